@@ -19,19 +19,66 @@
 #include "llvm/Target/TargetMachine.h"
 
 namespace AVRCC {
-  // AVR specific condition code.
+  // AVR specific condition code. There is one for each BRBS/BRBC alias,
+  // which come in pairs testing a flag for being set and cleared.
   enum CondCodes {
-    COND_E  = 0,  
-    COND_NE = 1,  
-    COND_HS = 2,  
-    COND_LO = 3,  
-    COND_GE = 4,
-    COND_L  = 5,
+    COND_E   = 0,  // breq, Z set
+    COND_NE  = 1,  // brne
+    COND_HS  = 2,  // brsh, C cleared, unsigned higher or same
+    COND_LO  = 3,  // brlo, C set
+    COND_GE  = 4,  // brge, S cleared
+    COND_L   = 5,  // brlt, S set
+    COND_MI  = 6,  // brmi, N set
+    COND_PL  = 7,  // brpl
+    COND_VS  = 8,  // brvs, V set
+    COND_VC  = 9,  // brvc
+    COND_TS  = 10, // brts, T set
+    COND_TC  = 11, // brtc
+    COND_HCS = 12, // brhs, H set
+    COND_HCC = 13, // brhc
+    COND_IE  = 14, // brie, I set
+    COND_ID  = 15, // brid
 
     COND_INVALID = -1
   };
 }
 
+namespace AVRCallingConv {
+  // Calling conventions of interrupt service routines, "cc 84" and "cc 85"
+  // in the IR. They take no arguments, return with RETI and save whatever
+  // they touch. INTR enables interrupts first thing, SIGNAL runs with them
+  // disabled.
+  enum {
+    INTR   = 84,
+    SIGNAL = 85
+  };
+
+  inline bool isInterrupt(unsigned CC) {
+    return CC == INTR || CC == SIGNAL;
+  }
+}
+
+namespace AVRAS {
+  // Address spaces of the IR. Data memory is 0. Program memory is 1, read
+  // with LPM, and 2 to 6 are the 64K segments of a larger flash after the
+  // first, read with ELPM with RAMPZ set to the segment number, as
+  // __flash1 to __flash5 of avr-gcc. Globals in these go to .progmem.
+  enum {
+    DATA         = 0,
+    PROGMEM      = 1,
+    PROGMEM_LAST = 6
+  };
+
+  inline bool isProgramMemory(unsigned AS) {
+    return AS >= PROGMEM && AS <= PROGMEM_LAST;
+  }
+
+  /// getSegment - The 64K segment of program memory an address space is in.
+  inline unsigned getSegment(unsigned AS) {
+    return AS - PROGMEM;
+  }
+}
+
 namespace llvm {
   class AVRTargetMachine;
   class FunctionPass;
@@ -40,7 +87,8 @@ namespace llvm {
   FunctionPass *createAVRISelDag(AVRTargetMachine &TM,
                                     CodeGenOpt::Level OptLevel);
 
-  //FunctionPass *createAVRBranchSelectionPass();
+  FunctionPass *createAVRBranchSelectionPass();
+  FunctionPass *createAVRSpillToRegPass();
 
 } // end namespace llvm;
 
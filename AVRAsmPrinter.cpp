@@ -32,6 +32,7 @@
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/MCSymbol.h"
 #include "llvm/Target/Mangler.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
@@ -57,6 +58,11 @@ namespace {
                                unsigned OpNo, unsigned AsmVariant,
                                const char *ExtraCode, raw_ostream &O);
     void EmitInstruction(const MachineInstr *MI);
+
+  private:
+    void EmitSkipIfClear(unsigned Reg, unsigned Bit);
+    void EmitUnary(unsigned Opc, unsigned Reg);
+    void EmitVariableShift(const MachineInstr *MI);
   };
 } // end of anonymous namespace
 
@@ -142,7 +148,81 @@ bool AVRAsmPrinter::PrintAsmMemoryOperand(const MachineInstr *MI,
 }
 
 //===----------------------------------------------------------------------===//
+void AVRAsmPrinter::EmitSkipIfClear(unsigned Reg, unsigned Bit) {
+  MCInst Inst;
+  Inst.setOpcode(AVR::SBRCrb);
+  Inst.addOperand(MCOperand::CreateReg(Reg));
+  Inst.addOperand(MCOperand::CreateImm(Bit));
+  OutStreamer.EmitInstruction(Inst);
+}
+
+void AVRAsmPrinter::EmitUnary(unsigned Opc, unsigned Reg) {
+  MCInst Inst;
+  Inst.setOpcode(Opc);
+  Inst.addOperand(MCOperand::CreateReg(Reg));
+  Inst.addOperand(MCOperand::CreateReg(Reg));
+  OutStreamer.EmitInstruction(Inst);
+}
+
+/// EmitVariableShift - Expand a variable 8-bit shift into a branch free
+/// sequence: the value is shifted by 4, 2 and 1 bits, each step guarded by
+/// a skip on the matching bit of the amount. A shift by 4 is a SWAP and an
+/// ANDI for the logical shifts, which are guarded one by one.
+void AVRAsmPrinter::EmitVariableShift(const MachineInstr *MI) {
+  unsigned Dst = MI->getOperand(0).getReg();
+  unsigned Src = MI->getOperand(1).getReg();
+  unsigned Cnt = MI->getOperand(2).getReg();
+
+  unsigned ShiftOpc, Mask = 0;
+  switch (MI->getOpcode()) {
+  default: llvm_unreachable("Invalid shift opcode!");
+  case AVR::Shl8: ShiftOpc = AVR::Shl8r1;  Mask = 0xf0; break;
+  case AVR::Srl8: ShiftOpc = AVR::Shr8r1;  Mask = 0x0f; break;
+  case AVR::Sra8: ShiftOpc = AVR::Shr8r1c; break;
+  }
+
+  MCInst Move;
+  Move.setOpcode(AVR::MOV8rr);
+  Move.addOperand(MCOperand::CreateReg(Dst));
+  Move.addOperand(MCOperand::CreateReg(Src));
+  OutStreamer.EmitInstruction(Move);
+
+  if (Mask) {
+    EmitSkipIfClear(Cnt, 2);
+    EmitUnary(AVR::SWAP8r, Dst);
+    EmitSkipIfClear(Cnt, 2);
+    MCInst And;
+    And.setOpcode(AVR::AND8ri);
+    And.addOperand(MCOperand::CreateReg(Dst));
+    And.addOperand(MCOperand::CreateReg(Dst));
+    And.addOperand(MCOperand::CreateImm(Mask));
+    OutStreamer.EmitInstruction(And);
+  } else {
+    for (unsigned i = 0; i != 4; ++i) {
+      EmitSkipIfClear(Cnt, 2);
+      EmitUnary(ShiftOpc, Dst);
+    }
+  }
+
+  for (unsigned i = 0; i != 2; ++i) {
+    EmitSkipIfClear(Cnt, 1);
+    EmitUnary(ShiftOpc, Dst);
+  }
+
+  EmitSkipIfClear(Cnt, 0);
+  EmitUnary(ShiftOpc, Dst);
+}
+
 void AVRAsmPrinter::EmitInstruction(const MachineInstr *MI) {
+  switch (MI->getOpcode()) {
+  default: break;
+  case AVR::Shl8:
+  case AVR::Srl8:
+  case AVR::Sra8:
+    EmitVariableShift(MI);
+    return;
+  }
+
   AVRMCInstLower MCInstLowering(OutContext, *Mang, *this);
 
   MCInst TmpInst;
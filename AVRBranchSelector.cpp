@@ -0,0 +1,207 @@
+//===-- AVRBranchSelector.cpp - Emit long conditional branches ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that scans a machine function to determine which
+// branches do not reach their destination. Conditional branches reach 64
+// words and RJMP 2K words either way; a conditional branch that is too short
+// is turned around to skip over a RJMP, or a JMP if even that does not reach.
+// Devices without JMP have at most 8K of flash, which RJMP covers as it
+// wraps around. The jumps on a bit are split up into their skip and a RJMP
+// first, the skip passes over a JMP just as well.
+// This pass should be run last, just before the assembly printer.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "avr-branch-select"
+#include "AVR.h"
+#include "AVRInstrInfo.h"
+#include "AVRSubtarget.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/MathExtras.h"
+using namespace llvm;
+
+STATISTIC(NumExpanded, "Number of branches expanded to long format");
+
+namespace {
+  struct AVRBSel : public MachineFunctionPass {
+    static char ID;
+    AVRBSel() : MachineFunctionPass(ID) {}
+
+    /// BlockSizes - The sizes of the basic blocks in the function.
+    std::vector<unsigned> BlockSizes;
+
+    /// BlockOffsets - The offsets of the basic blocks from the start of the
+    /// function, as of the last sizing.
+    std::vector<unsigned> BlockOffsets;
+
+    virtual bool runOnMachineFunction(MachineFunction &Fn);
+
+    virtual const char *getPassName() const {
+      return "AVR Branch Selector";
+    }
+  };
+  char AVRBSel::ID = 0;
+}
+
+/// createAVRBranchSelectionPass - returns an instance of the Branch
+/// Selection Pass
+///
+FunctionPass *llvm::createAVRBranchSelectionPass() {
+  return new AVRBSel();
+}
+
+bool AVRBSel::runOnMachineFunction(MachineFunction &Fn) {
+  const AVRInstrInfo *TII =
+    static_cast<const AVRInstrInfo*>(Fn.getTarget().getInstrInfo());
+  bool HasJMP = Fn.getTarget().getSubtarget<AVRSubtarget>().hasJMPCALL();
+  // Split up the jumps on a bit, a SBIC or SBRC skipping over the RJMP jumps
+  // if the bit is set, a SBIS or SBRS if it is cleared.
+  bool EverMadeChange = false;
+  for (MachineFunction::iterator MFI = Fn.begin(), E = Fn.end(); MFI != E;
+       ++MFI) {
+    MachineBasicBlock &MBB = *MFI;
+    for (MachineBasicBlock::iterator I = MBB.getFirstTerminator(),
+         IE = MBB.end(); I != IE; ) {
+      MachineInstr *MI = I++;
+      unsigned SkipOpc;
+      switch (MI->getOpcode()) {
+      default:          continue;
+      case AVR::BRBSAb: SkipOpc = AVR::SBICAb; break;
+      case AVR::BRBCAb: SkipOpc = AVR::SBISAb; break;
+      case AVR::BRBSrb: SkipOpc = AVR::SBRCrb; break;
+      case AVR::BRBCrb: SkipOpc = AVR::SBRSrb; break;
+      }
+
+      DebugLoc dl = MI->getDebugLoc();
+      BuildMI(MBB, MI, dl, TII->get(SkipOpc))
+        .addOperand(MI->getOperand(1)).addOperand(MI->getOperand(2));
+      BuildMI(MBB, MI, dl, TII->get(AVR::RJMP))
+        .addMBB(MI->getOperand(0).getMBB());
+      MI->eraseFromParent();
+      EverMadeChange = true;
+    }
+  }
+
+  // Give the blocks of the function a dense, in-order, numbering.
+  Fn.RenumberBlocks();
+  BlockSizes.resize(Fn.getNumBlockIDs());
+  BlockOffsets.resize(Fn.getNumBlockIDs());
+
+  // Measure each MBB and compute a size for the entire function.
+  unsigned FuncSize = 0;
+  for (MachineFunction::iterator MFI = Fn.begin(), E = Fn.end(); MFI != E;
+       ++MFI) {
+    MachineBasicBlock *MBB = MFI;
+
+    unsigned BlockSize = 0;
+    for (MachineBasicBlock::iterator MBBI = MBB->begin(), EE = MBB->end();
+         MBBI != EE; ++MBBI)
+      BlockSize += TII->GetInstSizeInBytes(MBBI);
+
+    BlockSizes[MBB->getNumber()] = BlockSize;
+    FuncSize += BlockSize;
+  }
+
+  // If the entire function is within the reach of a conditional branch, we
+  // know we don't need to expand any branches in this function. This is a
+  // common case.
+  if (FuncSize <= 128) {
+    BlockSizes.clear();
+    BlockOffsets.clear();
+    return EverMadeChange;
+  }
+
+  // For each branch, if the offset to its destination is larger than the
+  // offset field allows, transform it into a long branch sequence like this:
+  //   short branch:
+  //     brCC MBB
+  //   long branch:
+  //     br!CC .+2
+  //     rjmp MBB
+  // with a JMP instead of the RJMP if the RJMP does not reach either.
+  bool MadeChange = true;
+  while (MadeChange) {
+    // Iteratively expand branches until we reach a fixed point.
+    MadeChange = false;
+
+    unsigned Offset = 0;
+    for (unsigned i = 0, e = BlockSizes.size(); i != e; ++i) {
+      BlockOffsets[i] = Offset;
+      Offset += BlockSizes[i];
+    }
+
+    for (MachineFunction::iterator MFI = Fn.begin(), E = Fn.end(); MFI != E;
+         ++MFI) {
+      MachineBasicBlock &MBB = *MFI;
+      unsigned MBBOffset = BlockOffsets[MBB.getNumber()];
+      for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end();
+           I != E; ++I) {
+        bool isCond = I->getOpcode() == AVR::JCC && I->getOperand(0).isMBB();
+        if (!isCond && I->getOpcode() != AVR::RJMP) {
+          MBBOffset += TII->GetInstSizeInBytes(I);
+          continue;
+        }
+
+        // Determine the displacement from the instruction following the
+        // branch, which is what the branch is relative to.
+        MachineBasicBlock *Dest = I->getOperand(0).getMBB();
+        int Disp = int(BlockOffsets[Dest->getNumber()]) - int(MBBOffset + 2);
+
+        // If this branch is in range, ignore it.
+        if (isCond ? isInt<8>(Disp) : (isInt<13>(Disp) || !HasJMP)) {
+          MBBOffset += 2;
+          continue;
+        }
+
+        // Otherwise, we have to expand it to a long branch.
+        unsigned NewSize;
+        MachineInstr *OldBranch = I;
+        DebugLoc dl = OldBranch->getDebugLoc();
+
+        if (isCond) {
+          // The jump follows the turned around branch, its displacement is
+          // one word less.
+          bool isShort = isInt<13>(Disp - 2) || !HasJMP;
+          unsigned JumpSize = isShort ? 2 : 4;
+
+          SmallVector<MachineOperand, 1> Cond;
+          Cond.push_back(I->getOperand(1));
+          TII->ReverseBranchCondition(Cond);
+          BuildMI(MBB, I, dl, TII->get(AVR::JCC))
+            .addImm(JumpSize).addOperand(Cond[0]);
+          I = BuildMI(MBB, I, dl, TII->get(isShort ? AVR::RJMP : AVR::JMP))
+            .addMBB(Dest);
+          NewSize = 2 + JumpSize;
+        } else {
+          I = BuildMI(MBB, I, dl, TII->get(AVR::JMP)).addMBB(Dest);
+          NewSize = 4;
+        }
+
+        // Remove the old branch from the function.
+        OldBranch->eraseFromParent();
+
+        // Remember that this instruction is NewSize bytes, increase the size
+        // of the block by NewSize-2, remember to iterate.
+        BlockSizes[MBB.getNumber()] += NewSize - 2;
+        MBBOffset += NewSize;
+
+        ++NumExpanded;
+        MadeChange = true;
+      }
+    }
+    EverMadeChange |= MadeChange;
+  }
+
+  BlockSizes.clear();
+  BlockOffsets.clear();
+  return EverMadeChange;
+}
@@ -14,6 +14,7 @@
 #include "AVRFrameLowering.h"
 #include "AVRInstrInfo.h"
 #include "AVRMachineFunctionInfo.h"
+#include "AVRSubtarget.h"
 #include "llvm/Function.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -21,50 +22,205 @@
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/Target/TargetData.h"
+#include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
-// For the AVR, accessing stack slots without a stack frame is expensive, as SP is not a register
-// that can be used for indirect load. Using SP as the base register will therefore involve
-// a couple of INs into an indexed register followed by an indexed load or store. Doing this for
-// every stack slot access is going to blow up the function size very quickly.
-// So, if stack slots are needed, setup the stack frame with Y always.
+// For the AVR, accessing stack slots without a stack frame is expensive, as
+// SP is not a register that can be used for indirect load. Using SP as the
+// base register involves a couple of INs into a pointer register followed
+// by an indexed load or store. So Y is set up as frame pointer whenever the
+// function has stack objects of its own. Spill slots are made by the
+// register allocator, after it has been decided whether Y is free to
+// allocate, so they are reached through a pointer loaded from SP if there
+// is no frame pointer.
 
 bool AVRFrameLowering::hasFP(const MachineFunction &MF) const {
   const MachineFrameInfo *MFI = MF.getFrameInfo();
-  const AVRMachineFunctionInfo *AVRFI = MF.getInfo<AVRMachineFunctionInfo>();
-  const uint64_t NumStackBytes = MFI->getStackSize() - AVRFI->getCalleeSavedFrameSize();
 
-  return (MF.getTarget().Options.DisableFramePointerElim(MF) ||
-          MF.getFrameInfo()->hasVarSizedObjects() ||
-          MFI->isFrameAddressTaken());
+  if (MF.getTarget().Options.DisableFramePointerElim(MF) ||
+      MFI->hasVarSizedObjects() || MFI->isFrameAddressTaken())
+    return true;
+
+  for (int i = MFI->getObjectIndexBegin(), e = MFI->getObjectIndexEnd();
+       i != e; ++i)
+    if (!MFI->isDeadObjectIndex(i) && !MFI->isSpillSlotObjectIndex(i))
+      return true;
+
+  return false;
 }
 
 bool AVRFrameLowering::hasReservedCallFrame(const MachineFunction &MF) const {
   return !MF.getFrameInfo()->hasVarSizedObjects();
 }
 
+/// readSP - Copy SP into the pair Reg.
+void AVRFrameLowering::readSP(MachineBasicBlock &MBB,
+                              MachineBasicBlock::iterator MBBI, DebugLoc DL,
+                              unsigned Reg) const {
+  const TargetMachine &TM = MBB.getParent()->getTarget();
+  const TargetInstrInfo &TII = *TM.getInstrInfo();
+  const TargetRegisterInfo &TRI = *TM.getRegisterInfo();
+
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::IN),
+          TRI.getSubReg(Reg, AVR::subreg_loreg))
+    .addReg(AVR::SPL);
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::IN),
+          TRI.getSubReg(Reg, AVR::subreg_hireg))
+    .addReg(AVR::SPH);
+}
+
+/// writeSP - Copy the pair Reg into SP. An interrupt between the writes of
+/// the two halves would see a bogus SP, so they are done with interrupts
+/// off. Restoring SREG enables them again only after the next instruction,
+/// which is the write of the low half. The XMEGA holds off interrupts by
+/// itself after a write of SPL, so there it is written first.
+static void writeSP(MachineBasicBlock &MBB, MachineBasicBlock::iterator MBBI,
+                    DebugLoc DL, const TargetInstrInfo &TII,
+                    const TargetRegisterInfo &TRI, unsigned Reg) {
+  if (MBB.getParent()->getTarget().getSubtarget<AVRSubtarget>().isXMEGA()) {
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPL)
+      .addReg(TRI.getSubReg(Reg, AVR::subreg_loreg));
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPH)
+      .addReg(TRI.getSubReg(Reg, AVR::subreg_hireg));
+    return;
+  }
+
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::INSREG), AVR::R0);
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::CLI));
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPH)
+    .addReg(TRI.getSubReg(Reg, AVR::subreg_hireg));
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::OUTSREG))
+    .addReg(AVR::R0, RegState::Kill);
+  BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPL)
+    .addReg(TRI.getSubReg(Reg, AVR::subreg_loreg));
+}
+
+/// addToPair - Add Amount to the pair Reg, which is Y or Z. ADIW and SBIW
+/// take 6 bits, larger amounts, or any on a device without them, are
+/// subtracted a byte at a time.
+void AVRFrameLowering::addToPair(MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator MBBI,
+                                 DebugLoc DL, unsigned Reg, int Amount) const {
+  const TargetMachine &TM = MBB.getParent()->getTarget();
+  const TargetInstrInfo &TII = *TM.getInstrInfo();
+  const TargetRegisterInfo &TRI = *TM.getRegisterInfo();
+
+  if (Amount == 0)
+    return;
+
+  bool HasADDSUBIW = TM.getSubtarget<AVRSubtarget>().hasADDSUBIW();
+  if (HasADDSUBIW && Amount > 0 && Amount < 64) {
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::ADD16wri), Reg)
+      .addReg(Reg).addImm(Amount);
+  } else if (HasADDSUBIW && Amount < 0 && Amount > -64) {
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::SUB16wri), Reg)
+      .addReg(Reg).addImm(-Amount);
+  } else {
+    unsigned Lo = TRI.getSubReg(Reg, AVR::subreg_loreg);
+    unsigned Hi = TRI.getSubReg(Reg, AVR::subreg_hireg);
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::SUB8ri), Lo)
+      .addReg(Lo).addImm(-Amount & 0xff);
+    BuildMI(MBB, MBBI, DL, TII.get(AVR::SBC8ri), Hi)
+      .addReg(Hi).addImm((-Amount >> 8) & 0xff);
+  }
+}
+
+/// isPushPopCheaper - A run of PUSH or POP is one word per byte. Moving SP
+/// through a pair is one or two words to add and five to write it back,
+/// plus two to read SP if the pair does not already hold it.
+static bool isPushPopCheaper(int Amount, bool HaveSP) {
+  if (Amount < 0)
+    Amount = -Amount;
+  unsigned Cost = (Amount < 64 ? 1 : 2) + 5 + (HaveSP ? 0 : 2);
+  return unsigned(Amount) <= Cost;
+}
+
+/// adjustStackPointer - Move SP by Amount bytes, negative to allocate, as
+/// pushes or pops of R0 for small amounts, or else through the pair Reg,
+/// which is clobbered.
+void AVRFrameLowering::adjustStackPointer(MachineBasicBlock &MBB,
+                                          MachineBasicBlock::iterator MBBI,
+                                          DebugLoc DL, int Amount,
+                                          unsigned Reg) const {
+  MachineFunction &MF = *MBB.getParent();
+  const TargetInstrInfo &TII = *MF.getTarget().getInstrInfo();
+  const TargetRegisterInfo &TRI = *MF.getTarget().getRegisterInfo();
+
+  if (Amount == 0)
+    return;
+
+  if (isPushPopCheaper(Amount, false)) {
+    // Only the change of SP matters, not what is pushed or popped.
+    for (int i = 0; i < -Amount; ++i)
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R0, RegState::Undef);
+    for (int i = 0; i < Amount; ++i)
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::POP), AVR::R0);
+    return;
+  }
+
+  readSP(MBB, MBBI, DL, Reg);
+  addToPair(MBB, MBBI, DL, Reg, Amount);
+  writeSP(MBB, MBBI, DL, TII, TRI, Reg);
+}
+
 void AVRFrameLowering::emitPrologue(MachineFunction &MF) const {
-  
   MachineBasicBlock &MBB = MF.front();   // Prolog goes in entry BB
   MachineFrameInfo *MFI = MF.getFrameInfo();
   AVRMachineFunctionInfo *AVRFI = MF.getInfo<AVRMachineFunctionInfo>();
   const AVRInstrInfo &TII =
     *static_cast<const AVRInstrInfo*>(MF.getTarget().getInstrInfo());
+  const TargetRegisterInfo &TRI = *MF.getTarget().getRegisterInfo();
+
+  const Function *F = MF.getFunction();
+
+  // Naked functions bring their own prologue.
+  if (F->hasFnAttr(Attribute::Naked))
+    return;
 
   MachineBasicBlock::iterator MBBI = MBB.begin();
   DebugLoc DL = MBBI != MBB.end() ? MBBI->getDebugLoc() : DebugLoc();
 
-  // Get the number of bytes to allocate from the FrameInfo.
-  uint64_t StackSize = MFI->getStackSize();
+  // Interrupt service routines first save R1, R0, the flags and RAMPZ, as
+  // far as they are clobbered, and clear R1 for the code that expects it zero.
+  // An interruptible one turns interrupts back on before anything else.
+  CallingConv::ID CC = F->getCallingConv();
+  if (AVRCallingConv::isInterrupt(CC)) {
+    if (CC == AVRCallingConv::INTR)
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::SEI));
+    if (AVRFI->savesR1())
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R1, RegState::Kill);
+    if (AVRFI->savesR0())
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R0, RegState::Kill);
+    if (AVRFI->savesSREG()) {
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::INSREG), AVR::R0);
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R0, RegState::Kill);
+    }
+    if (AVRFI->savesRAMPZ()) {
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::IN), AVR::R0)
+        .addReg(AVR::RAMPZ);
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R0, RegState::Kill);
+    }
+    if (AVRFI->savesR1())
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::XOR8rr), AVR::R1)
+        .addReg(AVR::R1, RegState::Undef)
+        .addReg(AVR::R1, RegState::Undef);
+  }
 
-  // Calculate required stack adjustment
-  uint64_t FrameSize = StackSize;
-  uint64_t NumBytes = FrameSize - AVRFI->getCalleeSavedFrameSize();
+  // Get the number of bytes to allocate from the FrameInfo. The saved FP
+  // and callee-saved registers are pushed, not allocated.
+  uint64_t StackSize = MFI->getStackSize();
+  uint64_t NumBytes = StackSize - AVRFI->getCalleeSavedFrameSize();
 
   if (hasFP(MF)) {
+    NumBytes -= 2;
 
     // Save FPW into the appropriate stack slot...
     BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
@@ -74,7 +230,6 @@ void AVRFrameLowering::emitPrologue(MachineFunction &MF) const {
       .addReg(AVR::R29, RegState::Kill);
    }
 
-
   // Skip the callee-saved push instructions.
   while (MBBI != MBB.end() && (MBBI->getOpcode() == AVR::PUSH))
     ++MBBI;
@@ -82,37 +237,32 @@ void AVRFrameLowering::emitPrologue(MachineFunction &MF) const {
   if (MBBI != MBB.end())
     DL = MBBI->getDebugLoc();
 
-  // Write IN R30, SPL
-  //       SBCI R30, NumBytes
-  //       OUT SPL, R30
-
-  if (NumBytes) { // adjust stack pointer: SPW -= numbytes
-      MachineInstr *MI =
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::IN), AVR::R29)
-        .addReg(AVR::SPL);
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::IN), AVR::R28)
-        .addReg(AVR::SPH);
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::SUB8wri), AVR::R28)
-        .addReg(AVR::R30).addImm(NumBytes);
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPL)
-        .addReg(AVR::R28);
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::OUT), AVR::SPH)
-        .addReg(AVR::R29);
-      // The SRW implicit def is dead.
-      //MI->getOperand(3).setIsDead();
-
-      }
-
-  // Set the FP register to the updated SP. Setting it at the top
-  // of the stack frame allows std y+d instructions (stack grows down).
-  if (hasFP(MF) || NumBytes) {
-
-    // Mark the FramePtr as live-in in every block except the entry.
-    for (MachineFunction::iterator I = llvm::next(MF.begin()), E = MF.end();
-        I != E; ++I) {
-      I->addLiveIn(AVR::R28);
-      I->addLiveIn(AVR::R29);
-    }
+  // Without a frame pointer the frame only holds spill slots, Z is free
+  // to move SP with.
+  if (!hasFP(MF)) {
+    adjustStackPointer(MBB, MBBI, DL, -int(NumBytes), AVR::Z);
+    return;
+  }
+
+  // Allocate the frame and point Y at the new SP, so that the frame starts
+  // at Y+1 (stack grows down). A small frame is pushed and Y read from SP
+  // afterwards, a larger one is made by moving Y down and writing it to SP.
+  if (isPushPopCheaper(NumBytes, false)) {
+    for (uint64_t i = 0; i != NumBytes; ++i)
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::PUSH))
+        .addReg(AVR::R0, RegState::Undef);
+    readSP(MBB, MBBI, DL, AVR::Y);
+  } else {
+    readSP(MBB, MBBI, DL, AVR::Y);
+    addToPair(MBB, MBBI, DL, AVR::Y, -int(NumBytes));
+    writeSP(MBB, MBBI, DL, TII, TRI, AVR::Y);
+  }
+
+  // Mark the FramePtr as live-in in every block except the entry.
+  for (MachineFunction::iterator I = llvm::next(MF.begin()), E = MF.end();
+       I != E; ++I) {
+    I->addLiveIn(AVR::R28);
+    I->addLiveIn(AVR::R29);
   }
 }
 
@@ -122,6 +272,13 @@ void AVRFrameLowering::emitEpilogue(MachineFunction &MF,
   AVRMachineFunctionInfo *AVRFI = MF.getInfo<AVRMachineFunctionInfo>();
   const AVRInstrInfo &TII =
     *static_cast<const AVRInstrInfo*>(MF.getTarget().getInstrInfo());
+  const TargetRegisterInfo &TRI = *MF.getTarget().getRegisterInfo();
+
+  const Function *F = MF.getFunction();
+
+  // Naked functions bring their own epilogue.
+  if (F->hasFnAttr(Attribute::Naked))
+    return;
 
   MachineBasicBlock::iterator MBBI = MBB.getLastNonDebugInstr();
   unsigned RetOpcode = MBBI->getOpcode();
@@ -129,19 +286,47 @@ void AVRFrameLowering::emitEpilogue(MachineFunction &MF,
 
   switch (RetOpcode) {
   case AVR::RET:
-  case AVR::RETI: break;  // These are ok
+  case AVR::RETI:
+  case AVR::TCRETURNdi:
+  case AVR::TCRETURNri: break;  // These are ok
   default:
     llvm_unreachable("Can only insert epilog into returning blocks");
   }
 
+  // Restore what an interrupt service routine saved ahead of everything
+  // else, just before the RETI, and put the rest of the epilogue in front.
+  if (AVRCallingConv::isInterrupt(F->getCallingConv()) &&
+      AVRFI->getInterruptSaveSize()) {
+    // R0 is saved whenever anything else is but R1, so the postamble
+    // starts with the first POP R0, or else POP R1.
+    MachineBasicBlock::iterator RetI = MBBI;
+    if (AVRFI->savesR0())
+      MBBI = BuildMI(MBB, RetI, DL, TII.get(AVR::POP), AVR::R0);
+    if (AVRFI->savesRAMPZ()) {
+      BuildMI(MBB, RetI, DL, TII.get(AVR::OUT), AVR::RAMPZ)
+        .addReg(AVR::R0, RegState::Kill);
+      BuildMI(MBB, RetI, DL, TII.get(AVR::POP), AVR::R0);
+    }
+    if (AVRFI->savesSREG()) {
+      BuildMI(MBB, RetI, DL, TII.get(AVR::OUTSREG))
+        .addReg(AVR::R0, RegState::Kill);
+      BuildMI(MBB, RetI, DL, TII.get(AVR::POP), AVR::R0);
+    }
+    if (AVRFI->savesR1()) {
+      MachineBasicBlock::iterator I =
+        BuildMI(MBB, RetI, DL, TII.get(AVR::POP), AVR::R1);
+      if (!AVRFI->savesR0())
+        MBBI = I;
+    }
+  }
+
   // Get the number of bytes to allocate from the FrameInfo
   uint64_t StackSize = MFI->getStackSize();
   unsigned CSSize = AVRFI->getCalleeSavedFrameSize();
-  uint64_t FrameSize = StackSize;
-  uint64_t NumBytes = FrameSize - CSSize;
+  uint64_t NumBytes = StackSize - CSSize;
 
   if (hasFP(MF)) {
-    // Calculate required stack adjustment
+    NumBytes -= 2;
 
     // pop FPW.
     BuildMI(MBB, MBBI, DL, TII.get(AVR::POP), AVR::R29);
@@ -159,18 +344,45 @@ void AVRFrameLowering::emitEpilogue(MachineFunction &MF,
 
   DL = MBBI->getDebugLoc();
 
-  if (MFI->hasVarSizedObjects()) {
-    assert(false && "Variable sized objects not handled yet.");
+  // Free the frame. Z is not a return register, so without a frame pointer
+  // it is free to move SP with, unless it holds the target of a tail call,
+  // in which case X is, as it takes no arguments. Otherwise Y still points
+  // just below the frame, so if SP has moved with variable sized objects, or
+  // the frame is not small, SP is set from Y.
+  if (!hasFP(MF))
+    adjustStackPointer(MBB, MBBI, DL, NumBytes,
+                       RetOpcode == AVR::TCRETURNri ? AVR::X : AVR::Z);
+  else if (MFI->hasVarSizedObjects() || !isPushPopCheaper(NumBytes, true)) {
+    addToPair(MBB, MBBI, DL, AVR::Y, NumBytes);
+    writeSP(MBB, MBBI, DL, TII, TRI, AVR::Y);
   } else {
-    // adjust stack pointer back: SPW += numbytes by repeatedly doing POP r0
-    if (NumBytes) {
-      for (uint64_t i = 0; i<NumBytes; ++i)
-      {
-      MachineInstr *MI =
-        BuildMI(MBB, MBBI, DL, TII.get(AVR::POP))
-        .addReg(AVR::R0);
-      }
+    for (uint64_t i = 0; i != NumBytes; ++i)
+      BuildMI(MBB, MBBI, DL, TII.get(AVR::POP), AVR::R0);
+  }
+
+  // With the frame gone, a tail call jumps to the callee, which returns to
+  // the caller of this function. Devices without JMP have little enough
+  // flash for RJMP to reach anywhere.
+  if (RetOpcode == AVR::TCRETURNdi || RetOpcode == AVR::TCRETURNri) {
+    MBBI = MBB.getLastNonDebugInstr();
+    DL = MBBI->getDebugLoc();
+
+    MachineInstrBuilder MIB;
+    if (RetOpcode == AVR::TCRETURNri)
+      MIB = BuildMI(MBB, MBBI, DL, TII.get(AVR::TAILIJMP))
+        .addReg(AVR::Z, RegState::Implicit | RegState::Kill);
+    else {
+      bool HasJMP = MF.getTarget().getSubtarget<AVRSubtarget>().hasJMPCALL();
+      MIB = BuildMI(MBB, MBBI, DL,
+                    TII.get(HasJMP ? AVR::TAILJMP : AVR::TAILRJMP))
+        .addOperand(MBBI->getOperand(0));
     }
+
+    // Keep the argument registers live into the jump.
+    for (unsigned i = 1, e = MBBI->getNumOperands(); i != e; ++i)
+      MIB.addOperand(MBBI->getOperand(i));
+
+    MBB.erase(MBBI);
   }
 }
 
@@ -189,7 +401,7 @@ AVRFrameLowering::spillCalleeSavedRegisters(MachineBasicBlock &MBB,
   MachineFunction &MF = *MBB.getParent();
   const TargetInstrInfo &TII = *MF.getTarget().getInstrInfo();
   AVRMachineFunctionInfo *MFI = MF.getInfo<AVRMachineFunctionInfo>();
-  MFI->setCalleeSavedFrameSize(CSI.size() * 2);
+  MFI->setCalleeSavedFrameSize(CSI.size());
 
   for (unsigned i = CSI.size(); i != 0; --i) {
     unsigned Reg = CSI[i-1].getReg();
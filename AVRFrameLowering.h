@@ -41,6 +41,14 @@ public:
                                    const std::vector<CalleeSavedInfo> &CSI,
                                    const TargetRegisterInfo *TRI) const;
 
+  void readSP(MachineBasicBlock &MBB, MachineBasicBlock::iterator MBBI,
+              DebugLoc DL, unsigned Reg) const;
+  void addToPair(MachineBasicBlock &MBB, MachineBasicBlock::iterator MBBI,
+                 DebugLoc DL, unsigned Reg, int Amount) const;
+  void adjustStackPointer(MachineBasicBlock &MBB,
+                          MachineBasicBlock::iterator MBBI, DebugLoc DL,
+                          int Amount, unsigned Reg) const;
+
   bool hasFP(const MachineFunction &MF) const;
   bool hasReservedCallFrame(const MachineFunction &MF) const;
 };
@@ -92,10 +92,15 @@ namespace {
   class AVRDAGToDAGISel : public SelectionDAGISel {
     const AVRTargetLowering &Lowering;
 
+    /// Subtarget - Keep a pointer to the AVRSubtarget around so that we can
+    /// make the right decision when generating code for different targets.
+    const AVRSubtarget *Subtarget;
+
   public:
     AVRDAGToDAGISel(AVRTargetMachine &TM, CodeGenOpt::Level OptLevel)
       : SelectionDAGISel(TM, OptLevel),
-        Lowering(*TM.getTargetLowering())
+        Lowering(*TM.getTargetLowering()),
+        Subtarget(&TM.getSubtarget<AVRSubtarget>())
         { }
 
     virtual const char *getPassName() const {
@@ -106,6 +111,8 @@ namespace {
     bool MatchWrapper(SDValue N, AVRISelAddressMode &AM);
     bool MatchAddressBase(SDValue N, AVRISelAddressMode &AM);
 
+    virtual void PreprocessISelDAG();
+
     virtual bool
     SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
                                  std::vector<SDValue> &OutOps);
@@ -116,10 +123,16 @@ namespace {
   private:
     SDNode *Select(SDNode *N);
     SDNode *SelectIndexedLoad(SDNode *Op);
+    SDNode *SelectProgMemLoad(SDNode *Op);
+    SDNode *SelectIndexedStore(SDNode *Op);
     SDNode *SelectIndexedBinOp(SDNode *Op, SDValue N1, SDValue N2,
                                unsigned Opc8, unsigned Opc16);
 
-    bool SelectAddr(SDValue Addr, SDValue &Base, SDValue &Disp);
+    bool SelectAddr(SDNode *Parent, SDValue Addr,
+                    SDValue &Base, SDValue &Disp);
+    bool SelectAbsAddr(SDValue Addr, SDValue &Abs);
+    bool SelectIOAddr(SDValue Addr, SDValue &A);
+    bool SelectLowIOAddr(SDValue Addr, SDValue &A);
   };
 }  // end anonymous namespace
 
@@ -136,8 +149,6 @@ FunctionPass *llvm::createAVRISelDag(AVRTargetMachine &TM,
 /// These wrap things that will resolve down into a symbol reference.  If no
 /// match is possible, this returns true, otherwise it returns false.
 bool AVRDAGToDAGISel::MatchWrapper(SDValue N, AVRISelAddressMode &AM) {
-  return true;
-  /*
   // If the addressing mode already has a symbol as the displacement, we can
   // never match another symbol.
   if (AM.hasSymbolicDisplacement())
@@ -148,25 +159,19 @@ bool AVRDAGToDAGISel::MatchWrapper(SDValue N, AVRISelAddressMode &AM) {
   if (GlobalAddressSDNode *G = dyn_cast<GlobalAddressSDNode>(N0)) {
     AM.GV = G->getGlobal();
     AM.Disp += G->getOffset();
-    //AM.SymbolFlags = G->getTargetFlags();
   } else if (ConstantPoolSDNode *CP = dyn_cast<ConstantPoolSDNode>(N0)) {
     AM.CP = CP->getConstVal();
     AM.Align = CP->getAlignment();
     AM.Disp += CP->getOffset();
-    //AM.SymbolFlags = CP->getTargetFlags();
   } else if (ExternalSymbolSDNode *S = dyn_cast<ExternalSymbolSDNode>(N0)) {
     AM.ES = S->getSymbol();
-    //AM.SymbolFlags = S->getTargetFlags();
   } else if (JumpTableSDNode *J = dyn_cast<JumpTableSDNode>(N0)) {
     AM.JT = J->getIndex();
-    //AM.SymbolFlags = J->getTargetFlags();
   } else {
     AM.BlockAddr = cast<BlockAddressSDNode>(N0)->getBlockAddress();
-    //AM.SymbolFlags = cast<BlockAddressSDNode>(N0)->getTargetFlags();
   }
-  
+
   return false;
-  */
 }
 
 /// MatchAddressBase - Helper for MatchAddress. Add the specified node to the
@@ -246,46 +251,138 @@ bool AVRDAGToDAGISel::MatchAddress(SDValue N, AVRISelAddressMode &AM) {
   return MatchAddressBase(N, AM);
 }
 
-/// SelectAddr - returns true if it is able pattern match an addressing mode.
-/// It returns the operands which make up the maximal addressing mode it can
-/// match by reference.
-bool AVRDAGToDAGISel::SelectAddr(SDValue N,
-                                    SDValue &Base, SDValue &Disp) {
+/// isInDispRange - Check that all bytes of an access of Size bytes at Disp
+/// can be reached by the 6-bit displacement of LDD and STD.
+static bool isInDispRange(int64_t Disp, unsigned Size) {
+  return Disp >= 0 && Disp + Size <= 64;
+}
+
+/// SelectAddr - Match the address of the load or store Parent as Y or Z
+/// with a displacement. Absolute addresses are left to SelectAbsAddr, and
+/// byte accesses right through a pointer to LD and ST, which can use X too.
+/// The 16-bit accesses are made of two LDD or STD, so they take any pointer.
+bool AVRDAGToDAGISel::SelectAddr(SDNode *Parent, SDValue N,
+                                 SDValue &Base, SDValue &Disp) {
+  unsigned Size = cast<MemSDNode>(Parent)->getMemoryVT().getStoreSize();
   AVRISelAddressMode AM;
 
   if (MatchAddress(N, AM))
     return false;
 
-  EVT VT = N.getValueType();
-  if (AM.BaseType == AVRISelAddressMode::RegBase) {
-    if (!AM.Base.Reg.getNode())
-      AM.Base.Reg = CurDAG->getRegister(0, VT);
+  bool isSymbolic = AM.hasSymbolicDisplacement() || AM.BlockAddr;
+  if (AM.BaseType == AVRISelAddressMode::FrameIndexBase && !isSymbolic) {
+    // Frame objects are reached off Y, eliminateFrameIndex takes care of
+    // offsets out of range.
+    Base = CurDAG->getTargetFrameIndex(AM.Base.FrameIndex,
+                                       TLI.getPointerTy());
+    Disp = CurDAG->getTargetConstant(AM.Disp, MVT::i16);
+    return true;
   }
 
-  Base  = (AM.BaseType == AVRISelAddressMode::FrameIndexBase) ?
-    CurDAG->getTargetFrameIndex(AM.Base.FrameIndex, TLI.getPointerTy()) :
-    AM.Base.Reg;
+  if (AM.BaseType == AVRISelAddressMode::RegBase && !AM.Base.Reg.getNode() &&
+      (AM.GV || !isSymbolic))
+    return false;
+
+  if (isSymbolic || !isInDispRange(AM.Disp, Size)) {
+    if (Size == 1)
+      return false;
+    AM.BaseType = AVRISelAddressMode::RegBase;
+    AM.Base.Reg = N;
+    AM.Disp = 0;
+  } else if (AM.Disp == 0 && Size == 1)
+    return false;
+
+  Base = AM.Base.Reg;
+  Disp = CurDAG->getTargetConstant(AM.Disp, MVT::i16);
+  return true;
+}
+
+/// SelectAbsAddr - Match an address known at link time: a constant, or a
+/// global plus a constant.
+bool AVRDAGToDAGISel::SelectAbsAddr(SDValue N, SDValue &Abs) {
+  AVRISelAddressMode AM;
+
+  if (MatchAddress(N, AM) || AM.Base.Reg.getNode() ||
+      AM.BaseType != AVRISelAddressMode::RegBase)
+    return false;
 
   if (AM.GV)
-    Disp = CurDAG->getTargetGlobalAddress(AM.GV, N->getDebugLoc(),
-                                          MVT::i16, AM.Disp,
-                                          0);
-  else if (AM.CP)
-    Disp = CurDAG->getTargetConstantPool(AM.CP, MVT::i16,
-                                         AM.Align, AM.Disp, 0);
-  else if (AM.ES)
-    Disp = CurDAG->getTargetExternalSymbol(AM.ES, MVT::i16, 0);
-  else if (AM.JT != -1)
-    Disp = CurDAG->getTargetJumpTable(AM.JT, MVT::i16, 0);
-  else if (AM.BlockAddr)
-    Disp = CurDAG->getBlockAddress(AM.BlockAddr, MVT::i32,
-                                   true, 0);
+    Abs = CurDAG->getTargetGlobalAddress(AM.GV, N->getDebugLoc(),
+                                         MVT::i16, AM.Disp, 0);
+  else if (!AM.hasSymbolicDisplacement() && !AM.BlockAddr)
+    Abs = CurDAG->getTargetConstant(AM.Disp, MVT::i16);
   else
-    Disp = CurDAG->getTargetConstant(AM.Disp, MVT::i16);
+    return false;
+
+  return true;
+}
+
+/// SelectIOAddr - Match a constant data address in the 64 registers of the
+/// I/O space, as the I/O address of IN and OUT.
+bool AVRDAGToDAGISel::SelectIOAddr(SDValue N, SDValue &A) {
+  ConstantSDNode *C = dyn_cast<ConstantSDNode>(N);
+  if (!C)
+    return false;
 
+  uint64_t Addr = C->getZExtValue();
+  unsigned Base = Subtarget->getIOBase();
+  if (Addr < Base || Addr >= Base + 64)
+    return false;
+
+  A = CurDAG->getTargetConstant(Addr - Base, MVT::i8);
   return true;
 }
 
+/// SelectLowIOAddr - As SelectIOAddr, for the low 32 registers that SBI,
+/// CBI, SBIS and SBIC reach.
+bool AVRDAGToDAGISel::SelectLowIOAddr(SDValue N, SDValue &A) {
+  return SelectIOAddr(N, A) && cast<ConstantSDNode>(A)->getZExtValue() < 32;
+}
+
+/// PreprocessISelDAG - Split displacements out of the range of LDD and STD
+/// into a multiple of 32 added to the base and a displacement in range.
+/// Accesses to the same object share the new base, so it is computed once.
+void AVRDAGToDAGISel::PreprocessISelDAG() {
+  for (SelectionDAG::allnodes_iterator I = CurDAG->allnodes_begin(),
+       E = CurDAG->allnodes_end(); I != E; ) {
+    LSBaseSDNode *LS = dyn_cast<LSBaseSDNode>(I++);
+    if (!LS || LS->getAddressingMode() != ISD::UNINDEXED ||
+        AVRAS::isProgramMemory(LS->getAddressSpace()))
+      continue;
+
+    // Frame objects are handled when the frame is laid out.
+    SDValue Ptr = LS->getBasePtr();
+    if (Ptr.getOpcode() != ISD::ADD ||
+        Ptr.getOperand(0).getOpcode() == ISD::FrameIndex ||
+        Ptr.getOperand(0).getOpcode() == AVRISD::Wrapper)
+      continue;
+
+    ConstantSDNode *C = dyn_cast<ConstantSDNode>(Ptr.getOperand(1));
+    if (!C)
+      continue;
+
+    int64_t Disp = C->getSExtValue();
+    unsigned Size = LS->getMemoryVT().getStoreSize();
+    if (Disp < 0 || isInDispRange(Disp, Size))
+      continue;
+
+    int64_t Offset = Disp & ~63;
+    if (!isInDispRange(Disp - Offset, Size))
+      Offset += 32;
+
+    DebugLoc dl = LS->getDebugLoc();
+    SDValue Base = CurDAG->getNode(ISD::ADD, dl, MVT::i16, Ptr.getOperand(0),
+                                   CurDAG->getConstant(Offset, MVT::i16));
+    SDValue NewPtr = CurDAG->getNode(ISD::ADD, dl, MVT::i16, Base,
+                                     CurDAG->getConstant(Disp - Offset,
+                                                         MVT::i16));
+
+    SmallVector<SDValue, 4> Ops(LS->op_begin(), LS->op_end());
+    Ops[isa<LoadSDNode>(LS) ? 1 : 2] = NewPtr;
+    CurDAG->UpdateNodeOperands(LS, &Ops[0], Ops.size());
+  }
+}
+
 bool AVRDAGToDAGISel::
 SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
                              std::vector<SDValue> &OutOps) {
@@ -293,8 +390,9 @@ SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
   switch (ConstraintCode) {
   default: return true;
   case 'm':   // memory
-    if (!SelectAddr(Op, Op0, Op1))
-      return true;
+    // Inline asm gets a plain pointer register.
+    Op0 = Op;
+    Op1 = CurDAG->getTargetConstant(0, MVT::i16);
     break;
   }
 
@@ -303,31 +401,38 @@ SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
   return false;
 }
 
-static bool isValidIndexedLoad(const LoadSDNode *LD) {
-  ISD::MemIndexedMode AM = LD->getAddressingMode();
-  if (AM != ISD::POST_INC || LD->getExtensionType() != ISD::NON_EXTLOAD)
+/// isValidIndexedAccess - Check that the pointer of an indexed load or
+/// store is moved by the size of the access. X, Y and Z can only be
+/// post-incremented and pre-decremented.
+static bool isValidIndexedAccess(ISD::MemIndexedMode AM, EVT VT,
+                                 SDValue Offset) {
+  if (AM != ISD::POST_INC && AM != ISD::PRE_DEC)
     return false;
 
-  EVT VT = LD->getMemoryVT();
-
   switch (VT.getSimpleVT().SimpleTy) {
   case MVT::i8:
-    // Sanity check
-    if (cast<ConstantSDNode>(LD->getOffset())->getZExtValue() != 1)
-      return false;
-
-    break;
   case MVT::i16:
     // Sanity check
-    if (cast<ConstantSDNode>(LD->getOffset())->getZExtValue() != 2)
-      return false;
-
-    break;
+    return cast<ConstantSDNode>(Offset)->getZExtValue() == VT.getStoreSize();
   default:
     return false;
   }
+}
 
-  return true;
+static bool isValidIndexedLoad(const LoadSDNode *LD) {
+  if (LD->getExtensionType() != ISD::NON_EXTLOAD)
+    return false;
+
+  return isValidIndexedAccess(LD->getAddressingMode(), LD->getMemoryVT(),
+                              LD->getOffset());
+}
+
+static bool isValidIndexedStore(const StoreSDNode *ST) {
+  if (ST->isTruncatingStore())
+    return false;
+
+  return isValidIndexedAccess(ST->getAddressingMode(), ST->getMemoryVT(),
+                              ST->getOffset());
 }
 
 SDNode *AVRDAGToDAGISel::SelectIndexedLoad(SDNode *N) {
@@ -336,22 +441,111 @@ SDNode *AVRDAGToDAGISel::SelectIndexedLoad(SDNode *N) {
     return NULL;
 
   MVT VT = LD->getMemoryVT().getSimpleVT();
+  bool isInc = LD->getAddressingMode() == ISD::POST_INC;
+
+  unsigned Opcode = 0;
+  switch (VT.SimpleTy) {
+  case MVT::i8:
+    Opcode = isInc ? AVR::LD8rm_P : AVR::LD8rm_PD;
+    break;
+  case MVT::i16:
+    Opcode = isInc ? AVR::LD16rm_P : AVR::LD16rm_PD;
+    break;
+  default:
+    return NULL;
+  }
+
+  SDNode *ResNode = CurDAG->getMachineNode(Opcode, N->getDebugLoc(),
+                                           VT, MVT::i16, MVT::Other,
+                                           LD->getBasePtr(), LD->getChain());
+  MachineSDNode::mmo_iterator MemOp = MF->allocateMemRefsArray(1);
+  MemOp[0] = LD->getMemOperand();
+  cast<MachineSDNode>(ResNode)->setMemRefs(MemOp, MemOp + 1);
+  return ResNode;
+}
+
+/// SelectProgMemLoad - Select a load from program memory: LPM through Z, or
+/// ELPM after setting RAMPZ for the segments past the first. A load of the
+/// first segment that moves the pointer on uses Z+. Without LPMX the byte is
+/// read into R0 and copied out.
+SDNode *AVRDAGToDAGISel::SelectProgMemLoad(SDNode *N) {
+  LoadSDNode *LD = cast<LoadSDNode>(N);
+  unsigned AS = LD->getAddressSpace();
+  if (!AVRAS::isProgramMemory(AS))
+    return NULL;
+
+  MVT VT = LD->getMemoryVT().getSimpleVT();
+  if (LD->getExtensionType() != ISD::NON_EXTLOAD ||
+      (VT != MVT::i8 && VT != MVT::i16))
+    report_fatal_error("Unsupported load from program memory");
+
+  unsigned Segment = AVRAS::getSegment(AS);
+  if (!Subtarget->hasLPM() || (Segment && !Subtarget->hasELPMX()))
+    report_fatal_error("The device cannot read this program memory");
+
+  bool is16 = VT == MVT::i16;
+  DebugLoc dl = N->getDebugLoc();
+  SDNode *ResNode;
+  if (Segment) {
+    assert(LD->getAddressingMode() == ISD::UNINDEXED &&
+           "ELPM does not move the pointer!");
+    ResNode = CurDAG->getMachineNode(is16 ? AVR::ELPM16 : AVR::ELPM8, dl,
+                                     VT, MVT::Other, LD->getBasePtr(),
+                                     CurDAG->getTargetConstant(Segment,
+                                                               MVT::i8),
+                                     LD->getChain());
+  } else if (LD->getAddressingMode() == ISD::POST_INC) {
+    ResNode = CurDAG->getMachineNode(is16 ? AVR::LPM16rz_P : AVR::LPM8rz_P,
+                                     dl, VT, MVT::i16, MVT::Other,
+                                     LD->getBasePtr(), LD->getChain());
+  } else if (!Subtarget->hasLPMX()) {
+    assert(LD->getAddressingMode() == ISD::UNINDEXED &&
+           "LPM into R0 does not move the pointer!");
+    ResNode = CurDAG->getMachineNode(is16 ? AVR::LPM16r0 : AVR::LPM8r0, dl,
+                                     VT, MVT::Other, LD->getBasePtr(),
+                                     LD->getChain());
+  } else {
+    assert(LD->getAddressingMode() == ISD::UNINDEXED &&
+           "LPM only post-increments the pointer!");
+    ResNode = CurDAG->getMachineNode(is16 ? AVR::LPM16rz : AVR::LPM8rz, dl,
+                                     VT, MVT::Other, LD->getBasePtr(),
+                                     LD->getChain());
+  }
+
+  MachineSDNode::mmo_iterator MemOp = MF->allocateMemRefsArray(1);
+  MemOp[0] = LD->getMemOperand();
+  cast<MachineSDNode>(ResNode)->setMemRefs(MemOp, MemOp + 1);
+  return ResNode;
+}
+
+SDNode *AVRDAGToDAGISel::SelectIndexedStore(SDNode *N) {
+  StoreSDNode *ST = cast<StoreSDNode>(N);
+  if (!isValidIndexedStore(ST))
+    return NULL;
+
+  MVT VT = ST->getMemoryVT().getSimpleVT();
+  bool isInc = ST->getAddressingMode() == ISD::POST_INC;
 
   unsigned Opcode = 0;
   switch (VT.SimpleTy) {
   case MVT::i8:
-    Opcode = AVR::MOV8rm_POST;
+    Opcode = isInc ? AVR::ST8mr_P : AVR::ST8mr_PD;
     break;
   case MVT::i16:
-    Opcode = AVR::MOV16rm_POST;
+    Opcode = isInc ? AVR::ST16mr_P : AVR::ST16mr_PD;
     break;
   default:
     return NULL;
   }
 
-   return CurDAG->getMachineNode(Opcode, N->getDebugLoc(),
-                                 VT, MVT::i16, MVT::Other,
-                                 LD->getBasePtr(), LD->getChain());
+  SDNode *ResNode = CurDAG->getMachineNode(Opcode, N->getDebugLoc(),
+                                           MVT::i16, MVT::Other,
+                                           ST->getBasePtr(), ST->getValue(),
+                                           ST->getChain());
+  MachineSDNode::mmo_iterator MemOp = MF->allocateMemRefsArray(1);
+  MemOp[0] = ST->getMemOperand();
+  cast<MachineSDNode>(ResNode)->setMemRefs(MemOp, MemOp + 1);
+  return ResNode;
 }
 
 SDNode *AVRDAGToDAGISel::SelectIndexedBinOp(SDNode *Op,
@@ -404,10 +598,28 @@ SDNode *AVRDAGToDAGISel::Select(SDNode *Node) {
     return NULL;
   }
 
-  /*
   // Few custom selection stuff.
   switch (Node->getOpcode()) {
   default: break;
+  case ISD::LOAD:
+    if (SDNode *ResNode = SelectProgMemLoad(Node))
+      return ResNode;
+    if (SDNode *ResNode = SelectIndexedLoad(Node))
+      return ResNode;
+    // Other cases are autogenerated.
+    break;
+  case ISD::STORE:
+    if (AVRAS::isProgramMemory(cast<StoreSDNode>(Node)->getAddressSpace()))
+      report_fatal_error("Cannot store to program memory");
+    if (SDNode *ResNode = SelectIndexedStore(Node))
+      return ResNode;
+    // Other cases are autogenerated.
+    break;
+  }
+
+  /*
+  switch (Node->getOpcode()) {
+  default: break;
   case ISD::FrameIndex: {
     assert(Node->getValueType(0) == MVT::i16);
     int FI = cast<FrameIndexSDNode>(Node)->getIndex();
@@ -418,11 +630,6 @@ SDNode *AVRDAGToDAGISel::Select(SDNode *Node) {
     return CurDAG->getMachineNode(AVR::ADD16ri, dl, MVT::i8,
                                   TFI, CurDAG->getTargetConstant(0, MVT::i8));
   }
-  case ISD::LOAD:
-    if (SDNode *ResNode = SelectIndexedLoad(Node))
-      return ResNode;
-    // Other cases are autogenerated.
-    break;
   case ISD::ADD:
     if (SDNode *ResNode =
         SelectIndexedBinOp(Node,
@@ -16,7 +16,9 @@
 #include "AVRISelLowering.h"
 #include "AVR.h"
 #include "AVRMachineFunctionInfo.h"
+#include "AVRSubtarget.h"
 #include "AVRTargetMachine.h"
+#include "AVRTargetObjectFile.h"
 #include "AVRRegisterInfo.h"
 #include "llvm/DerivedTypes.h"
 #include "llvm/Function.h"
@@ -35,23 +37,23 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/VectorExtras.h"
 using namespace llvm;
 
 AVRTargetLowering::AVRTargetLowering(AVRTargetMachine &tm) :
-  TargetLowering(tm, new TargetLoweringObjectFileELF()),
-  TM(tm) {
+  TargetLowering(tm, new AVRTargetObjectFile()),
+  Subtarget(*tm.getSubtargetImpl()), TM(tm) {
 
   TD = getTargetData();
 
-  // Set up the register classes.
-  addRegisterClass(MVT::i8,  AVR::IGR8RegisterClass);
+  // Set up the register classes. Values start out in the widest class of
+  // their type, and are constrained to IGR8, IWR16, INDR16 and the like by
+  // the instructions that use them.
   addRegisterClass(MVT::i8,  AVR::GR8RegisterClass);
-  addRegisterClass(MVT::i8,  AVR::IO8RegisterClass);
   addRegisterClass(MVT::i16, AVR::GR16RegisterClass);
-  addRegisterClass(MVT::i16, AVR::IGR16RegisterClass);
-  addRegisterClass(MVT::i16, AVR::INDR16RegisterClass);
 
   // Compute derived properties from the register classes
   computeRegisterProperties();
@@ -61,13 +63,34 @@ AVRTargetLowering::AVRTargetLowering(AVRTargetMachine &tm) :
   // Division is expensive
   setIntDivIsCheap(false);
 
+  // Copies and fills of a known size are unrolled into word moves up to
+  // these counts, and left to the loops of AVRSelectionDAGInfo above them.
+  // A word through LDS and STS is 8 words of code, a loop about 9 with its
+  // setup.
+  maxStoresPerMemcpy = 8;
+  maxStoresPerMemcpyOptSize = 1;
+  maxStoresPerMemset = 8;
+  maxStoresPerMemsetOptSize = 1;
+  maxStoresPerMemmove = 8;
+  maxStoresPerMemmoveOptSize = 1;
+
+  // Loads and stores through X, Y and Z may post-increment or pre-decrement
+  // the pointer.
+  setIndexedLoadAction(ISD::POST_INC, MVT::i8, Legal);
   setIndexedLoadAction(ISD::POST_INC, MVT::i16, Legal);
+  setIndexedLoadAction(ISD::PRE_DEC, MVT::i8, Legal);
   setIndexedLoadAction(ISD::PRE_DEC, MVT::i16, Legal);
+  setIndexedStoreAction(ISD::POST_INC, MVT::i8, Legal);
+  setIndexedStoreAction(ISD::POST_INC, MVT::i16, Legal);
+  setIndexedStoreAction(ISD::PRE_DEC, MVT::i8, Legal);
+  setIndexedStoreAction(ISD::PRE_DEC, MVT::i16, Legal);
 
   setLoadExtAction(ISD::EXTLOAD,  MVT::i1,  Promote);
   setLoadExtAction(ISD::SEXTLOAD, MVT::i1,  Promote);
   setLoadExtAction(ISD::ZEXTLOAD, MVT::i1,  Promote);
+  setLoadExtAction(ISD::EXTLOAD,  MVT::i8,  Expand);
   setLoadExtAction(ISD::SEXTLOAD, MVT::i8,  Expand);
+  setLoadExtAction(ISD::ZEXTLOAD, MVT::i8,  Expand);
   setLoadExtAction(ISD::SEXTLOAD, MVT::i16, Expand);
 
   setOperationAction(ISD::DYNAMIC_STACKALLOC, MVT::i8, Expand);
@@ -81,13 +104,63 @@ AVRTargetLowering::AVRTargetLowering(AVRTargetMachine &tm) :
 
   setOperationAction(ISD::BR_CC,            MVT::i8,    Custom);
   setOperationAction(ISD::BR_CC,            MVT::i16,   Custom);
+  setOperationAction(ISD::BR_CC,            MVT::i32,   Custom);
+  setOperationAction(ISD::BR_CC,            MVT::i64,   Custom);
   setOperationAction(ISD::BRCOND,           MVT::Other, Expand);
 
+  // Comparisons and selects read the flags of a CMP. Wider compares are
+  // split into words by EmitCMP, wider selects by the type legalizer.
+  setOperationAction(ISD::SETCC,            MVT::i8,    Custom);
+  setOperationAction(ISD::SETCC,            MVT::i16,   Custom);
+  setOperationAction(ISD::SETCC,            MVT::i32,   Custom);
+  setOperationAction(ISD::SETCC,            MVT::i64,   Custom);
+  setOperationAction(ISD::SELECT_CC,        MVT::i8,    Custom);
+  setOperationAction(ISD::SELECT_CC,        MVT::i16,   Custom);
+  setOperationAction(ISD::SELECT_CC,        MVT::i32,   Custom);
+  setOperationAction(ISD::SELECT_CC,        MVT::i64,   Custom);
+  setOperationAction(ISD::SELECT,           MVT::i8,    Expand);
+  setOperationAction(ISD::SELECT,           MVT::i16,   Expand);
+
+  // Constant shifts of 32 bit values are done inline, variable ones are
+  // left to the libcalls.
   setOperationAction(ISD::SHL,            MVT::i8,    Custom);
   setOperationAction(ISD::SRL,            MVT::i8,    Custom);
   setOperationAction(ISD::SRA,            MVT::i8,    Custom);
+  setOperationAction(ISD::SHL,            MVT::i16,   Custom);
+  setOperationAction(ISD::SRL,            MVT::i16,   Custom);
+  setOperationAction(ISD::SRA,            MVT::i16,   Custom);
+  setOperationAction(ISD::SHL,            MVT::i32,   Custom);
+  setOperationAction(ISD::SRL,            MVT::i32,   Custom);
+  setOperationAction(ISD::SRA,            MVT::i32,   Custom);
   setOperationAction(ISD::ROTR,           MVT::i8,    Expand);
   setOperationAction(ISD::ROTL,           MVT::i8,    Expand);
+  setOperationAction(ISD::ROTR,           MVT::i16,   Expand);
+  setOperationAction(ISD::ROTL,           MVT::i16,   Expand);
+
+  // Use the hardware multiplier if there is one. The 8x8 bit products are
+  // legal, wider ones are built by the custom inserter; 32 bit products are
+  // assembled by the type legalizer out of 16x16->32 bit pieces.
+  if (Subtarget.hasMul()) {
+    setOperationAction(ISD::SMUL_LOHI,    MVT::i8,    Expand);
+    setOperationAction(ISD::UMUL_LOHI,    MVT::i8,    Expand);
+    setOperationAction(ISD::MULHS,        MVT::i16,   Expand);
+    setOperationAction(ISD::MULHU,        MVT::i16,   Expand);
+  } else {
+    setOperationAction(ISD::MUL,          MVT::i8,    Expand);
+    setOperationAction(ISD::MULHS,        MVT::i8,    Expand);
+    setOperationAction(ISD::MULHU,        MVT::i8,    Expand);
+    setOperationAction(ISD::SMUL_LOHI,    MVT::i8,    Expand);
+    setOperationAction(ISD::UMUL_LOHI,    MVT::i8,    Expand);
+    setOperationAction(ISD::MUL,          MVT::i16,   Expand);
+    setOperationAction(ISD::MULHS,        MVT::i16,   Expand);
+    setOperationAction(ISD::MULHU,        MVT::i16,   Expand);
+    setOperationAction(ISD::SMUL_LOHI,    MVT::i16,   Expand);
+    setOperationAction(ISD::UMUL_LOHI,    MVT::i16,   Expand);
+  }
+
+  // Single bit extracts and inserts go through the T flag.
+  setTargetDAGCombine(ISD::AND);
+  setTargetDAGCombine(ISD::OR);
 
   setBooleanContents(ZeroOrOneBooleanContent);
   setBooleanVectorContents(ZeroOrOneBooleanContent); // FIXME: Is this correct?
@@ -106,11 +179,11 @@ SDValue AVRTargetLowering::LowerOperation(SDValue Op,
   case ISD::BlockAddress:     return LowerBlockAddress(Op, DAG);
   /*
   case ISD::ExternalSymbol:   return LowerExternalSymbol(Op, DAG);
-  case ISD::SETCC:            return LowerSETCC(Op, DAG);
   */
+  case ISD::SETCC:            return LowerSETCC(Op, DAG);
   case ISD::BR_CC:            return LowerBR_CC(Op, DAG);
-  /*
   case ISD::SELECT_CC:        return LowerSELECT_CC(Op, DAG);
+  /*
   case ISD::SIGN_EXTEND:      return LowerSIGN_EXTEND(Op, DAG);
   case ISD::RETURNADDR:       return LowerRETURNADDR(Op, DAG);
   */
@@ -167,7 +240,115 @@ getRegForInlineAsmConstraint(const std::string &Constraint,
 //===----------------------------------------------------------------------===//
 */
 
-#include "AVRGenCallingConv.inc"
+/// Registers used for passing arguments and return values, indexed by the
+/// number of their (low) byte register minus 8.
+static const unsigned ArgRegs8[] = {
+  AVR::R8,  AVR::R9,  AVR::R10, AVR::R11, AVR::R12, AVR::R13,
+  AVR::R14, AVR::R15, AVR::R16, AVR::R17, AVR::R18, AVR::R19,
+  AVR::R20, AVR::R21, AVR::R22, AVR::R23, AVR::R24, AVR::R25
+};
+static const unsigned ArgRegs16[] = {
+  AVR::R9W,  AVR::R11W, AVR::R13W, AVR::R15W, AVR::R17W,
+  AVR::R19W, AVR::R21W, AVR::R23W, AVR::R25W
+};
+
+/// assignArgRegs - Assign the registers starting at byte register number Reg
+/// to the parts [First, Last) of a value, lowest part first.
+template<typename ArgT>
+static void assignArgRegs(const SmallVectorImpl<ArgT> &Args,
+                          unsigned First, unsigned Last, unsigned Reg,
+                          CCState &CCInfo) {
+  for (unsigned i = First; i != Last; ++i) {
+    MVT VT = Args[i].VT.getSimpleVT();
+    unsigned PhysReg;
+    if (VT == MVT::i8)
+      PhysReg = ArgRegs8[Reg - 8];
+    else {
+      assert(VT == MVT::i16 && (Reg & 1) == 0 && "Unexpected value part!");
+      PhysReg = ArgRegs16[(Reg - 8) / 2];
+    }
+
+    CCInfo.AllocateReg(PhysReg);
+    CCInfo.addLoc(CCValAssign::getReg(i, VT, PhysReg, VT, CCValAssign::Full));
+    Reg += VT.getSizeInBits() / 8;
+  }
+}
+
+/// analyzeArguments - Assign locations to the parts of the arguments the way
+/// avr-gcc does. Every argument takes an even number of bytes, the first one
+/// ends at R25 and the following ones are placed below it, down to R8. Once
+/// an argument does not fit anymore, it and all the following ones are
+/// passed on the stack, as are all arguments of varargs functions.
+template<typename ArgT>
+static void analyzeArguments(const SmallVectorImpl<ArgT> &Args,
+                             bool isVarArg, CCState &CCInfo) {
+  unsigned BytesLeft = isVarArg ? 0 : array_lengthof(ArgRegs8);
+
+  for (unsigned i = 0, e = Args.size(); i != e; ) {
+    // Find the parts making up this argument. Only the first part of a split
+    // argument is flagged, the other ones have an alignment of 1.
+    unsigned End = i + 1;
+    if (Args[i].Flags.isSplit())
+      while (End != e && !Args[End].Flags.isSplit() &&
+             Args[End].Flags.getOrigAlign() == 1 &&
+             Args[End].VT == Args[i].VT)
+        ++End;
+
+    unsigned Size = 0;
+    for (unsigned j = i; j != End; ++j)
+      Size += Args[j].VT.getStoreSize();
+    Size = (Size + 1) & ~1U;
+
+    if (Size <= BytesLeft) {
+      BytesLeft -= Size;
+      assignArgRegs(Args, i, End, 8 + BytesLeft, CCInfo);
+    } else {
+      BytesLeft = 0;
+      for (unsigned j = i; j != End; ++j) {
+        MVT VT = Args[j].VT.getSimpleVT();
+        unsigned Offset = CCInfo.AllocateStack(VT.getSizeInBits() / 8, 1);
+        CCInfo.addLoc(CCValAssign::getMem(j, VT, Offset, VT,
+                                          CCValAssign::Full));
+      }
+    }
+
+    i = End;
+  }
+}
+
+/// getReturnSize - Return the number of bytes the parts of a return value
+/// take in registers.
+template<typename ArgT>
+static unsigned getReturnSize(const SmallVectorImpl<ArgT> &Args) {
+  unsigned Size = 0;
+  for (unsigned i = 0, e = Args.size(); i != e; ++i)
+    Size += Args[i].VT.getStoreSize();
+  return (Size + 1) & ~1U;
+}
+
+/// analyzeReturnValues - Assign registers to the parts of a return value.
+/// Like with avr-gcc, values of up to 8 bytes are returned in the registers
+/// ending at R25, i.e. R24 for i8, R25:R24 for i16, R25-R22 for i32 and
+/// R25-R18 for i64.
+template<typename ArgT>
+static void analyzeReturnValues(const SmallVectorImpl<ArgT> &Args,
+                                CCState &CCInfo) {
+  if (Args.empty())
+    return;
+
+  unsigned Size = getReturnSize(Args);
+  assert(Size <= 8 && "Return value does not fit in registers!");
+  assignArgRegs(Args, 0, Args.size(), 26 - Size, CCInfo);
+}
+
+bool
+AVRTargetLowering::CanLowerReturn(CallingConv::ID CallConv,
+                                  MachineFunction &MF, bool isVarArg,
+                                  const SmallVectorImpl<ISD::OutputArg> &Outs,
+                                  LLVMContext &Context) const {
+  // Larger values are returned through a hidden pointer argument.
+  return getReturnSize(Outs) <= 8;
+}
 
 SDValue
 AVRTargetLowering::LowerFormalArguments(SDValue Chain,
@@ -186,6 +367,11 @@ AVRTargetLowering::LowerFormalArguments(SDValue Chain,
   case CallingConv::C:
   case CallingConv::Fast:
     return LowerCCCArguments(Chain, CallConv, isVarArg, Ins, dl, DAG, InVals);
+  case AVRCallingConv::INTR:
+  case AVRCallingConv::SIGNAL:
+    if (!Ins.empty())
+      report_fatal_error("ISRs cannot have arguments");
+    return Chain;
   }
 }
 
@@ -198,8 +384,9 @@ AVRTargetLowering::LowerCall(SDValue Chain, SDValue Callee,
                                 const SmallVectorImpl<ISD::InputArg> &Ins,
                                 DebugLoc dl, SelectionDAG &DAG,
                                 SmallVectorImpl<SDValue> &InVals) const {
-  // AVR target does not yet support tail call optimization.
-  isTailCall = false;
+  if (isTailCall)
+    isTailCall = IsEligibleForTailCallOptimization(Callee, CallConv, isVarArg,
+                                                   Outs, DAG);
 
   switch (CallConv) {
   default:
@@ -211,6 +398,62 @@ AVRTargetLowering::LowerCall(SDValue Chain, SDValue Callee,
   }
 }
 
+/// IsEligibleForTailCallOptimization - Check whether the call in tail
+/// position can jump to the callee once the frame of the caller is freed.
+/// The callee must take all its arguments in registers, and those must be
+/// call clobbered ones, R18-R25: the epilogue restores R8-R17 before the
+/// jump, which would write over arguments there. An interrupt service
+/// routine has to return with RETI, and a naked function has no epilogue
+/// to turn the tail call into a jump.
+bool
+AVRTargetLowering::IsEligibleForTailCallOptimization(SDValue Callee,
+                                                     CallingConv::ID CalleeCC,
+                                                     bool isVarArg,
+                                  const SmallVectorImpl<ISD::OutputArg> &Outs,
+                                                     SelectionDAG &DAG) const {
+  MachineFunction &MF = DAG.getMachineFunction();
+  const Function *CallerF = MF.getFunction();
+  CallingConv::ID CallerCC = CallerF->getCallingConv();
+
+  if (CallerCC != CallingConv::C && CallerCC != CallingConv::Fast)
+    return false;
+  if (CalleeCC != CallingConv::C && CalleeCC != CallingConv::Fast)
+    return false;
+  if (CallerF->hasFnAttr(Attribute::Naked) || CallerF->hasStructRetAttr())
+    return false;
+
+  // Varargs are passed on the stack.
+  if (isVarArg)
+    return false;
+
+  // An indirect tail call is an IJMP through Z.
+  if (!isa<GlobalAddressSDNode>(Callee) && !isa<ExternalSymbolSDNode>(Callee) &&
+      !Subtarget.hasIJMPCALL())
+    return false;
+
+  for (unsigned i = 0, e = Outs.size(); i != e; ++i)
+    if (Outs[i].Flags.isSRet() || Outs[i].Flags.isByVal())
+      return false;
+
+  SmallVector<CCValAssign, 16> ArgLocs;
+  CCState CCInfo(CalleeCC, isVarArg, MF, getTargetMachine(), ArgLocs,
+                 *DAG.getContext());
+  analyzeArguments(Outs, isVarArg, CCInfo);
+
+  if (CCInfo.getNextStackOffset() != 0)
+    return false;
+
+  // The first ten argument registers, R8-R17, are callee saved.
+  for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i) {
+    unsigned Reg = ArgLocs[i].getLocReg();
+    if (std::find(ArgRegs8, ArgRegs8 + 10, Reg) != ArgRegs8 + 10 ||
+        std::find(ArgRegs16, ArgRegs16 + 5, Reg) != ArgRegs16 + 5)
+      return false;
+  }
+
+  return true;
+}
+
 /// LowerCCCArguments - transform physical registers into virtual registers and
 /// generate load operations for arguments places on the stack.
 // FIXME: struct return stuff
@@ -233,9 +476,10 @@ AVRTargetLowering::LowerCCCArguments(SDValue Chain,
   SmallVector<CCValAssign, 16> ArgLocs;
   CCState CCInfo(CallConv, isVarArg, DAG.getMachineFunction(),
 		 getTargetMachine(), ArgLocs, *DAG.getContext());
-  CCInfo.AnalyzeFormalArguments(Ins, CC_AVR);
+  analyzeArguments(Ins, isVarArg, CCInfo);
 
-  assert(!isVarArg && "Varargs not supported yet");
+  if (isVarArg)
+    report_fatal_error("Varargs functions are not supported yet");
 
   for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i) {
     CCValAssign &VA = ArgLocs[i];
@@ -287,11 +531,6 @@ AVRTargetLowering::LowerCCCArguments(SDValue Chain,
       assert(VA.isMemLoc());
       // Load the argument to a virtual register
       unsigned ObjSize = VA.getLocVT().getSizeInBits()/8;
-      if (ObjSize > 2) {
-        errs() << "LowerFormalArguments Unhandled argument type: "
-             << EVT(VA.getLocVT()).getEVTString()
-             << "\n";
-      }
       // Create the frame index object for this incoming parameter...
       int FI = MFI->CreateFixedObject(ObjSize, VA.getLocMemOffset(), true);
 
@@ -323,7 +562,7 @@ AVRTargetLowering::LowerReturn(SDValue Chain,
 		 getTargetMachine(), RVLocs, *DAG.getContext());
 
   // Analize return values.
-  CCInfo.AnalyzeReturn(Outs, RetCC_AVR);
+  analyzeReturnValues(Outs, CCInfo);
 
   // If this is the first return lowered for this function, add the regs to the
   // liveout set for the function.
@@ -350,6 +589,13 @@ AVRTargetLowering::LowerReturn(SDValue Chain,
 
   unsigned Opc =  AVRISD::RET_FLAG;
 
+  // Interrupt service routines return with RETI, to nobody expecting a value.
+  if (AVRCallingConv::isInterrupt(CallConv)) {
+    if (!RVLocs.empty())
+      report_fatal_error("ISRs cannot return any value");
+    Opc = AVRISD::RETI_FLAG;
+  }
+
   if (Flag.getNode())
     return DAG.getNode(Opc, dl, MVT::Other, Chain, Flag);
 
@@ -357,8 +603,23 @@ AVRTargetLowering::LowerReturn(SDValue Chain,
   return DAG.getNode(Opc, dl, MVT::Other, Chain);
 }
 
+/// readStackPointer - Copy SP out of SPL and SPH into a pair.
+static SDValue readStackPointer(SDValue Chain, DebugLoc dl,
+                                SelectionDAG &DAG) {
+  SDValue Lo = DAG.getCopyFromReg(Chain, dl, AVR::SPL, MVT::i8);
+  SDValue Hi = DAG.getCopyFromReg(Chain, dl, AVR::SPH, MVT::i8);
+  SDValue Ops[] = {
+    DAG.getTargetConstant(AVR::GR16RegClassID, MVT::i32),
+    Lo, DAG.getTargetConstant(AVR::subreg_loreg, MVT::i32),
+    Hi, DAG.getTargetConstant(AVR::subreg_hireg, MVT::i32)
+  };
+  return SDValue(DAG.getMachineNode(TargetOpcode::REG_SEQUENCE, dl, MVT::i16,
+                                    Ops, array_lengthof(Ops)), 0);
+}
+
 /// LowerCCCCallTo - functions arguments are copied from virtual regs to
 /// (physical regs)/(stack frame), CALLSEQ_START and CALLSEQ_END are emitted.
+/// A tail call has no call sequence and ends the DAG with a TC_RETURN.
 /// TODO: sret.
 SDValue
 AVRTargetLowering::LowerCCCCallTo(SDValue Chain, SDValue Callee,
@@ -375,13 +636,14 @@ AVRTargetLowering::LowerCCCCallTo(SDValue Chain, SDValue Callee,
   CCState CCInfo(CallConv, isVarArg, DAG.getMachineFunction(),
 		 getTargetMachine(), ArgLocs, *DAG.getContext());
 
-  CCInfo.AnalyzeCallOperands(Outs, CC_AVR);
+  analyzeArguments(Outs, isVarArg, CCInfo);
 
   // Get a count of how many bytes are to be pushed on the stack.
   unsigned NumBytes = CCInfo.getNextStackOffset();
 
-  Chain = DAG.getCALLSEQ_START(Chain ,DAG.getConstant(NumBytes,
-                                                      getPointerTy(), true));
+  if (!isTailCall)
+    Chain = DAG.getCALLSEQ_START(Chain ,DAG.getConstant(NumBytes,
+                                                        getPointerTy(), true));
 
   SmallVector<std::pair<unsigned, SDValue>, 4> RegsToPass;
   SmallVector<SDValue, 12> MemOpChains;
@@ -415,15 +677,17 @@ AVRTargetLowering::LowerCCCCallTo(SDValue Chain, SDValue Callee,
     } else {
       assert(VA.isMemLoc());
 
-/*
+      // The outgoing arguments are stored just above SP, which points below
+      // the last byte pushed. The prologue reserves room for them, or the
+      // call sequence does with variable sized objects. CALL then pushes the
+      // return address below them, where the callee expects it.
       if (StackPtr.getNode() == 0)
-        StackPtr = DAG.getCopyFromReg(Chain, dl, AVR::SPW, getPointerTy());
-*/
+        StackPtr = readStackPointer(Chain, dl, DAG);
 
       SDValue PtrOff = DAG.getNode(ISD::ADD, dl, getPointerTy(),
                                    StackPtr,
-                                   DAG.getIntPtrConstant(VA.getLocMemOffset()));
-
+                                   DAG.getIntPtrConstant(VA.getLocMemOffset() +
+                                                         1));
 
       MemOpChains.push_back(DAG.getStore(Chain, dl, Arg, PtrOff,
                                          MachinePointerInfo(),false, false, 0));
@@ -469,6 +733,12 @@ AVRTargetLowering::LowerCCCCallTo(SDValue Chain, SDValue Callee,
   if (InFlag.getNode())
     Ops.push_back(InFlag);
 
+  // The value of a tail call is live out of the caller as it is, so there
+  // are no results to copy.
+  if (isTailCall)
+    return DAG.getNode(AVRISD::TC_RETURN, dl, MVT::Other,
+                       &Ops[0], Ops.size());
+
   Chain = DAG.getNode(AVRISD::CALL, dl, NodeTys, &Ops[0], Ops.size());
   InFlag = Chain.getValue(1);
 
@@ -500,7 +770,7 @@ AVRTargetLowering::LowerCallResult(SDValue Chain, SDValue InFlag,
   CCState CCInfo(CallConv, isVarArg, DAG.getMachineFunction(),
 		 getTargetMachine(), RVLocs, *DAG.getContext());
 
-  CCInfo.AnalyzeCallResult(Ins, RetCC_AVR);
+  analyzeReturnValues(Ins, CCInfo);
 
   // Copy all of the result registers out of their specified physreg.
   for (unsigned i = 0; i != RVLocs.size(); ++i) {
@@ -519,41 +789,87 @@ SDValue AVRTargetLowering::LowerShifts(SDValue Op,
   SDNode* N = Op.getNode();
   EVT VT = Op.getValueType();
   DebugLoc dl = N->getDebugLoc();
+  SDValue Victim = N->getOperand(0);
 
-  // Expand non-constant shifts to loops:
+  // Variable shifts are expanded by the custom inserter or the asm printer.
   if (!isa<ConstantSDNode>(N->getOperand(1)))
     switch (Opc) {
     default:
-      assert(0 && "Invalid shift opcode!");
+      llvm_unreachable("Invalid shift opcode!");
     case ISD::SHL:
-      return DAG.getNode(AVRISD::SHL, dl,
-                         VT, N->getOperand(0), N->getOperand(1));
+      return DAG.getNode(AVRISD::SHL, dl, VT, Victim, N->getOperand(1));
     case ISD::SRA:
-      return DAG.getNode(AVRISD::SRA, dl,
-                         VT, N->getOperand(0), N->getOperand(1));
+      return DAG.getNode(AVRISD::SRA, dl, VT, Victim, N->getOperand(1));
     case ISD::SRL:
-      return DAG.getNode(AVRISD::SRL, dl,
-                         VT, N->getOperand(0), N->getOperand(1));
+      return DAG.getNode(AVRISD::SRL, dl, VT, Victim, N->getOperand(1));
     }
 
   uint64_t ShiftAmount = N->getConstantOperandVal(1);
+  unsigned Width = VT.getSizeInBits();
+
+  // Shifting by the width or more is undefined, the result may as well be
+  // zero or the sign.
+  if (ShiftAmount >= Width) {
+    if (Opc != ISD::SRA)
+      return DAG.getConstant(0, VT);
+    ShiftAmount = Width - 1;
+  }
+  if (ShiftAmount == 0)
+    return Victim;
+
+  unsigned TargetOpcode = 0;
+  switch (Opc) {
+  default: llvm_unreachable("Invalid shift opcode!");
+  case ISD::SHL: TargetOpcode = AVRISD::SHLC; break;
+  case ISD::SRA: TargetOpcode = AVRISD::SRAC; break;
+  case ISD::SRL: TargetOpcode = AVRISD::SRLC; break;
+  }
 
-  // Expand the stuff into sequence of shifts.
-  // FIXME: for some shift amounts this might be done better!
-  // E.g.: foo >> (8 + N) => sxt(swpb(foo)) >> N
-  SDValue Victim = N->getOperand(0);
+  return DAG.getNode(TargetOpcode, dl, VT, Victim,
+                     DAG.getConstant(ShiftAmount, MVT::i8));
+}
 
-  unsigned int TargetOpcode = 0;
-  switch(Opc) {
-    case ISD::SHL: TargetOpcode = AVRISD::SHLC; break;
-    case ISD::SRA: TargetOpcode = AVRISD::SRAC; break;
-    case ISD::SRL: TargetOpcode = AVRISD::SRLC; break;
-  }
+void AVRTargetLowering::ReplaceNodeResults(SDNode *N,
+                                           SmallVectorImpl<SDValue> &Results,
+                                           SelectionDAG &DAG) const {
+  DebugLoc dl = N->getDebugLoc();
 
-  while (ShiftAmount--)
-    Victim = DAG.getNode(TargetOpcode, dl, VT, Victim);
+  switch (N->getOpcode()) {
+  default:
+    llvm_unreachable("Don't know how to custom expand this!");
+  case ISD::SELECT_CC:
+    // Selects of wide values are split up by the type legalizer, the
+    // compares are dealt with by LowerSELECT_CC.
+    return;
+  case ISD::SHL:
+  case ISD::SRA:
+  case ISD::SRL: {
+    // Shift 32 bit values by a constant as a whole, byte moves and all. The
+    // rest is left to the type legalizer.
+    ConstantSDNode *C = dyn_cast<ConstantSDNode>(N->getOperand(1));
+    if (!C || C->isNullValue() || C->getZExtValue() >= 32)
+      return;
+
+    unsigned Opc;
+    switch (N->getOpcode()) {
+    default:       llvm_unreachable("Invalid shift opcode!");
+    case ISD::SHL: Opc = AVRISD::SHLC32; break;
+    case ISD::SRA: Opc = AVRISD::SRAC32; break;
+    case ISD::SRL: Opc = AVRISD::SRLC32; break;
+    }
 
-  return Victim;
+    SDValue Lo = DAG.getNode(ISD::EXTRACT_ELEMENT, dl, MVT::i16,
+                             N->getOperand(0), DAG.getIntPtrConstant(0));
+    SDValue Hi = DAG.getNode(ISD::EXTRACT_ELEMENT, dl, MVT::i16,
+                             N->getOperand(0), DAG.getIntPtrConstant(1));
+    SDValue Res = DAG.getNode(Opc, dl, DAG.getVTList(MVT::i16, MVT::i16),
+                              Lo, Hi,
+                              DAG.getConstant(C->getZExtValue(), MVT::i8));
+    Results.push_back(DAG.getNode(ISD::BUILD_PAIR, dl, MVT::i32,
+                                  Res, Res.getValue(1)));
+    return;
+  }
+  }
 }
 
 SDValue AVRTargetLowering::LowerGlobalAddress(SDValue Op,
@@ -588,13 +904,49 @@ SDValue AVRTargetLowering::LowerBlockAddress(SDValue Op,
 
   return DAG.getNode(AVRISD::Wrapper, dl, getPointerTy(), Result);;
 }
+/// splitToWords - Split Val into 16-bit words, least significant first.
+static void splitToWords(SDValue Val, DebugLoc dl, SelectionDAG &DAG,
+                         SmallVectorImpl<SDValue> &Words) {
+  EVT VT = Val.getValueType();
+  if (VT.getSizeInBits() <= 16) {
+    Words.push_back(Val);
+    return;
+  }
+
+  EVT HalfVT = EVT::getIntegerVT(*DAG.getContext(), VT.getSizeInBits() / 2);
+  splitToWords(DAG.getNode(ISD::EXTRACT_ELEMENT, dl, HalfVT, Val,
+                           DAG.getIntPtrConstant(0)), dl, DAG, Words);
+  splitToWords(DAG.getNode(ISD::EXTRACT_ELEMENT, dl, HalfVT, Val,
+                           DAG.getIntPtrConstant(1)), dl, DAG, Words);
+}
+
 static SDValue EmitCMP(SDValue &LHS, SDValue &RHS, SDValue &TargetCC,
                        ISD::CondCode CC,
                        DebugLoc dl, SelectionDAG &DAG) {
   // FIXME: Handle bittests someday
   assert(!LHS.getValueType().isFloatingPoint() && "We don't handle FP yet");
 
-  // FIXME: Handle jump negative someday
+  // A sign test only needs the most significant byte, compared against zero
+  // for the N flag.
+  if (const ConstantSDNode *C = dyn_cast<ConstantSDNode>(RHS)) {
+    bool isNeg = (CC == ISD::SETLT && C->isNullValue()) ||
+                 (CC == ISD::SETLE && C->isAllOnesValue());
+    bool isPos = (CC == ISD::SETGE && C->isNullValue()) ||
+                 (CC == ISD::SETGT && C->isAllOnesValue());
+    if (isNeg || isPos) {
+      SmallVector<SDValue, 4> LHSWords;
+      splitToWords(LHS, dl, DAG, LHSWords);
+      SDValue Top = LHSWords.back();
+      if (Top.getValueType() == MVT::i16)
+        Top = DAG.getTargetExtractSubreg(AVR::subreg_hireg, dl, MVT::i8, Top);
+
+      TargetCC = DAG.getConstant(isNeg ? AVRCC::COND_MI : AVRCC::COND_PL,
+                                 MVT::i8);
+      return DAG.getNode(AVRISD::CMP, dl, MVT::Glue,
+                         Top, DAG.getConstant(0, MVT::i8));
+    }
+  }
+
   AVRCC::CondCodes TCC = AVRCC::COND_INVALID;
   switch (CC) {
   default: llvm_unreachable("Invalid integer condition!");
@@ -667,7 +1019,20 @@ static SDValue EmitCMP(SDValue &LHS, SDValue &RHS, SDValue &TargetCC,
   }
 
   TargetCC = DAG.getConstant(TCC, MVT::i8);
-  return DAG.getNode(AVRISD::CMP, dl, MVT::Glue, LHS, RHS);
+
+  // Values wider than 16 bits are compared a word at a time. CPC subtracts
+  // the borrow of the lower words and only ever clears Z, so the flags end
+  // up set for the whole value.
+  SmallVector<SDValue, 4> LHSWords, RHSWords;
+  splitToWords(LHS, dl, DAG, LHSWords);
+  splitToWords(RHS, dl, DAG, RHSWords);
+
+  SDValue Flag = DAG.getNode(AVRISD::CMP, dl, MVT::Glue,
+                             LHSWords[0], RHSWords[0]);
+  for (unsigned i = 1, e = LHSWords.size(); i != e; ++i)
+    Flag = DAG.getNode(AVRISD::CMPC, dl, MVT::Glue,
+                       LHSWords[i], RHSWords[i], Flag);
+  return Flag;
 }
 
 
@@ -679,6 +1044,44 @@ SDValue AVRTargetLowering::LowerBR_CC(SDValue Op, SelectionDAG &DAG) const {
   SDValue Dest  = Op.getOperand(4);
   DebugLoc dl   = Op.getDebugLoc();
 
+  // A test of a single bit is a skip over a jump, on any register rather
+  // than the upper half that ANDI takes.
+  ConstantSDNode *RHSC = dyn_cast<ConstantSDNode>(RHS);
+  if ((CC == ISD::SETEQ || CC == ISD::SETNE) && RHSC &&
+      RHSC->isNullValue() && LHS.getOpcode() == ISD::AND &&
+      isa<ConstantSDNode>(LHS.getOperand(1)) &&
+      isPowerOf2_64(LHS.getConstantOperandVal(1))) {
+    unsigned Bit = Log2_64(LHS.getConstantOperandVal(1));
+    SDValue Set = DAG.getConstant(CC == ISD::SETNE, MVT::i8);
+
+    // One of the low 32 I/O registers, read right before the branch, is
+    // tested by SBIC or SBIS. The branch does the read in place of the load.
+    LoadSDNode *Load = dyn_cast<LoadSDNode>(LHS.getOperand(0));
+    unsigned IOBase = Subtarget.getIOBase();
+    ConstantSDNode *Addr = Load ?
+      dyn_cast<ConstantSDNode>(Load->getBasePtr()) : 0;
+    if (Addr && Bit < 8 && LHS.hasOneUse() && Chain.getNode() == Load &&
+        Load->getMemoryVT() == MVT::i8 &&
+        Load->getAddressingMode() == ISD::UNINDEXED &&
+        !AVRAS::isProgramMemory(Load->getAddressSpace()) &&
+        Load->hasNUsesOfValue(1, 0) && Load->hasNUsesOfValue(1, 1) &&
+        Addr->getZExtValue() >= IOBase && Addr->getZExtValue() < IOBase + 32)
+      return DAG.getNode(AVRISD::BRBIT_IO, dl, MVT::Other,
+                         Load->getChain(), Dest, Load->getBasePtr(),
+                         DAG.getConstant(Bit, MVT::i8), Set);
+
+    // Anything else by SBRC or SBRS, on the byte that holds the bit.
+    SmallVector<SDValue, 4> Words;
+    splitToWords(LHS.getOperand(0), dl, DAG, Words);
+    SDValue Byte = Words[Bit / 16];
+    if (Byte.getValueType() == MVT::i16)
+      Byte = DAG.getTargetExtractSubreg(Bit % 16 < 8 ? AVR::subreg_loreg
+                                                     : AVR::subreg_hireg,
+                                        dl, MVT::i8, Byte);
+    return DAG.getNode(AVRISD::BRBIT, dl, MVT::Other, Chain, Dest, Byte,
+                       DAG.getConstant(Bit % 8, MVT::i8), Set);
+  }
+
   SDValue TargetCC;
   SDValue Flag = EmitCMP(LHS, RHS, TargetCC, CC, dl, DAG);
 
@@ -686,85 +1089,19 @@ SDValue AVRTargetLowering::LowerBR_CC(SDValue Op, SelectionDAG &DAG) const {
                      Chain, Dest, TargetCC, Flag);
 }
 
-/*
 SDValue AVRTargetLowering::LowerSETCC(SDValue Op, SelectionDAG &DAG) const {
   SDValue LHS   = Op.getOperand(0);
   SDValue RHS   = Op.getOperand(1);
+  ISD::CondCode CC = cast<CondCodeSDNode>(Op.getOperand(2))->get();
   DebugLoc dl   = Op.getDebugLoc();
 
-  // If we are doing an AND and testing against zero, then the CMP
-  // will not be generated.  The AND (or BIT) will generate the condition codes,
-  // but they are different from CMP.
-  // FIXME: since we're doing a post-processing, use a pseudoinstr here, so
-  // lowering & isel wouldn't diverge.
-  bool andCC = false;
-  if (ConstantSDNode *RHSC = dyn_cast<ConstantSDNode>(RHS)) {
-    if (RHSC->isNullValue() && LHS.hasOneUse() &&
-        (LHS.getOpcode() == ISD::AND ||
-         (LHS.getOpcode() == ISD::TRUNCATE &&
-          LHS.getOperand(0).getOpcode() == ISD::AND))) {
-      andCC = true;
-    }
-  }
-  ISD::CondCode CC = cast<CondCodeSDNode>(Op.getOperand(2))->get();
   SDValue TargetCC;
   SDValue Flag = EmitCMP(LHS, RHS, TargetCC, CC, dl, DAG);
 
-  // Get the condition codes directly from the status register, if its easy.
-  // Otherwise a branch will be generated.  Note that the AND and BIT
-  // instructions generate different flags than CMP, the carry bit can be used
-  // for NE/EQ.
-  bool Invert = false;
-  bool Shift = false;
-  bool Convert = true;
-  switch (cast<ConstantSDNode>(TargetCC)->getZExtValue()) {
-   default:
-    Convert = false;
-    break;
-   case AVRCC::COND_HS:
-     // Res = SRW & 1, no processing is required
-     break;
-   case AVRCC::COND_LO:
-     // Res = ~(SRW & 1)
-     Invert = true;
-     break;
-   case AVRCC::COND_NE:
-     if (andCC) {
-       // C = ~Z, thus Res = SRW & 1, no processing is required
-     } else {
-       // Res = ~((SRW >> 1) & 1)
-       Shift = true;
-       Invert = true;
-     }
-     break;
-   case AVRCC::COND_E:
-     Shift = true;
-     // C = ~Z for AND instruction, thus we can put Res = ~(SRW & 1), however,
-     // Res = (SRW >> 1) & 1 is 1 word shorter.
-     break;
-  }
-  EVT VT = Op.getValueType();
-  SDValue One  = DAG.getConstant(1, VT);
-  if (Convert) {
-    SDValue SR = DAG.getCopyFromReg(DAG.getEntryNode(), dl, AVR::SRW,
-                                    MVT::i16, Flag);
-    if (Shift)
-      // FIXME: somewhere this is turned into a SRL, lower it MSP specific?
-      SR = DAG.getNode(ISD::SRA, dl, MVT::i16, SR, One);
-    SR = DAG.getNode(ISD::AND, dl, MVT::i16, SR, One);
-    if (Invert)
-      SR = DAG.getNode(ISD::XOR, dl, MVT::i16, SR, One);
-    return SR;
-  } else {
-    SDValue Zero = DAG.getConstant(0, VT);
-    SDVTList VTs = DAG.getVTList(Op.getValueType(), MVT::Glue);
-    SmallVector<SDValue, 4> Ops;
-    Ops.push_back(One);
-    Ops.push_back(Zero);
-    Ops.push_back(TargetCC);
-    Ops.push_back(Flag);
-    return DAG.getNode(AVRISD::SELECT_CC, dl, VTs, &Ops[0], Ops.size());
-  }
+  SDValue Res = DAG.getNode(AVRISD::SETCC, dl, MVT::i8, TargetCC, Flag);
+  if (Op.getValueType() != MVT::i8)
+    Res = DAG.getNode(ISD::ZERO_EXTEND, dl, Op.getValueType(), Res);
+  return Res;
 }
 
 SDValue AVRTargetLowering::LowerSELECT_CC(SDValue Op,
@@ -779,16 +1116,11 @@ SDValue AVRTargetLowering::LowerSELECT_CC(SDValue Op,
   SDValue TargetCC;
   SDValue Flag = EmitCMP(LHS, RHS, TargetCC, CC, dl, DAG);
 
-  SDVTList VTs = DAG.getVTList(Op.getValueType(), MVT::Glue);
-  SmallVector<SDValue, 4> Ops;
-  Ops.push_back(TrueV);
-  Ops.push_back(FalseV);
-  Ops.push_back(TargetCC);
-  Ops.push_back(Flag);
-
-  return DAG.getNode(AVRISD::SELECT_CC, dl, VTs, &Ops[0], Ops.size());
+  return DAG.getNode(AVRISD::SELECT_CC, dl, Op.getValueType(),
+                     TrueV, FalseV, TargetCC, Flag);
 }
 
+/*
 SDValue AVRTargetLowering::LowerSIGN_EXTEND(SDValue Op,
                                                SelectionDAG &DAG) const {
   SDValue Val = Op.getOperand(0);
@@ -861,42 +1193,198 @@ SDValue AVRTargetLowering::LowerFRAMEADDR(SDValue Op,
   return FrameAddr;
 }
 
-/*
+/// getIndexedAddressParts - Match Ptr, the address of a load or store N,
+/// against a pointer moved by the size of the access. X, Y and Z can only
+/// be moved by that much, in a post-increment or a pre-decrement.
+static bool getIndexedAddressParts(SDNode *N, SDNode *Ptr, SDValue &Base,
+                                   SDValue &Offset, bool &isInc,
+                                   SelectionDAG &DAG) {
+  EVT VT;
+  if (LoadSDNode *LD = dyn_cast<LoadSDNode>(N)) {
+    if (LD->getExtensionType() != ISD::NON_EXTLOAD)
+      return false;
+    VT = LD->getMemoryVT();
+  } else if (StoreSDNode *ST = dyn_cast<StoreSDNode>(N)) {
+    if (ST->isTruncatingStore())
+      return false;
+    VT = ST->getMemoryVT();
+  } else
+    return false;
+
+  if (VT != MVT::i8 && VT != MVT::i16)
+    return false;
+
+  if (Ptr->getOpcode() != ISD::ADD && Ptr->getOpcode() != ISD::SUB)
+    return false;
+
+  ConstantSDNode *RHS = dyn_cast<ConstantSDNode>(Ptr->getOperand(1));
+  if (!RHS)
+    return false;
+
+  int64_t Inc = RHS->getSExtValue();
+  if (Ptr->getOpcode() == ISD::SUB)
+    Inc = -Inc;
+
+  int64_t Size = VT.getStoreSize();
+  if (Inc != Size && Inc != -Size)
+    return false;
+
+  Base = Ptr->getOperand(0);
+  Offset = DAG.getConstant(Size, MVT::i16);
+  isInc = Inc > 0;
+  return true;
+}
+
+/// getPreIndexedAddressParts - returns true by value, base pointer and
+/// offset pointer and addressing mode by reference if the node's address
+/// can be legally represented as pre-indexed load / store address.
+bool AVRTargetLowering::getPreIndexedAddressParts(SDNode *N, SDValue &Base,
+                                                  SDValue &Offset,
+                                                  ISD::MemIndexedMode &AM,
+                                                  SelectionDAG &DAG) const {
+  SDValue Ptr;
+  if (LoadSDNode *LD = dyn_cast<LoadSDNode>(N))
+    Ptr = LD->getBasePtr();
+  else if (StoreSDNode *ST = dyn_cast<StoreSDNode>(N))
+    Ptr = ST->getBasePtr();
+  else
+    return false;
+
+  // LPM and ELPM do not pre-decrement.
+  if (AVRAS::isProgramMemory(cast<LSBaseSDNode>(N)->getAddressSpace()))
+    return false;
+
+  bool isInc;
+  if (!getIndexedAddressParts(N, Ptr.getNode(), Base, Offset, isInc, DAG) ||
+      isInc)
+    return false;
+
+  AM = ISD::PRE_DEC;
+  return true;
+}
+
 /// getPostIndexedAddressParts - returns true by value, base pointer and
 /// offset pointer and addressing mode by reference if this node can be
 /// combined with a load / store to form a post-indexed load / store.
 bool AVRTargetLowering::getPostIndexedAddressParts(SDNode *N, SDNode *Op,
-                                                      SDValue &Base,
-                                                      SDValue &Offset,
-                                                      ISD::MemIndexedMode &AM,
-                                                      SelectionDAG &DAG) const {
-
-  LoadSDNode *LD = cast<LoadSDNode>(N);
-  if (LD->getExtensionType() != ISD::NON_EXTLOAD)
-    return false;
+                                                   SDValue &Base,
+                                                   SDValue &Offset,
+                                                   ISD::MemIndexedMode &AM,
+                                                   SelectionDAG &DAG) const {
+  // Of the program memory loads, only LPM Rd, Z+ is selected moving Z
+  // along.
+  if (LSBaseSDNode *LS = dyn_cast<LSBaseSDNode>(N)) {
+    unsigned AS = LS->getAddressSpace();
+    if (AVRAS::isProgramMemory(AS) &&
+        (AVRAS::getSegment(AS) || !Subtarget.hasLPMX()))
+      return false;
+  }
 
-  EVT VT = LD->getMemoryVT();
-  if (VT != MVT::i8 && VT != MVT::i16)
+  bool isInc;
+  if (!getIndexedAddressParts(N, Op, Base, Offset, isInc, DAG) || !isInc)
     return false;
 
-  if (Op->getOpcode() != ISD::ADD)
-    return false;
+  AM = ISD::POST_INC;
+  return true;
+}
 
-  if (ConstantSDNode *RHS = dyn_cast<ConstantSDNode>(Op->getOperand(1))) {
-    uint64_t RHSC = RHS->getZExtValue();
-    if ((VT == MVT::i16 && RHSC != 2) ||
-        (VT == MVT::i8 && RHSC != 1))
+/// getBitSource - Find where bit Bit of V comes from, when V is a byte
+/// shifted by a constant or not at all.
+static bool getBitSource(SDValue V, unsigned Bit,
+                         SDValue &Src, unsigned &SrcBit) {
+  Src = V;
+  SrcBit = Bit;
+  if ((V.getOpcode() == ISD::SRL || V.getOpcode() == ISD::SHL) &&
+      isa<ConstantSDNode>(V.getOperand(1))) {
+    unsigned Amount = V.getConstantOperandVal(1);
+    if (V.getOpcode() == ISD::SHL && Amount > Bit)
       return false;
+    Src = V.getOperand(0);
+    SrcBit = V.getOpcode() == ISD::SRL ? Bit + Amount : Bit - Amount;
+  }
+  return SrcBit < 8;
+}
 
-    Base = Op->getOperand(0);
-    Offset = DAG.getConstant(RHSC, VT);
-    AM = ISD::POST_INC;
-    return true;
+/// EmitBitCopy - Copy bit SrcBit of Src to bit Bit of Dst through the T
+/// flag.
+static SDValue EmitBitCopy(SDValue Dst, unsigned Bit, SDValue Src,
+                           unsigned SrcBit, DebugLoc dl, SelectionDAG &DAG) {
+  SDValue T = DAG.getNode(AVRISD::BST, dl, MVT::Glue, Src,
+                          DAG.getConstant(SrcBit, MVT::i8));
+  return DAG.getNode(AVRISD::BLD, dl, MVT::i8, Dst,
+                     DAG.getConstant(Bit, MVT::i8), T);
+}
+
+/// PerformANDCombine - A bit of a byte moved down to bit 0, (x >> n) & 1,
+/// is a BST and a BLD into zero. Shifting takes as many instructions from
+/// two bits up. Bit tests that are branched on are left to LowerBR_CC.
+static SDValue PerformANDCombine(SDNode *N, SelectionDAG &DAG) {
+  ConstantSDNode *C = dyn_cast<ConstantSDNode>(N->getOperand(1));
+  SDValue Shift = N->getOperand(0);
+  if (N->getValueType(0) != MVT::i8 || !C || C->getZExtValue() != 1 ||
+      Shift.getOpcode() != ISD::SRL ||
+      !isa<ConstantSDNode>(Shift.getOperand(1)) ||
+      Shift.getConstantOperandVal(1) < 2)
+    return SDValue();
+
+  for (SDNode::use_iterator UI = N->use_begin(), UE = N->use_end();
+       UI != UE; ++UI)
+    if (UI->getOpcode() == ISD::BRCOND || UI->getOpcode() == ISD::BR_CC ||
+        UI->getOpcode() == ISD::SETCC || UI->getOpcode() == ISD::TRUNCATE)
+      return SDValue();
+
+  SDValue Src;
+  unsigned SrcBit;
+  if (!getBitSource(Shift, 0, Src, SrcBit))
+    return SDValue();
+
+  DebugLoc dl = N->getDebugLoc();
+  return EmitBitCopy(DAG.getConstant(0, MVT::i8), 0, Src, SrcBit, dl, DAG);
+}
+
+/// PerformORCombine - A bit of one byte put in place of a bit of another,
+/// (y & ~(1 << m)) | (x' & (1 << m)) with x' a shift of x, is a BST of the
+/// bit of x and a BLD into y.
+static SDValue PerformORCombine(SDNode *N, SelectionDAG &DAG) {
+  if (N->getValueType(0) != MVT::i8)
+    return SDValue();
+
+  for (unsigned i = 0; i != 2; ++i) {
+    SDValue Keep = N->getOperand(i);
+    SDValue Insert = N->getOperand(1 - i);
+    if (Keep.getOpcode() != ISD::AND || Insert.getOpcode() != ISD::AND ||
+        !isa<ConstantSDNode>(Keep.getOperand(1)) ||
+        !isa<ConstantSDNode>(Insert.getOperand(1)))
+      continue;
+
+    uint64_t Mask = Insert.getConstantOperandVal(1);
+    if (!isPowerOf2_64(Mask) ||
+        Keep.getConstantOperandVal(1) != (~Mask & 0xff))
+      continue;
+
+    unsigned Bit = Log2_64(Mask);
+    SDValue Src;
+    unsigned SrcBit;
+    if (!getBitSource(Insert.getOperand(0), Bit, Src, SrcBit))
+      continue;
+
+    return EmitBitCopy(Keep.getOperand(0), Bit, Src, SrcBit,
+                       N->getDebugLoc(), DAG);
   }
 
-  return false;
+  return SDValue();
+}
+
+SDValue AVRTargetLowering::PerformDAGCombine(SDNode *N,
+                                             DAGCombinerInfo &DCI) const {
+  switch (N->getOpcode()) {
+  default: break;
+  case ISD::AND: return PerformANDCombine(N, DCI.DAG);
+  case ISD::OR:  return PerformORCombine(N, DCI.DAG);
+  }
+
+  return SDValue();
 }
-*/
 
 const char *AVRTargetLowering::getTargetNodeName(unsigned Opcode) const {
   switch (Opcode) {
@@ -906,15 +1394,38 @@ const char *AVRTargetLowering::getTargetNodeName(unsigned Opcode) const {
   case AVRISD::RLC:                return "AVRISD::RLC";
   case AVRISD::RRC:                return "AVRISD::RRC";
   case AVRISD::CALL:               return "AVRISD::CALL";
+  case AVRISD::TC_RETURN:          return "AVRISD::TC_RETURN";
   case AVRISD::Wrapper:            return "AVRISD::Wrapper";
   case AVRISD::BR_CC:              return "AVRISD::BR_CC";
+  case AVRISD::BRBIT_IO:           return "AVRISD::BRBIT_IO";
+  case AVRISD::BRBIT:              return "AVRISD::BRBIT";
   case AVRISD::CMP:                return "AVRISD::CMP";
+  case AVRISD::CMPC:               return "AVRISD::CMPC";
   case AVRISD::SELECT_CC:          return "AVRISD::SELECT_CC";
+  case AVRISD::SETCC:              return "AVRISD::SETCC";
+  case AVRISD::SHLC:               return "AVRISD::SHLC";
+  case AVRISD::SRAC:               return "AVRISD::SRAC";
+  case AVRISD::SRLC:               return "AVRISD::SRLC";
+  case AVRISD::SHLC32:             return "AVRISD::SHLC32";
+  case AVRISD::SRAC32:             return "AVRISD::SRAC32";
+  case AVRISD::SRLC32:             return "AVRISD::SRLC32";
   case AVRISD::SHL:                return "AVRISD::SHL";
+  case AVRISD::SRA:                return "AVRISD::SRA";
   case AVRISD::SRL:                return "AVRISD::SRL";
+  case AVRISD::BST:                return "AVRISD::BST";
+  case AVRISD::BLD:                return "AVRISD::BLD";
+  case AVRISD::MEMCPY:             return "AVRISD::MEMCPY";
+  case AVRISD::MEMSET:             return "AVRISD::MEMSET";
   }
 }
 
+EVT AVRTargetLowering::getOptimalMemOpType(uint64_t Size, unsigned DstAlign,
+                                           unsigned SrcAlign, bool IsZeroVal,
+                                           bool MemcpyStrSrc,
+                                           MachineFunction &MF) const {
+  return Size >= 2 ? MVT::i16 : MVT::i8;
+}
+
 bool AVRTargetLowering::isTruncateFree(Type *Ty1,
                                           Type *Ty2) const {
   if (!Ty1->isIntegerTy() || !Ty2->isIntegerTy())
@@ -941,6 +1452,336 @@ bool AVRTargetLowering::isZExtFree(EVT VT1, EVT VT2) const {
 }
 
 
+namespace {
+  /// AVRByteBuilder - Helper for the custom inserters expanding multi-byte
+  /// operations into 8-bit instructions. Products are built out of the
+  /// 8x8->16 bit hardware multiplier, shifts out of byte moves, nibble swaps
+  /// and single bit shifts. Values are handled as lists of 8-bit virtual
+  /// registers, least significant byte first.
+  class AVRByteBuilder {
+    MachineBasicBlock &MBB;
+    MachineBasicBlock::iterator I;
+    DebugLoc dl;
+    const TargetInstrInfo &TII;
+    MachineRegisterInfo &RI;
+    unsigned ZeroReg;
+
+  public:
+    AVRByteBuilder(MachineBasicBlock &mbb, MachineBasicBlock::iterator i,
+                  DebugLoc DL, const TargetInstrInfo &tii)
+      : MBB(mbb), I(i), dl(DL), TII(tii),
+        RI(mbb.getParent()->getRegInfo()), ZeroReg(0) {}
+
+    /// copy - Copy Reg, or its sub-register SubIdx, into a new virtual
+    /// register of class RC.
+    unsigned copy(const TargetRegisterClass *RC, unsigned Reg,
+                  unsigned SubIdx = 0) {
+      unsigned NewReg = RI.createVirtualRegister(RC);
+      BuildMI(MBB, I, dl, TII.get(TargetOpcode::COPY), NewReg)
+        .addReg(Reg, 0, SubIdx);
+      return NewReg;
+    }
+
+    /// getBytes - Append the bytes of the 8 or 16 bit register Reg to Bytes.
+    void getBytes(unsigned Reg, SmallVectorImpl<unsigned> &Bytes) {
+      if (RI.getRegClass(Reg)->getSize() == 1) {
+        Bytes.push_back(Reg);
+        return;
+      }
+      Bytes.push_back(copy(AVR::GR8RegisterClass, Reg, AVR::subreg_loreg));
+      Bytes.push_back(copy(AVR::GR8RegisterClass, Reg, AVR::subreg_hireg));
+    }
+
+    /// combine - Build the 16 bit register Dst out of its two halves.
+    void combine(unsigned Dst, unsigned Lo, unsigned Hi) {
+      BuildMI(MBB, I, dl, TII.get(TargetOpcode::REG_SEQUENCE), Dst)
+        .addReg(Lo).addImm(AVR::subreg_loreg)
+        .addReg(Hi).addImm(AVR::subreg_hireg);
+    }
+
+    /// getZero - Return a register holding zero. LDI leaves SREG alone, so
+    /// this may be called in the middle of a carry chain.
+    unsigned getZero() {
+      if (!ZeroReg) {
+        ZeroReg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+        BuildMI(MBB, I, dl, TII.get(AVR::MOV8ri), ZeroReg).addImm(0);
+      }
+      return ZeroReg;
+    }
+
+    /// getSignByte - Return a register holding 0xff if Reg is negative and
+    /// zero otherwise.
+    unsigned getSignByte(unsigned Reg) {
+      // lsl moves the sign into the carry, sbc spreads it over the byte.
+      unsigned Tmp = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      unsigned Sign = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      BuildMI(MBB, I, dl, TII.get(AVR::Shl8r1), Tmp).addReg(Reg);
+      BuildMI(MBB, I, dl, TII.get(AVR::SBC8rr), Sign).addReg(Tmp).addReg(Tmp);
+      return Sign;
+    }
+
+    /// accumulate - Add the bytes of Partial to Acc, starting at byte Pos.
+    /// The carry out of the last byte of Partial is rippled up through the
+    /// rest of Acc. Null entries of Acc are known to be zero.
+    void accumulate(SmallVectorImpl<unsigned> &Acc, unsigned Pos,
+                    ArrayRef<unsigned> Partial) {
+      bool Carry = false;
+      for (unsigned p = Pos, e = Acc.size(); p != e; ++p) {
+        unsigned Byte = p - Pos < Partial.size() ? Partial[p - Pos] : 0;
+        if (!Byte) {
+          // Only the carry is left to add.
+          if (!Carry)
+            break;
+          Byte = getZero();
+        }
+
+        if (!Acc[p] && !Carry) {
+          Acc[p] = Byte;
+          continue;
+        }
+
+        unsigned Sum = RI.createVirtualRegister(AVR::GR8RegisterClass);
+        BuildMI(MBB, I, dl, TII.get(Carry ? AVR::ADC8rr : AVR::ADD8rr), Sum)
+          .addReg(Acc[p] ? Acc[p] : getZero()).addReg(Byte);
+        Acc[p] = Sum;
+        Carry = true;
+      }
+    }
+
+    /// multiply - Add the product of A and B to Acc, keeping as many bytes
+    /// of it as Acc has. The most significant byte of an operand is treated
+    /// as signed if the operand is.
+    void multiply(ArrayRef<unsigned> A, bool SignedA,
+                  ArrayRef<unsigned> B, bool SignedB,
+                  SmallVectorImpl<unsigned> &Acc) {
+      unsigned NumBytes = Acc.size();
+
+      for (unsigned i = 0, ie = A.size(); i != ie; ++i)
+        for (unsigned j = 0, je = B.size(); j != je; ++j) {
+          unsigned Pos = i + j;
+          if (Pos >= NumBytes)
+            continue;
+
+          bool SA = SignedA && i + 1 == ie;
+          bool SB = SignedB && j + 1 == je;
+          unsigned X = A[i], Y = B[j];
+          unsigned Opc = AVR::MUL8rr;
+          if (SA && SB) {
+            Opc = AVR::MULS8rr;
+            X = copy(AVR::IGR8RegisterClass, X);
+            Y = copy(AVR::IGR8RegisterClass, Y);
+          } else if (SA || SB) {
+            // MULSU takes its signed operand first.
+            Opc = AVR::MULSU8rr;
+            if (SB)
+              std::swap(X, Y);
+            X = copy(AVR::MGR8RegisterClass, X);
+            Y = copy(AVR::MGR8RegisterClass, Y);
+          }
+          BuildMI(MBB, I, dl, TII.get(Opc)).addReg(X).addReg(Y);
+
+          SmallVector<unsigned, 4> Partial;
+          Partial.push_back(copy(AVR::GR8RegisterClass, AVR::R0));
+          if (Pos + 1 < NumBytes)
+            Partial.push_back(copy(AVR::GR8RegisterClass, AVR::R1));
+
+          // Signed partial products have to be sign extended into the bytes
+          // above them.
+          if ((SA || SB) && Pos + 2 < NumBytes)
+            Partial.append(NumBytes - Pos - 2, getSignByte(Partial[1]));
+
+          accumulate(Acc, Pos, Partial);
+        }
+    }
+
+    /// clearR1 - Restore the zero register clobbered by the multiplies.
+    void clearR1() {
+      BuildMI(MBB, I, dl, TII.get(AVR::XOR8rr), AVR::R1)
+        .addReg(AVR::R1).addReg(AVR::R1);
+    }
+
+    /// emit - Emit Opc with the operands Reg and Reg2 or Imm, whichever are
+    /// given, into a new register of class RC.
+    unsigned emit(unsigned Opc, unsigned Reg, unsigned Reg2 = 0,
+                  int64_t Imm = -1,
+                  const TargetRegisterClass *RC = AVR::GR8RegisterClass) {
+      unsigned Dst = RI.createVirtualRegister(RC);
+      MachineInstrBuilder MIB = BuildMI(MBB, I, dl, TII.get(Opc), Dst)
+        .addReg(Reg);
+      if (Reg2)
+        MIB.addReg(Reg2);
+      if (Imm >= 0)
+        MIB.addImm(Imm);
+      return Dst;
+    }
+
+    /// andImm - Return Reg & Imm, done with ANDI.
+    unsigned andImm(unsigned Reg, unsigned Imm) {
+      return emit(AVR::AND8ri, copy(AVR::IGR8RegisterClass, Reg), 0, Imm,
+                  AVR::IGR8RegisterClass);
+    }
+
+    /// getCarryMask - Return 0xff if the carry flag is set, 0 otherwise.
+    /// Both operands of the SBC must hold the same value, so it is done on
+    /// zero; LDI and MOV leave the carry alone.
+    unsigned getCarryMask() {
+      unsigned Zero = copy(AVR::GR8RegisterClass, getZero());
+      return emit(AVR::SBC8rr, Zero, Zero);
+    }
+
+    /// getFlag - Return 1 if the flag Bit of SREG is set, or cleared when
+    /// Invert is true, 0 otherwise. The bit is moved over with BST and BLD.
+    unsigned getFlag(unsigned Bit, bool Invert) {
+      unsigned SR = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      BuildMI(MBB, I, dl, TII.get(AVR::INSREG), SR);
+      if (Invert)
+        SR = emit(AVR::COM8r, SR);
+      BuildMI(MBB, I, dl, TII.get(AVR::BSTrb)).addReg(SR).addImm(Bit);
+      return emit(AVR::BLDrb, copy(AVR::GR8RegisterClass, getZero()), 0, 0);
+    }
+
+    /// getFlagMask - Return 0xff if the flag Bit of SREG is set, 0 otherwise.
+    /// NEG sets the carry for any non-zero value, which SBC turns into the
+    /// mask.
+    unsigned getFlagMask(unsigned Bit) {
+      unsigned SR = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      BuildMI(MBB, I, dl, TII.get(AVR::INSREG), SR);
+      emit(AVR::NEG8r, andImm(SR, 1 << Bit));
+      return getCarryMask();
+    }
+
+    /// blend - Return the bytes of True where Mask is set and the bytes of
+    /// False elsewhere.
+    unsigned blend(unsigned Mask, unsigned True, unsigned False) {
+      unsigned Diff = emit(AVR::XOR8rr, True, False);
+      return emit(AVR::XOR8rr, emit(AVR::AND8rr, Diff, Mask), False);
+    }
+
+    /// shiftByOne - Shift the value in Bytes by a single bit, the carry
+    /// moving the bit from one byte to the next.
+    void shiftByOne(unsigned Kind, SmallVectorImpl<unsigned> &Bytes) {
+      unsigned N = Bytes.size();
+      if (Kind == ISD::SHL) {
+        Bytes[0] = emit(AVR::Shl8r1, Bytes[0]);
+        for (unsigned i = 1; i != N; ++i)
+          Bytes[i] = emit(AVR::ROL8r1c, Bytes[i]);
+        return;
+      }
+
+      Bytes[N - 1] = emit(Kind == ISD::SRA ? AVR::Shr8r1c : AVR::Shr8r1,
+                          Bytes[N - 1]);
+      for (unsigned i = N - 1; i != 0; --i)
+        Bytes[i - 1] = emit(AVR::ROR8r1c, Bytes[i - 1]);
+    }
+
+    /// shiftByNibble - Logically shift the one or two bytes in Bytes by four
+    /// bits. The nibbles are swapped and masked; for two bytes the nibble
+    /// moving between them is exchanged with two XORs.
+    void shiftByNibble(unsigned Kind, SmallVectorImpl<unsigned> &Bytes) {
+      bool isLeft = Kind == ISD::SHL;
+      unsigned Mask = isLeft ? 0xf0 : 0x0f;
+
+      if (Bytes.size() == 1) {
+        Bytes[0] = andImm(emit(AVR::SWAP8r, Bytes[0]), Mask);
+        return;
+      }
+
+      unsigned Lo = emit(AVR::SWAP8r, Bytes[0]);
+      unsigned Hi = emit(AVR::SWAP8r, Bytes[1]);
+      if (isLeft) {
+        Hi = emit(AVR::XOR8rr, andImm(Hi, Mask), Lo);
+        Lo = andImm(Lo, Mask);
+        Hi = emit(AVR::XOR8rr, Hi, Lo);
+      } else {
+        Lo = emit(AVR::XOR8rr, andImm(Lo, Mask), Hi);
+        Hi = andImm(Hi, Mask);
+        Lo = emit(AVR::XOR8rr, Lo, Hi);
+      }
+      Bytes[0] = Lo;
+      Bytes[1] = Hi;
+    }
+
+    /// shiftBits - Shift the value in Bytes by less than 8 bits, picking the
+    /// cheapest of single bit shifts, a nibble swap followed by single bit
+    /// shifts, or shifting the other way through an extra byte, which is
+    /// then dropped: x << n == (x << 8) >> (8 - n), and likewise to the
+    /// right. Costs are counted in instructions, which are one cycle each.
+    void shiftBits(unsigned Kind, SmallVectorImpl<unsigned> &Bytes,
+                   unsigned Amount) {
+      unsigned N = Bytes.size();
+      unsigned SingleCost = Amount * N;
+      unsigned NibbleCost = ~0U;
+      if (Kind != ISD::SRA && Amount >= 4 && N <= 2)
+        NibbleCost = (N == 1 ? 2 : 6) + (Amount - 4) * N;
+      unsigned ReverseCost = (Kind == ISD::SRA ? 3 : 1) + (8 - Amount) * (N + 1);
+
+      if (ReverseCost < SingleCost && ReverseCost < NibbleCost) {
+        SmallVector<unsigned, 5> Wide;
+        if (Kind == ISD::SHL) {
+          Wide.push_back(getZero());
+          Wide.append(Bytes.begin(), Bytes.end());
+          for (unsigned i = Amount; i != 8; ++i)
+            shiftByOne(ISD::SRL, Wide);
+          Bytes.assign(Wide.begin(), Wide.begin() + N);
+        } else {
+          Wide.append(Bytes.begin(), Bytes.end());
+          Wide.push_back(Kind == ISD::SRA ? getSignByte(Bytes[N - 1])
+                                          : getZero());
+          for (unsigned i = Amount; i != 8; ++i)
+            shiftByOne(ISD::SHL, Wide);
+          Bytes.assign(Wide.begin() + 1, Wide.end());
+        }
+        return;
+      }
+
+      if (NibbleCost < SingleCost) {
+        shiftByNibble(Kind, Bytes);
+        Amount -= 4;
+      }
+      while (Amount--)
+        shiftByOne(Kind, Bytes);
+    }
+
+    /// shift - Shift the value in Bytes by Amount, which is less than its
+    /// width. Whole bytes are just moved, the rest goes to shiftBits.
+    void shift(unsigned Kind, SmallVectorImpl<unsigned> &Bytes,
+               unsigned Amount) {
+      unsigned N = Bytes.size();
+      assert(Amount != 0 && Amount < 8 * N && "Invalid shift amount!");
+
+      // An arithmetic shift by all but one bit leaves only the sign.
+      if (Kind == ISD::SRA && Amount == 8 * N - 1) {
+        unsigned Sign = getSignByte(Bytes[N - 1]);
+        Bytes.assign(N, Sign);
+        return;
+      }
+
+      unsigned ByteShift = Amount / 8;
+      unsigned BitShift = Amount % 8;
+      if (ByteShift) {
+        unsigned Fill = Kind == ISD::SRA ? getSignByte(Bytes[N - 1])
+                                         : getZero();
+        if (Kind == ISD::SHL)
+          for (unsigned i = N; i-- != 0; )
+            Bytes[i] = i >= ByteShift ? Bytes[i - ByteShift] : Fill;
+        else
+          for (unsigned i = 0; i != N; ++i)
+            Bytes[i] = i + ByteShift < N ? Bytes[i + ByteShift] : Fill;
+      }
+
+      if (!BitShift)
+        return;
+
+      // Only the bytes not holding the fill take part in the bit shifts.
+      unsigned Begin = Kind == ISD::SHL ? ByteShift : 0;
+      SmallVector<unsigned, 4> Part(Bytes.begin() + Begin,
+                                    Bytes.begin() + Begin + N - ByteShift);
+      shiftBits(Kind, Part, BitShift);
+      std::copy(Part.begin(), Part.end(), Bytes.begin() + Begin);
+    }
+  };
+}
+
 MachineBasicBlock*
 AVRTargetLowering::EmitShiftInstr(MachineInstr *MI,
                                      MachineBasicBlock *BB) const {
@@ -949,22 +1790,22 @@ AVRTargetLowering::EmitShiftInstr(MachineInstr *MI,
   DebugLoc dl = MI->getDebugLoc();
   const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
 
-  unsigned Opc;
+  unsigned Kind;
   const TargetRegisterClass * RC;
   switch (MI->getOpcode()) {
   default:
-    assert(0 && "Invalid shift opcode!");
-  case AVR::Shl8:
-   Opc = AVRISD::SHLC;
-   RC = AVR::GR8RegisterClass;
+    llvm_unreachable("Invalid shift opcode!");
+  case AVR::Shl16:
+   Kind = ISD::SHL;
+   RC = AVR::GR16RegisterClass;
    break;
-  case AVR::Srl8:
-   Opc = AVRISD::SRLC;
-   RC = AVR::GR8RegisterClass;
+  case AVR::Srl16:
+   Kind = ISD::SRL;
+   RC = AVR::GR16RegisterClass;
    break;
-  case AVR::Sra8:
-   Opc = AVRISD::SRAC;
-   RC = AVR::GR8RegisterClass;
+  case AVR::Sra16:
+   Kind = ISD::SRA;
+   RC = AVR::GR16RegisterClass;
    break;
   }
 
@@ -992,11 +1833,13 @@ AVRTargetLowering::EmitShiftInstr(MachineInstr *MI,
   LoopBB->addSuccessor(RemBB);
   LoopBB->addSuccessor(LoopBB);
 
-  unsigned ShiftAmtReg = RI.createVirtualRegister(AVR::GR8RegisterClass);
-  unsigned ShiftAmtReg2 = RI.createVirtualRegister(AVR::GR8RegisterClass);
+  // The loop counter is compared and decremented with CPI and SUBI.
+  unsigned ShiftAmtReg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+  unsigned ShiftAmtReg2 = RI.createVirtualRegister(AVR::IGR8RegisterClass);
   unsigned ShiftReg = RI.createVirtualRegister(RC);
   unsigned ShiftReg2 = RI.createVirtualRegister(RC);
   unsigned ShiftAmtSrcReg = MI->getOperand(2).getReg();
+  RI.constrainRegClass(ShiftAmtSrcReg, AVR::IGR8RegisterClass);
   unsigned SrcReg = MI->getOperand(1).getReg();
   unsigned DstReg = MI->getOperand(0).getReg();
 
@@ -1020,8 +1863,11 @@ AVRTargetLowering::EmitShiftInstr(MachineInstr *MI,
   BuildMI(LoopBB, dl, TII.get(AVR::PHI), ShiftAmtReg)
     .addReg(ShiftAmtSrcReg).addMBB(BB)
     .addReg(ShiftAmtReg2).addMBB(LoopBB);
-  BuildMI(LoopBB, dl, TII.get(Opc), ShiftReg2)
-    .addReg(ShiftReg);
+  AVRByteBuilder Builder(*LoopBB, LoopBB->end(), dl, TII);
+  SmallVector<unsigned, 2> Bytes;
+  Builder.getBytes(ShiftReg, Bytes);
+  Builder.shiftByOne(Kind, Bytes);
+  Builder.combine(ShiftReg2, Bytes[0], Bytes[1]);
   BuildMI(LoopBB, dl, TII.get(AVR::SUB8ri), ShiftAmtReg2)
     .addReg(ShiftAmtReg).addImm(1);
   BuildMI(LoopBB, dl, TII.get(AVR::JCC))
@@ -1039,12 +1885,680 @@ AVRTargetLowering::EmitShiftInstr(MachineInstr *MI,
 }
 
 MachineBasicBlock*
-AVRTargetLowering::EmitInstrWithCustomInserter(MachineInstr *MI,
-                                                  MachineBasicBlock *BB) const {
+AVRTargetLowering::EmitShiftImmInstr(MachineInstr *MI,
+                                     MachineBasicBlock *BB) const {
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  DebugLoc dl = MI->getDebugLoc();
+  AVRByteBuilder Builder(*BB, MI, dl, TII);
+
+  unsigned Kind;
+  unsigned NumDefs = 1;
+  switch (MI->getOpcode()) {
+  default:
+    llvm_unreachable("Invalid shift opcode!");
+  case AVR::Shl32i: NumDefs = 2; // FALLTHROUGH
+  case AVR::Shl8i:
+  case AVR::Shl16i: Kind = ISD::SHL; break;
+  case AVR::Srl32i: NumDefs = 2; // FALLTHROUGH
+  case AVR::Srl8i:
+  case AVR::Srl16i: Kind = ISD::SRL; break;
+  case AVR::Sra32i: NumDefs = 2; // FALLTHROUGH
+  case AVR::Sra8i:
+  case AVR::Sra16i: Kind = ISD::SRA; break;
+  }
+
+  SmallVector<unsigned, 4> Bytes;
+  for (unsigned i = 0; i != NumDefs; ++i)
+    Builder.getBytes(MI->getOperand(NumDefs + i).getReg(), Bytes);
+  Builder.shift(Kind, Bytes, MI->getOperand(2 * NumDefs).getImm());
+
+  if (Bytes.size() == 1)
+    BuildMI(*BB, MI, dl, TII.get(TargetOpcode::COPY),
+            MI->getOperand(0).getReg())
+      .addReg(Bytes[0]);
+  else
+    for (unsigned i = 0; i != NumDefs; ++i)
+      Builder.combine(MI->getOperand(i).getReg(),
+                      Bytes[2 * i], Bytes[2 * i + 1]);
+
+  MI->eraseFromParent();   // The pseudo instruction is gone now.
+  return BB;
+}
+
+MachineBasicBlock*
+AVRTargetLowering::EmitMulInstr(MachineInstr *MI,
+                                MachineBasicBlock *BB) const {
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  AVRByteBuilder Builder(*BB, MI, MI->getDebugLoc(), TII);
+
   unsigned Opc = MI->getOpcode();
+  bool isLoHi = Opc == AVR::UMulLoHi16 || Opc == AVR::SMulLoHi16;
+  bool SignedA = false, SignedB = false;
+  unsigned NumBytes;
 
-  if (Opc == AVR::Shl8 || Opc == AVR::Sra8 ||
-      Opc == AVR::Srl8)
-    return EmitShiftInstr(MI, BB);
+  switch (Opc) {
+  default:
+    llvm_unreachable("Invalid multiplication opcode!");
+  case AVR::Mul8:
+    NumBytes = 1;
+    break;
+  case AVR::MulHS8:
+  case AVR::SMulW8:
+    SignedA = SignedB = true;
+    NumBytes = 2;
+    break;
+  case AVR::SUMulW8:
+    SignedA = true;
+    NumBytes = 2;
+    break;
+  case AVR::MulHU8:
+  case AVR::Mul16:
+  case AVR::UMulW8:
+    NumBytes = 2;
+    break;
+  case AVR::SMulLoHi16:
+    SignedA = SignedB = true;
+    NumBytes = 4;
+    break;
+  case AVR::UMulLoHi16:
+    NumBytes = 4;
+    break;
+  }
+
+  unsigned FirstSrc = isLoHi ? 2 : 1;
+  SmallVector<unsigned, 2> A, B;
+  Builder.getBytes(MI->getOperand(FirstSrc).getReg(), A);
+  Builder.getBytes(MI->getOperand(FirstSrc + 1).getReg(), B);
+
+  SmallVector<unsigned, 4> Acc(NumBytes, 0);
+  Builder.multiply(A, SignedA, B, SignedB, Acc);
+  Builder.clearR1();
+
+  // Hand the requested bytes of the product over to the results.
+  unsigned DstReg = MI->getOperand(0).getReg();
+  switch (Opc) {
+  case AVR::Mul8:
+    BuildMI(*BB, MI, MI->getDebugLoc(), TII.get(TargetOpcode::COPY), DstReg)
+      .addReg(Acc[0]);
+    break;
+  case AVR::MulHS8:
+  case AVR::MulHU8:
+    BuildMI(*BB, MI, MI->getDebugLoc(), TII.get(TargetOpcode::COPY), DstReg)
+      .addReg(Acc[1]);
+    break;
+  default:
+    Builder.combine(DstReg, Acc[0], Acc[1]);
+    if (isLoHi)
+      Builder.combine(MI->getOperand(1).getReg(), Acc[2], Acc[3]);
+    break;
+  }
+
+  MI->eraseFromParent();   // The pseudo instruction is gone now.
+  return BB;
+}
+
+/// addByteAddress - Add the NumOps address operands of MI starting at OpNo
+/// to MIB, moved Offset bytes on. The last one is the displacement or the
+/// absolute address, anything before it is the base.
+static void addByteAddress(MachineInstrBuilder &MIB, MachineInstr *MI,
+                           unsigned OpNo, unsigned NumOps, int64_t Offset) {
+  unsigned DispNo = OpNo + NumOps - 1;
+  for (unsigned i = OpNo; i != DispNo; ++i) {
+    // The base is used again by the other byte.
+    MachineOperand Base = MI->getOperand(i);
+    if (Base.isReg())
+      Base.setIsKill(false);
+    MIB.addOperand(Base);
+  }
+
+  const MachineOperand &Disp = MI->getOperand(DispNo);
+  if (Disp.isGlobal())
+    MIB.addGlobalAddress(Disp.getGlobal(), Disp.getOffset() + Offset,
+                         Disp.getTargetFlags());
+  else
+    MIB.addImm(Disp.getImm() + Offset);
+}
+
+MachineBasicBlock*
+AVRTargetLowering::Emit16BitInstr(MachineInstr *MI,
+                                  MachineBasicBlock *BB) const {
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  MachineRegisterInfo &RI = BB->getParent()->getRegInfo();
+  DebugLoc dl = MI->getDebugLoc();
+  AVRByteBuilder Builder(*BB, MI, dl, TII);
+  unsigned Opc = MI->getOpcode();
+
+  switch (Opc) {
+  case AVR::MOV16ri: {
+    // LDI does not touch the flags, so the two halves may go anywhere. An
+    // address known at link time is loaded as lo8(sym) and hi8(sym).
+    const MachineOperand &Src = MI->getOperand(1);
+    unsigned Lo = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+    unsigned Hi = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+    if (Src.isImm()) {
+      uint64_t Imm = Src.getImm();
+      BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), Lo).addImm(Imm & 0xff);
+      BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), Hi).addImm((Imm >> 8) & 0xff);
+    } else {
+      MachineOperand LoSym = Src, HiSym = Src;
+      LoSym.setTargetFlags(AVRII::MO_LO8);
+      HiSym.setTargetFlags(AVRII::MO_HI8);
+      BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), Lo).addOperand(LoSym);
+      BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), Hi).addOperand(HiSym);
+    }
+    Builder.combine(MI->getOperand(0).getReg(), Lo, Hi);
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::MOV16rm:
+  case AVR::MOV16rm_INDEX: {
+    bool isIndex = Opc == AVR::MOV16rm_INDEX;
+    unsigned ByteOpc = isIndex ? AVR::MOV8rm_INDEX : AVR::MOV8rm;
+    unsigned Bytes[2];
+    for (unsigned i = 0; i != 2; ++i) {
+      Bytes[i] = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      MachineInstrBuilder MIB = BuildMI(*BB, MI, dl, TII.get(ByteOpc),
+                                        Bytes[i]);
+      addByteAddress(MIB, MI, 1, isIndex ? 2 : 1, i);
+      MIB.setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    }
+    Builder.combine(MI->getOperand(0).getReg(), Bytes[0], Bytes[1]);
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::MOV16mr:
+  case AVR::MOV16mr_INDEX: {
+    bool isIndex = Opc == AVR::MOV16mr_INDEX;
+    unsigned ByteOpc = isIndex ? AVR::MOV8mr_INDEX : AVR::MOV8mr;
+    unsigned NumAddrOps = isIndex ? 2 : 1;
+    SmallVector<unsigned, 2> Bytes;
+    Builder.getBytes(MI->getOperand(NumAddrOps).getReg(), Bytes);
+    // The 16-bit I/O registers latch the byte written first and take both
+    // at the second write: the high byte first on classic cores, the low
+    // byte first on the XMEGA.
+    bool LowFirst = Subtarget.isXMEGA();
+    for (unsigned n = 0; n != 2; ++n) {
+      unsigned i = LowFirst ? n : 1 - n;
+      MachineInstrBuilder MIB = BuildMI(*BB, MI, dl, TII.get(ByteOpc));
+      addByteAddress(MIB, MI, 0, NumAddrOps, i);
+      MIB.addReg(Bytes[i])
+         .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    }
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::LD16rm_P:
+  case AVR::LD16rm_PD: {
+    // A post-increment reads the low byte first, a pre-decrement the high
+    // byte. The pointer is passed from the first load to the second.
+    bool isInc = Opc == AVR::LD16rm_P;
+    unsigned ByteOpc = isInc ? AVR::LD8rm_P : AVR::LD8rm_PD;
+    unsigned Ptr = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+    unsigned First = RI.createVirtualRegister(AVR::GR8RegisterClass);
+    unsigned Second = RI.createVirtualRegister(AVR::GR8RegisterClass);
+    BuildMI(*BB, MI, dl, TII.get(ByteOpc), First)
+      .addReg(Ptr, RegState::Define)
+      .addReg(MI->getOperand(2).getReg())
+      .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    BuildMI(*BB, MI, dl, TII.get(ByteOpc), Second)
+      .addReg(MI->getOperand(1).getReg(), RegState::Define)
+      .addReg(Ptr)
+      .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    Builder.combine(MI->getOperand(0).getReg(),
+                    isInc ? First : Second, isInc ? Second : First);
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::LPM8r0:
+  case AVR::LPM16r0: {
+    // LPM reads into R0, Z is moved on by hand for the high byte. Without
+    // ADIW, a SUBI and SBCI of -1 do it.
+    unsigned Ptr = MI->getOperand(1).getReg();
+    unsigned Bytes[2];
+    unsigned NumBytes = Opc == AVR::LPM16r0 ? 2 : 1;
+    for (unsigned i = 0; i != NumBytes; ++i) {
+      if (i) {
+        unsigned NextPtr = RI.createVirtualRegister(AVR::ZREGRegisterClass);
+        if (Subtarget.hasADDSUBIW()) {
+          BuildMI(*BB, MI, dl, TII.get(AVR::ADD16wri), NextPtr)
+            .addReg(Ptr).addImm(1);
+        } else {
+          unsigned Lo = Builder.copy(AVR::IGR8RegisterClass, Ptr,
+                                     AVR::subreg_loreg);
+          unsigned Hi = Builder.copy(AVR::IGR8RegisterClass, Ptr,
+                                     AVR::subreg_hireg);
+          unsigned NextLo = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+          unsigned NextHi = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+          BuildMI(*BB, MI, dl, TII.get(AVR::SUB8ri), NextLo)
+            .addReg(Lo).addImm(0xff);
+          BuildMI(*BB, MI, dl, TII.get(AVR::SBC8ri), NextHi)
+            .addReg(Hi).addImm(0xff);
+          Builder.combine(NextPtr, NextLo, NextHi);
+        }
+        Ptr = NextPtr;
+      }
+      BuildMI(*BB, MI, dl, TII.get(AVR::LPM))
+        .addReg(Ptr)
+        .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+      Bytes[i] = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      BuildMI(*BB, MI, dl, TII.get(TargetOpcode::COPY), Bytes[i])
+        .addReg(AVR::R0);
+    }
+    if (NumBytes == 2)
+      Builder.combine(MI->getOperand(0).getReg(), Bytes[0], Bytes[1]);
+    else
+      BuildMI(*BB, MI, dl, TII.get(TargetOpcode::COPY),
+              MI->getOperand(0).getReg())
+        .addReg(Bytes[0]);
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::LPM16rz:
+  case AVR::LPM16rz_P:
+  case AVR::ELPM8:
+  case AVR::ELPM16: {
+    // Program memory is read a byte at a time through Z, the low byte first
+    // with Z+. ELPM has RAMPZ set to the segment first.
+    bool isInc = Opc == AVR::LPM16rz_P;
+    bool isExt = Opc == AVR::ELPM8 || Opc == AVR::ELPM16;
+    unsigned FirstOpc = isExt ? AVR::ELPM8rz_P : AVR::LPM8rz_P;
+    unsigned SecondOpc = isExt ? AVR::ELPM8rz : AVR::LPM8rz;
+    unsigned Ptr = MI->getOperand(isInc ? 2 : 1).getReg();
+
+    if (isExt) {
+      unsigned Seg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+      BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), Seg)
+        .addImm(MI->getOperand(2).getImm());
+      BuildMI(*BB, MI, dl, TII.get(AVR::OUT), AVR::RAMPZ)
+        .addReg(Seg, RegState::Kill);
+    }
+
+    if (Opc == AVR::ELPM8) {
+      BuildMI(*BB, MI, dl, TII.get(SecondOpc), MI->getOperand(0).getReg())
+        .addReg(Ptr)
+        .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    } else {
+      unsigned NextPtr = RI.createVirtualRegister(AVR::ZREGRegisterClass);
+      unsigned Lo = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      unsigned Hi = RI.createVirtualRegister(AVR::GR8RegisterClass);
+      BuildMI(*BB, MI, dl, TII.get(FirstOpc), Lo)
+        .addReg(NextPtr, RegState::Define)
+        .addReg(Ptr)
+        .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+      if (isInc)
+        BuildMI(*BB, MI, dl, TII.get(FirstOpc), Hi)
+          .addReg(MI->getOperand(1).getReg(), RegState::Define)
+          .addReg(NextPtr)
+          .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+      else
+        BuildMI(*BB, MI, dl, TII.get(SecondOpc), Hi)
+          .addReg(NextPtr)
+          .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+      Builder.combine(MI->getOperand(0).getReg(), Lo, Hi);
+    }
+
+    // The XMEGA also takes RAMPZ for data accesses through Z.
+    if (isExt && Subtarget.isXMEGA())
+      BuildMI(*BB, MI, dl, TII.get(AVR::OUT), AVR::RAMPZ)
+        .addReg(Builder.getZero());
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::ST16mr_P:
+  case AVR::ST16mr_PD: {
+    bool isInc = Opc == AVR::ST16mr_P;
+    unsigned ByteOpc = isInc ? AVR::ST8mr_P : AVR::ST8mr_PD;
+    unsigned Ptr = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+    SmallVector<unsigned, 2> Bytes;
+    Builder.getBytes(MI->getOperand(2).getReg(), Bytes);
+    if (!isInc)
+      std::swap(Bytes[0], Bytes[1]);
+    BuildMI(*BB, MI, dl, TII.get(ByteOpc), Ptr)
+      .addReg(MI->getOperand(1).getReg())
+      .addReg(Bytes[0])
+      .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    BuildMI(*BB, MI, dl, TII.get(ByteOpc), MI->getOperand(0).getReg())
+      .addReg(Ptr)
+      .addReg(Bytes[1])
+      .setMemRefs(MI->memoperands_begin(), MI->memoperands_end());
+    MI->eraseFromParent();
+    return BB;
+  }
+  case AVR::ZExt8:
+  case AVR::SExt8: {
+    unsigned Src = MI->getOperand(1).getReg();
+    unsigned Hi = Opc == AVR::ZExt8 ? Builder.getZero()
+                                    : Builder.getSignByte(Src);
+    Builder.combine(MI->getOperand(0).getReg(), Src, Hi);
+    MI->eraseFromParent();
+    return BB;
+  }
+  }
+
+  // The rest are binary operations, done on the low halves first so that
+  // the carry flows from the low into the high half.
+  unsigned LoOpc, HiOpc;
+  bool isCompare = false;
+  switch (Opc) {
+  default:
+    llvm_unreachable("Invalid 16-bit opcode!");
+  case AVR::Add16: LoOpc = AVR::ADD8rr; HiOpc = AVR::ADC8rr; break;
+  case AVR::Adc16: LoOpc = AVR::ADC8rr; HiOpc = AVR::ADC8rr; break;
+  case AVR::Sub16: LoOpc = AVR::SUB8rr; HiOpc = AVR::SBC8rr; break;
+  case AVR::Sbc16: LoOpc = AVR::SBC8rr; HiOpc = AVR::SBC8rr; break;
+  case AVR::And16: LoOpc = AVR::AND8rr; HiOpc = AVR::AND8rr; break;
+  case AVR::Or16:  LoOpc = AVR::OR8rr;  HiOpc = AVR::OR8rr;  break;
+  case AVR::Xor16: LoOpc = AVR::XOR8rr; HiOpc = AVR::XOR8rr; break;
+  case AVR::Cmp16:
+    LoOpc = AVR::CMP8rr; HiOpc = AVR::CPC8rr; isCompare = true;
+    break;
+  case AVR::Cpc16:
+    LoOpc = AVR::CPC8rr; HiOpc = AVR::CPC8rr; isCompare = true;
+    break;
+  }
+
+  unsigned FirstSrc = isCompare ? 0 : 1;
+  SmallVector<unsigned, 2> A, B;
+  Builder.getBytes(MI->getOperand(FirstSrc).getReg(), A);
+  Builder.getBytes(MI->getOperand(FirstSrc + 1).getReg(), B);
+
+  if (isCompare) {
+    BuildMI(*BB, MI, dl, TII.get(LoOpc)).addReg(A[0]).addReg(B[0]);
+    BuildMI(*BB, MI, dl, TII.get(HiOpc)).addReg(A[1]).addReg(B[1]);
+  } else {
+    unsigned Lo = RI.createVirtualRegister(AVR::GR8RegisterClass);
+    unsigned Hi = RI.createVirtualRegister(AVR::GR8RegisterClass);
+    BuildMI(*BB, MI, dl, TII.get(LoOpc), Lo).addReg(A[0]).addReg(B[0]);
+    BuildMI(*BB, MI, dl, TII.get(HiOpc), Hi).addReg(A[1]).addReg(B[1]);
+    Builder.combine(MI->getOperand(0).getReg(), Lo, Hi);
+  }
+
+  MI->eraseFromParent();   // The pseudo instruction is gone now.
+  return BB;
+}
+
+/// getFlagBit - Find the SREG flag the condition code CC tests. The
+/// condition holds when the flag is set, or cleared if Invert is true.
+/// Returns false if the condition is not a single flag.
+static bool getFlagBit(unsigned CC, unsigned &Bit, bool &Invert) {
+  switch (CC) {
+  default:            return false;
+  case AVRCC::COND_LO: Bit = 0; Invert = false; return true; // C
+  case AVRCC::COND_HS: Bit = 0; Invert = true;  return true;
+  case AVRCC::COND_E:  Bit = 1; Invert = false; return true; // Z
+  case AVRCC::COND_NE: Bit = 1; Invert = true;  return true;
+  case AVRCC::COND_L:  Bit = 4; Invert = false; return true; // S
+  case AVRCC::COND_GE: Bit = 4; Invert = true;  return true;
+  case AVRCC::COND_MI: Bit = 2; Invert = false; return true; // N
+  case AVRCC::COND_PL: Bit = 2; Invert = true;  return true;
+  case AVRCC::COND_VS: Bit = 3; Invert = false; return true; // V
+  case AVRCC::COND_VC: Bit = 3; Invert = true;  return true;
+  case AVRCC::COND_HCS: Bit = 5; Invert = false; return true; // H
+  case AVRCC::COND_HCC: Bit = 5; Invert = true;  return true;
+  case AVRCC::COND_TS: Bit = 6; Invert = false; return true; // T
+  case AVRCC::COND_TC: Bit = 6; Invert = true;  return true;
+  case AVRCC::COND_IE: Bit = 7; Invert = false; return true; // I
+  case AVRCC::COND_ID: Bit = 7; Invert = true;  return true;
+  }
+}
+
+MachineBasicBlock*
+AVRTargetLowering::EmitSelectInstr(MachineInstr *MI,
+                                   MachineBasicBlock *BB) const {
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  DebugLoc dl = MI->getDebugLoc();
+  unsigned Opc = MI->getOpcode();
+  unsigned Dst = MI->getOperand(0).getReg();
+  unsigned CC = MI->getOperand(Opc == AVR::SetCC8 ? 1 : 3).getImm();
+
+  unsigned Bit;
+  bool Invert;
+  if (getFlagBit(CC, Bit, Invert)) {
+    // The flag is turned into a value or a mask right away, so the timing
+    // does not depend on the condition.
+    AVRByteBuilder Builder(*BB, MI, dl, TII);
+
+    if (Opc == AVR::SetCC8) {
+      unsigned Res;
+      if (Bit == 0) {
+        unsigned Mask = Builder.getCarryMask();
+        Res = Builder.emit(Invert ? AVR::INC8r : AVR::NEG8r, Mask);
+      } else
+        Res = Builder.getFlag(Bit, Invert);
+      BuildMI(*BB, MI, dl, TII.get(TargetOpcode::COPY), Dst).addReg(Res);
+      MI->eraseFromParent();
+      return BB;
+    }
+
+    unsigned Mask = Bit == 0 ? Builder.getCarryMask()
+                             : Builder.getFlagMask(Bit);
+    SmallVector<unsigned, 2> True, False;
+    Builder.getBytes(MI->getOperand(1).getReg(), True);
+    Builder.getBytes(MI->getOperand(2).getReg(), False);
+    if (Invert)
+      std::swap(True, False);
+
+    for (unsigned i = 0, e = True.size(); i != e; ++i)
+      True[i] = Builder.blend(Mask, True[i], False[i]);
+
+    if (Opc == AVR::Select8)
+      BuildMI(*BB, MI, dl, TII.get(TargetOpcode::COPY), Dst).addReg(True[0]);
+    else
+      Builder.combine(Dst, True[0], True[1]);
+    MI->eraseFromParent();
+    return BB;
+  }
 
+  // Conditions involving more than a single flag are branched on.
+  MachineRegisterInfo &RI = BB->getParent()->getRegInfo();
+  unsigned TrueReg, FalseReg;
+  if (Opc == AVR::SetCC8) {
+    TrueReg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+    FalseReg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+    BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), TrueReg).addImm(1);
+    BuildMI(*BB, MI, dl, TII.get(AVR::MOV8ri), FalseReg).addImm(0);
+  } else {
+    TrueReg = MI->getOperand(1).getReg();
+    FalseReg = MI->getOperand(2).getReg();
+  }
+
+  // To "insert" a select we actually have to insert the diamond control-flow
+  // pattern. The incoming instruction knows the destination vreg to set,
+  // the condition code register to branch on, the true/false values to
+  // select between, and a branch opcode to use.
+  const BasicBlock *LLVM_BB = BB->getBasicBlock();
+  MachineFunction::iterator I = BB;
+  ++I;
+
+  //  thisMBB:
+  //  ...
+  //   TrueVal = ...
+  //   cmpTY ccX, r1, r2
+  //   jCC copy1MBB
+  //   fallthrough --> copy0MBB
+  MachineBasicBlock *thisMBB = BB;
+  MachineFunction *F = BB->getParent();
+  MachineBasicBlock *copy0MBB = F->CreateMachineBasicBlock(LLVM_BB);
+  MachineBasicBlock *copy1MBB = F->CreateMachineBasicBlock(LLVM_BB);
+  F->insert(I, copy0MBB);
+  F->insert(I, copy1MBB);
+  // Update machine-CFG edges by transferring all successors of the current
+  // block to the new block which will contain the Phi node for the select.
+  copy1MBB->splice(copy1MBB->begin(), BB,
+                   llvm::next(MachineBasicBlock::iterator(MI)),
+                   BB->end());
+  copy1MBB->transferSuccessorsAndUpdatePHIs(BB);
+  // Next, add the true and fallthrough blocks as its successors.
+  BB->addSuccessor(copy0MBB);
+  BB->addSuccessor(copy1MBB);
+
+  BuildMI(BB, dl, TII.get(AVR::JCC))
+    .addMBB(copy1MBB)
+    .addImm(CC);
+
+  //  copy0MBB:
+  //   %FalseValue = ...
+  //   # fallthrough to copy1MBB
+  BB = copy0MBB;
+
+  // Update machine-CFG edges
+  BB->addSuccessor(copy1MBB);
+
+  //  copy1MBB:
+  //   %Result = phi [ %FalseValue, copy0MBB ], [ %TrueValue, thisMBB ]
+  //  ...
+  BB = copy1MBB;
+  BuildMI(*BB, BB->begin(), dl, TII.get(AVR::PHI), Dst)
+    .addReg(FalseReg).addMBB(copy0MBB)
+    .addReg(TrueReg).addMBB(thisMBB);
+
+  MI->eraseFromParent();   // The pseudo instruction is gone now.
+  return BB;
+}
+
+MachineBasicBlock*
+AVRTargetLowering::EmitMemLoopInstr(MachineInstr *MI,
+                                    MachineBasicBlock *BB) const {
+  MachineFunction *F = BB->getParent();
+  MachineRegisterInfo &RI = F->getRegInfo();
+  DebugLoc dl = MI->getDebugLoc();
+  const TargetInstrInfo &TII = *getTargetMachine().getInstrInfo();
+  bool IsCopy = MI->getOpcode() == AVR::CopyLoop;
+
+  const BasicBlock *LLVM_BB = BB->getBasicBlock();
+  MachineFunction::iterator I = BB;
+  ++I;
+
+  MachineBasicBlock *LoopBB = F->CreateMachineBasicBlock(LLVM_BB);
+  MachineBasicBlock *RemBB  = F->CreateMachineBasicBlock(LLVM_BB);
+  F->insert(I, LoopBB);
+  F->insert(I, RemBB);
+
+  RemBB->splice(RemBB->begin(), BB,
+                llvm::next(MachineBasicBlock::iterator(MI)),
+                BB->end());
+  RemBB->transferSuccessorsAndUpdatePHIs(BB);
+
+  // The loop runs at least once: BB => LoopBB => RemBB, LoopBB => LoopBB.
+  BB->addSuccessor(LoopBB);
+  LoopBB->addSuccessor(LoopBB);
+  LoopBB->addSuccessor(RemBB);
+
+  // BB:
+  // Count = ldi N, where 256 is 0 as the counter wraps before the test.
+  unsigned CountReg = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+  BuildMI(BB, dl, TII.get(AVR::MOV8ri), CountReg)
+    .addImm(MI->getOperand(2).getImm() & 0xff);
+
+  // LoopBB:
+  // DstPtr = phi [%Dst, BB], [%DstPtr2, LoopBB]
+  // SrcPtr = phi [%Src, BB], [%SrcPtr2, LoopBB]   (copies only)
+  // Count1 = phi [%Count, BB], [%Count2, LoopBB]
+  // Byte, SrcPtr2 = ld SrcPtr+                    (copies only)
+  // DstPtr2 = st DstPtr+, Byte
+  // Count2 = subi Count1, 1
+  // brne LoopBB
+  unsigned DstReg = MI->getOperand(0).getReg();
+  unsigned DstPtr = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+  unsigned DstPtr2 = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+  unsigned Count1 = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+  unsigned Count2 = RI.createVirtualRegister(AVR::IGR8RegisterClass);
+
+  BuildMI(LoopBB, dl, TII.get(AVR::PHI), DstPtr)
+    .addReg(DstReg).addMBB(BB)
+    .addReg(DstPtr2).addMBB(LoopBB);
+  BuildMI(LoopBB, dl, TII.get(AVR::PHI), Count1)
+    .addReg(CountReg).addMBB(BB)
+    .addReg(Count2).addMBB(LoopBB);
+
+  unsigned Byte = MI->getOperand(1).getReg();
+  if (IsCopy) {
+    unsigned SrcPtr = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+    unsigned SrcPtr2 = RI.createVirtualRegister(AVR::INDR16RegisterClass);
+    BuildMI(LoopBB, dl, TII.get(AVR::PHI), SrcPtr)
+      .addReg(Byte).addMBB(BB)
+      .addReg(SrcPtr2).addMBB(LoopBB);
+    Byte = RI.createVirtualRegister(AVR::GR8RegisterClass);
+    BuildMI(LoopBB, dl, TII.get(AVR::LD8rm_P), Byte)
+      .addReg(SrcPtr2, RegState::Define)
+      .addReg(SrcPtr);
+  }
+  BuildMI(LoopBB, dl, TII.get(AVR::ST8mr_P), DstPtr2)
+    .addReg(DstPtr)
+    .addReg(Byte);
+  BuildMI(LoopBB, dl, TII.get(AVR::SUB8ri), Count2)
+    .addReg(Count1).addImm(1);
+  BuildMI(LoopBB, dl, TII.get(AVR::JCC))
+    .addMBB(LoopBB)
+    .addImm(AVRCC::COND_NE);
+
+  MI->eraseFromParent();   // The pseudo instruction is gone now.
+  return RemBB;
+}
+
+MachineBasicBlock*
+AVRTargetLowering::EmitInstrWithCustomInserter(MachineInstr *MI,
+                                                  MachineBasicBlock *BB) const {
+  switch (MI->getOpcode()) {
+  default:
+    llvm_unreachable("Unexpected instr type to insert");
+  case AVR::Shl16:
+  case AVR::Sra16:
+  case AVR::Srl16:
+    return EmitShiftInstr(MI, BB);
+  case AVR::Shl8i:
+  case AVR::Srl8i:
+  case AVR::Sra8i:
+  case AVR::Shl16i:
+  case AVR::Srl16i:
+  case AVR::Sra16i:
+  case AVR::Shl32i:
+  case AVR::Srl32i:
+  case AVR::Sra32i:
+    return EmitShiftImmInstr(MI, BB);
+  case AVR::Mul8:
+  case AVR::MulHS8:
+  case AVR::MulHU8:
+  case AVR::Mul16:
+  case AVR::UMulLoHi16:
+  case AVR::SMulLoHi16:
+  case AVR::UMulW8:
+  case AVR::SMulW8:
+  case AVR::SUMulW8:
+    return EmitMulInstr(MI, BB);
+  case AVR::MOV16ri:
+  case AVR::Add16:
+  case AVR::Adc16:
+  case AVR::Sub16:
+  case AVR::Sbc16:
+  case AVR::And16:
+  case AVR::Or16:
+  case AVR::Xor16:
+  case AVR::Cmp16:
+  case AVR::Cpc16:
+  case AVR::SExt8:
+  case AVR::ZExt8:
+  case AVR::MOV16rm:
+  case AVR::MOV16rm_INDEX:
+  case AVR::MOV16mr:
+  case AVR::MOV16mr_INDEX:
+  case AVR::LD16rm_P:
+  case AVR::LD16rm_PD:
+  case AVR::ST16mr_P:
+  case AVR::ST16mr_PD:
+  case AVR::LPM8r0:
+  case AVR::LPM16r0:
+  case AVR::LPM16rz:
+  case AVR::LPM16rz_P:
+  case AVR::ELPM8:
+  case AVR::ELPM16:
+    return Emit16BitInstr(MI, BB);
+  case AVR::SetCC8:
+  case AVR::Select8:
+  case AVR::Select16:
+    return EmitSelectInstr(MI, BB);
+  case AVR::CopyLoop:
+  case AVR::FillLoop:
+    return EmitMemLoopInstr(MI, BB);
+  }
 }
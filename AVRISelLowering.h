@@ -37,6 +37,10 @@ namespace llvm {
       /// instruction, which includes a bunch of information.
       CALL,
 
+      /// TC_RETURN - A tail call. Operand 0 is the chain operand, operand 1
+      /// the callee, and the argument registers follow.
+      TC_RETURN,
+
       /// Wrapper - A wrapper node for TargetConstantPool, TargetExternalSymbol,
       /// and TargetGlobalAddress.
       Wrapper,
@@ -44,8 +48,13 @@ namespace llvm {
       /// CMP - Compare instruction.
       CMP,
 
+      /// CMPC - Compare with carry, continues a CMP for the upper words of
+      /// values wider than 16 bits. Operand 2 is the flag operand of the
+      /// previous compare.
+      CMPC,
+
       /// SetCC - Operand 0 is condition code, and operand 1 is the flag
-      /// operand produced by a CMP instruction.
+      /// operand produced by a CMP instruction. The result is 0 or 1.
       SETCC,
 
       /// AVR conditional branches. Operand 0 is the chain operand, operand 1
@@ -54,33 +63,76 @@ namespace llvm {
       /// instruction.
       BR_CC,
 
-      /// SELECT_CC - Operand 0 and operand 1 are selection variable, operand 3
-      /// is condition code and operand 4 is flag operand.
+      /// BRBIT_IO - Jump on a bit of one of the low 32 I/O registers. Operand
+      /// 0 is the chain operand, operand 1 the block to jump to, operand 2 the
+      /// data address of the register, operand 3 the number of the bit, and
+      /// operand 4 is 1 to jump if it is set, 0 if it is cleared.
+      BRBIT_IO,
+
+      /// BRBIT - Jump on a bit of a byte, as BRBIT_IO with the byte as
+      /// operand 2.
+      BRBIT,
+
+      /// SELECT_CC - Operand 0 and operand 1 are selection variable, operand 2
+      /// is condition code and operand 3 is flag operand.
       SELECT_CC,
 
-      /// SHLC, SRAC, SRLC - constant shifts.
+      /// SHLC, SRAC, SRLC - constant shifts. Operand 1 is the shift amount,
+      /// which is less than the width of the value.
       SHLC, SRAC, SRLC,
 
+      /// SHLC32, SRAC32, SRLC32 - constant shifts of a 32-bit value given by
+      /// its low and high half, operand 2 is the shift amount.
+      SHLC32, SRAC32, SRLC32,
+
       /// SHL, SRA, SRL - non-constant shifts
-      SHL, SRA, SRL
+      SHL, SRA, SRL,
+
+      /// BST - Copy bit operand 1 of operand 0 to the T flag, which is the
+      /// flag result.
+      BST,
+
+      /// BLD - Copy the T flag of operand 2 to bit operand 1 of operand 0.
+      BLD,
+
+      /// MEMCPY - Copy loop. Operand 0 is the chain operand, operands 1 and
+      /// 2 the destination and the source, and operand 3 the number of
+      /// bytes, 1 to 256.
+      MEMCPY,
+
+      /// MEMSET - Fill loop, as MEMCPY with the byte to store as operand 2.
+      MEMSET
     };
   }
 
+  class AVRSubtarget;
   class AVRTargetMachine;
 
   class AVRTargetLowering : public TargetLowering {
   public:
     explicit AVRTargetLowering(AVRTargetMachine &TM);
 
-    //virtual MVT getShiftAmountTy(EVT LHSTy) const { return MVT::i8; }
+    virtual MVT getShiftAmountTy(EVT LHSTy) const { return MVT::i8; }
+
+    /// getSetCCResultType - Comparisons yield a byte holding 0 or 1.
+    virtual EVT getSetCCResultType(EVT VT) const { return MVT::i8; }
 
     /// LowerOperation - Provide custom lowering hooks for some operations.
     virtual SDValue LowerOperation(SDValue Op, SelectionDAG &DAG) const;
 
+    /// ReplaceNodeResults - Replace the results of node with an illegal
+    /// result type with new values built out of custom code.
+    virtual void ReplaceNodeResults(SDNode *N, SmallVectorImpl<SDValue>&Results,
+                                    SelectionDAG &DAG) const;
+
     /// getTargetNodeName - This method returns the name of a target specific
     /// DAG node.
     virtual const char *getTargetNodeName(unsigned Opcode) const;
 
+    /// PerformDAGCombine - Turn single bit extracts and inserts into BST and
+    /// BLD.
+    virtual SDValue PerformDAGCombine(SDNode *N, DAGCombinerInfo &DCI) const;
+
     SDValue LowerShifts(SDValue Op, SelectionDAG &DAG) const;
 
     SDValue LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) const;
@@ -122,6 +174,24 @@ namespace llvm {
                                                    MachineBasicBlock *BB) const;
     MachineBasicBlock* EmitShiftInstr(MachineInstr *MI,
                                       MachineBasicBlock *BB) const;
+    MachineBasicBlock* EmitShiftImmInstr(MachineInstr *MI,
+                                         MachineBasicBlock *BB) const;
+    MachineBasicBlock* EmitMulInstr(MachineInstr *MI,
+                                    MachineBasicBlock *BB) const;
+    MachineBasicBlock* Emit16BitInstr(MachineInstr *MI,
+                                      MachineBasicBlock *BB) const;
+    MachineBasicBlock* EmitSelectInstr(MachineInstr *MI,
+                                       MachineBasicBlock *BB) const;
+    MachineBasicBlock* EmitMemLoopInstr(MachineInstr *MI,
+                                        MachineBasicBlock *BB) const;
+
+    /// getOptimalMemOpType - Inline copies and fills move words, as there
+    /// is no alignment to keep to.
+    virtual EVT getOptimalMemOpType(uint64_t Size, unsigned DstAlign,
+                                    unsigned SrcAlign, bool IsZeroVal,
+                                    bool MemcpyStrSrc,
+                                    MachineFunction &MF) const;
+    virtual bool allowsUnalignedMemoryAccesses(EVT VT) const { return true; }
 
   private:
     SDValue LowerCCCCallTo(SDValue Chain, SDValue Callee,
@@ -141,6 +211,13 @@ namespace llvm {
                               SelectionDAG &DAG,
                               SmallVectorImpl<SDValue> &InVals) const;
 
+    bool
+      IsEligibleForTailCallOptimization(SDValue Callee,
+                                        CallingConv::ID CalleeCC,
+                                        bool isVarArg,
+                                  const SmallVectorImpl<ISD::OutputArg> &Outs,
+                                        SelectionDAG &DAG) const;
+
     SDValue LowerCallResult(SDValue Chain, SDValue InFlag,
                             CallingConv::ID CallConv, bool isVarArg,
                             const SmallVectorImpl<ISD::InputArg> &Ins,
@@ -162,6 +239,12 @@ namespace llvm {
                 DebugLoc dl, SelectionDAG &DAG,
                 SmallVectorImpl<SDValue> &InVals) const;
 
+    virtual bool
+      CanLowerReturn(CallingConv::ID CallConv, MachineFunction &MF,
+                     bool isVarArg,
+                     const SmallVectorImpl<ISD::OutputArg> &Outs,
+                     LLVMContext &Context) const;
+
     virtual SDValue
       LowerReturn(SDValue Chain,
                   CallingConv::ID CallConv, bool isVarArg,
@@ -169,14 +252,18 @@ namespace llvm {
                   const SmallVectorImpl<SDValue> &OutVals,
                   DebugLoc dl, SelectionDAG &DAG) const;
 
-/*
+    virtual bool getPreIndexedAddressParts(SDNode *N, SDValue &Base,
+                                           SDValue &Offset,
+                                           ISD::MemIndexedMode &AM,
+                                           SelectionDAG &DAG) const;
+
     virtual bool getPostIndexedAddressParts(SDNode *N, SDNode *Op,
                                             SDValue &Base,
                                             SDValue &Offset,
                                             ISD::MemIndexedMode &AM,
                                             SelectionDAG &DAG) const;
-*/
 
+    const AVRSubtarget &Subtarget;
     const AVRTargetMachine &TM;
     const TargetData *TD;
   };
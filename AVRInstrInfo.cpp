@@ -31,6 +31,16 @@ AVRInstrInfo::AVRInstrInfo(AVRTargetMachine &tm)
   : AVRGenInstrInfo(AVR::ADJCALLSTACKDOWN, AVR::ADJCALLSTACKUP),
     RI(tm, *this), TM(tm) {}
 
+/// addSubReg - Add the SubIdx half of the 16-bit register Reg to MIB. After
+/// register allocation it is a register of its own.
+static void addSubReg(MachineInstrBuilder &MIB, unsigned Reg, unsigned SubIdx,
+                      unsigned Flags, const TargetRegisterInfo &TRI) {
+  if (TargetRegisterInfo::isPhysicalRegister(Reg))
+    MIB.addReg(TRI.getSubReg(Reg, SubIdx), Flags & ~RegState::Undef);
+  else
+    MIB.addReg(Reg, Flags, SubIdx);
+}
+
 void AVRInstrInfo::storeRegToStackSlot(MachineBasicBlock &MBB,
                                           MachineBasicBlock::iterator MI,
                                     unsigned SrcReg, bool isKill, int FrameIdx,
@@ -47,11 +57,23 @@ void AVRInstrInfo::storeRegToStackSlot(MachineBasicBlock &MBB,
                             MFI.getObjectSize(FrameIdx),
                             MFI.getObjectAlignment(FrameIdx));
 
-  if (RC == &AVR::GR8RegClass)
-    BuildMI(MBB, MI, DL, get(AVR::MOV8mr))
+  // The narrower classes, IGR8, INDR16 and the like, are spilled as the
+  // class they are in.
+  if (AVR::GR8RegClass.hasSubClassEq(RC))
+    BuildMI(MBB, MI, DL, get(AVR::MOV8mr_INDEX))
       .addFrameIndex(FrameIdx).addImm(0)
       .addReg(SrcReg, getKillRegState(isKill)).addMemOperand(MMO);
-  else
+  else if (AVR::GR16RegClass.hasSubClassEq(RC)) {
+    // A byte at a time. The order does not matter for a stack slot.
+    MachineInstrBuilder MIB = BuildMI(MBB, MI, DL, get(AVR::MOV8mr_INDEX))
+      .addFrameIndex(FrameIdx).addImm(1);
+    addSubReg(MIB, SrcReg, AVR::subreg_hireg, 0, RI);
+    MIB.addMemOperand(MMO);
+    MIB = BuildMI(MBB, MI, DL, get(AVR::MOV8mr_INDEX))
+      .addFrameIndex(FrameIdx).addImm(0);
+    addSubReg(MIB, SrcReg, AVR::subreg_loreg, getKillRegState(isKill), RI);
+    MIB.addMemOperand(MMO);
+  } else
     llvm_unreachable("Cannot store this register to stack slot!");
 }
 
@@ -71,24 +93,47 @@ void AVRInstrInfo::loadRegFromStackSlot(MachineBasicBlock &MBB,
                             MFI.getObjectSize(FrameIdx),
                             MFI.getObjectAlignment(FrameIdx));
 
-  if (RC == &AVR::GR16RegClass)
-    BuildMI(MBB, MI, DL, get(AVR::MOV16rm))
-      .addReg(DestReg).addFrameIndex(FrameIdx).addImm(0).addMemOperand(MMO);
-  else if (RC == &AVR::GR8RegClass)
-    BuildMI(MBB, MI, DL, get(AVR::MOV8rm))
-      .addReg(DestReg).addFrameIndex(FrameIdx).addImm(0).addMemOperand(MMO);
+  if (AVR::GR16RegClass.hasSubClassEq(RC)) {
+    MachineInstrBuilder MIB = BuildMI(MBB, MI, DL, get(AVR::MOV8rm_INDEX));
+    addSubReg(MIB, DestReg, AVR::subreg_loreg,
+              RegState::Define | RegState::Undef, RI);
+    MIB.addFrameIndex(FrameIdx).addImm(0).addMemOperand(MMO);
+    MIB = BuildMI(MBB, MI, DL, get(AVR::MOV8rm_INDEX));
+    addSubReg(MIB, DestReg, AVR::subreg_hireg, RegState::Define, RI);
+    MIB.addFrameIndex(FrameIdx).addImm(1).addMemOperand(MMO);
+  } else if (AVR::GR8RegClass.hasSubClassEq(RC))
+    BuildMI(MBB, MI, DL, get(AVR::MOV8rm_INDEX), DestReg)
+      .addFrameIndex(FrameIdx).addImm(0).addMemOperand(MMO);
   else
-    llvm_unreachable("Cannot store this register to stack slot!");
+    llvm_unreachable("Cannot load this register from stack slot!");
 }
 
 void AVRInstrInfo::copyPhysReg(MachineBasicBlock &MBB,
                                   MachineBasicBlock::iterator I, DebugLoc DL,
                                   unsigned DestReg, unsigned SrcReg,
                                   bool KillSrc) const {
+  if (AVR::GR16RegClass.contains(DestReg, SrcReg)) {
+    if (TM.getSubtarget<AVRSubtarget>().hasMOVW()) {
+      BuildMI(MBB, I, DL, get(AVR::MOV16rr), DestReg)
+        .addReg(SrcReg, getKillRegState(KillSrc));
+      return;
+    }
+
+    // Without MOVW the pair is copied one half at a time.
+    const TargetRegisterInfo &TRI = getRegisterInfo();
+    BuildMI(MBB, I, DL, get(AVR::MOV8rr),
+            TRI.getSubReg(DestReg, AVR::subreg_loreg))
+      .addReg(TRI.getSubReg(SrcReg, AVR::subreg_loreg),
+              getKillRegState(KillSrc));
+    BuildMI(MBB, I, DL, get(AVR::MOV8rr),
+            TRI.getSubReg(DestReg, AVR::subreg_hireg))
+      .addReg(TRI.getSubReg(SrcReg, AVR::subreg_hireg),
+              getKillRegState(KillSrc));
+    return;
+  }
+
   unsigned Opc;
-  if (AVR::GR16RegClass.contains(DestReg, SrcReg))
-    Opc = AVR::MOV16rr;
-  else if (AVR::GR8RegClass.contains(DestReg, SrcReg))
+  if (AVR::GR8RegClass.contains(DestReg, SrcReg))
     Opc = AVR::MOV8rr;
   else if (AVR::IO8RegClass.contains(DestReg))
     Opc = AVR::OUT;
@@ -101,63 +146,82 @@ void AVRInstrInfo::copyPhysReg(MachineBasicBlock &MBB,
     .addReg(SrcReg, getKillRegState(KillSrc));
 }
 
+/// isBitBranch - Return true for the jumps on a bit, whose condition is
+/// their opcode and the operands naming the bit.
+static bool isBitBranch(unsigned Opc) {
+  return Opc == AVR::BRBSAb || Opc == AVR::BRBCAb ||
+         Opc == AVR::BRBSrb || Opc == AVR::BRBCrb;
+}
+
+/// getOppositeBitBranch - Return the jump on the same bit being the other
+/// way round.
+static unsigned getOppositeBitBranch(unsigned Opc) {
+  switch (Opc) {
+  default: llvm_unreachable("Invalid bit branch!");
+  case AVR::BRBSAb: return AVR::BRBCAb;
+  case AVR::BRBCAb: return AVR::BRBSAb;
+  case AVR::BRBSrb: return AVR::BRBCrb;
+  case AVR::BRBCrb: return AVR::BRBSrb;
+  }
+}
+
 unsigned AVRInstrInfo::RemoveBranch(MachineBasicBlock &MBB) const {
-  //MachineBasicBlock::iterator I = MBB.end();
+  MachineBasicBlock::iterator I = MBB.end();
   unsigned Count = 0;
 
-  /*
   while (I != MBB.begin()) {
     --I;
     if (I->isDebugValue())
       continue;
-    if (I->getOpcode() != AVR::JMP &&
+    if (I->getOpcode() != AVR::RJMP &&
+        I->getOpcode() != AVR::JMP &&
         I->getOpcode() != AVR::JCC &&
-        I->getOpcode() != AVR::Br &&
-        I->getOpcode() != AVR::Bm)
+        !isBitBranch(I->getOpcode()))
       break;
     // Remove the branch.
     I->eraseFromParent();
     I = MBB.end();
     ++Count;
   }
-  */
 
   return Count;
 }
 
+/// getOppositeCondition - Return the condition testing the same flag the
+/// other way round. Every BRBS has its BRBC.
+AVRCC::CondCodes AVRInstrInfo::getOppositeCondition(AVRCC::CondCodes CC) {
+  switch (CC) {
+  default: llvm_unreachable("Invalid branch condition!");
+  case AVRCC::COND_E:   return AVRCC::COND_NE;
+  case AVRCC::COND_NE:  return AVRCC::COND_E;
+  case AVRCC::COND_L:   return AVRCC::COND_GE;
+  case AVRCC::COND_GE:  return AVRCC::COND_L;
+  case AVRCC::COND_HS:  return AVRCC::COND_LO;
+  case AVRCC::COND_LO:  return AVRCC::COND_HS;
+  case AVRCC::COND_MI:  return AVRCC::COND_PL;
+  case AVRCC::COND_PL:  return AVRCC::COND_MI;
+  case AVRCC::COND_VS:  return AVRCC::COND_VC;
+  case AVRCC::COND_VC:  return AVRCC::COND_VS;
+  case AVRCC::COND_TS:  return AVRCC::COND_TC;
+  case AVRCC::COND_TC:  return AVRCC::COND_TS;
+  case AVRCC::COND_HCS: return AVRCC::COND_HCC;
+  case AVRCC::COND_HCC: return AVRCC::COND_HCS;
+  case AVRCC::COND_IE:  return AVRCC::COND_ID;
+  case AVRCC::COND_ID:  return AVRCC::COND_IE;
+  }
+}
+
 bool AVRInstrInfo::
 ReverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond) const {
-  /*
+  if (Cond.size() == 3) {
+    Cond[0].setImm(getOppositeBitBranch(Cond[0].getImm()));
+    return false;
+  }
+
   assert(Cond.size() == 1 && "Invalid Xbranch condition!");
 
   AVRCC::CondCodes CC = static_cast<AVRCC::CondCodes>(Cond[0].getImm());
-
-  switch (CC) {
-  default:
-    assert(0 && "Invalid branch condition!");
-    break;
-  case AVRCC::COND_E:
-    CC = AVRCC::COND_NE;
-    break;
-  case AVRCC::COND_NE:
-    CC = AVRCC::COND_E;
-    break;
-  case AVRCC::COND_L:
-    CC = AVRCC::COND_GE;
-    break;
-  case AVRCC::COND_GE:
-    CC = AVRCC::COND_L;
-    break;
-  case AVRCC::COND_HS:
-    CC = AVRCC::COND_LO;
-    break;
-  case AVRCC::COND_LO:
-    CC = AVRCC::COND_HS;
-    break;
-  }
-
-  Cond[0].setImm(CC);
-  */
+  Cond[0].setImm(getOppositeCondition(CC));
   return false;
 }
 
@@ -191,12 +255,12 @@ bool AVRInstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       break;
 
     // A terminator that isn't a branch can't easily be handled
-    // by this analysis.
-    if (!I->isBranch())
+    // by this analysis, nor can an indirect branch.
+    if (!I->isBranch() || I->isIndirectBranch())
       return true;
 
     // Handle unconditional branches.
-    if (I->getOpcode() == AVR::JMP) {
+    if (I->getOpcode() == AVR::RJMP || I->getOpcode() == AVR::JMP) {
       if (!AllowModify) {
         TBB = I->getOperand(0).getMBB();
         continue;
@@ -208,7 +272,7 @@ bool AVRInstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       Cond.clear();
       FBB = 0;
 
-      // Delete the JMP if it's equivalent to a fall-through.
+      // Delete the jump if it's equivalent to a fall-through.
       if (MBB.isLayoutSuccessor(I->getOperand(0).getMBB())) {
         TBB = 0;
         I->eraseFromParent();
@@ -221,6 +285,21 @@ bool AVRInstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       continue;
     }
 
+    // Handle the jumps on a bit, which only ever come alone.
+    if (isBitBranch(I->getOpcode())) {
+      if (!Cond.empty())
+        return true;
+      FBB = TBB;
+      TBB = I->getOperand(0).getMBB();
+      Cond.push_back(MachineOperand::CreateImm(I->getOpcode()));
+      Cond.push_back(I->getOperand(1));
+      Cond.push_back(I->getOperand(2));
+      // The register may be tested again by a branch built from Cond.
+      if (Cond[1].isReg())
+        Cond[1].setIsKill(false);
+      continue;
+    }
+
     // Handle conditional branches.
     assert(I->getOpcode() == AVR::JCC && "Invalid conditional branch");
     AVRCC::CondCodes BranchCode =
@@ -238,7 +317,8 @@ bool AVRInstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
 
     // Handle subsequent conditional branches. Only handle the case where all
     // conditional branches branch to the same destination.
-    assert(Cond.size() == 1);
+    if (Cond.size() != 1)
+      return true;
     assert(TBB);
 
     // Only handle the case where all conditional branches branch to
@@ -264,24 +344,28 @@ AVRInstrInfo::InsertBranch(MachineBasicBlock &MBB, MachineBasicBlock *TBB,
                               DebugLoc DL) const {
   // Shouldn't be a fall through.
   assert(TBB && "InsertBranch must not be told to insert a fallthrough");
-  assert((Cond.size() == 1 || Cond.size() == 0) &&
-         "AVR branch conditions have one component!");
+  assert((Cond.size() == 3 || Cond.size() == 1 || Cond.size() == 0) &&
+         "AVR branch conditions have one or three components!");
 
   if (Cond.empty()) {
     // Unconditional branch?
     assert(!FBB && "Unconditional branch with multiple successors!");
-    BuildMI(&MBB, DL, get(AVR::JMP)).addMBB(TBB);
+    BuildMI(&MBB, DL, get(AVR::RJMP)).addMBB(TBB);
     return 1;
   }
 
   // Conditional branch.
   unsigned Count = 0;
-  BuildMI(&MBB, DL, get(AVR::JCC)).addMBB(TBB).addImm(Cond[0].getImm());
+  if (Cond.size() == 3)
+    BuildMI(&MBB, DL, get(Cond[0].getImm())).addMBB(TBB)
+      .addOperand(Cond[1]).addOperand(Cond[2]);
+  else
+    BuildMI(&MBB, DL, get(AVR::JCC)).addMBB(TBB).addImm(Cond[0].getImm());
   ++Count;
 
   if (FBB) {
     // Two-way Conditional branch. Insert the second branch.
-    BuildMI(&MBB, DL, get(AVR::JMP)).addMBB(FBB);
+    BuildMI(&MBB, DL, get(AVR::RJMP)).addMBB(FBB);
     ++Count;
   }
   return Count;
@@ -312,15 +396,17 @@ unsigned AVRInstrInfo::GetInstSizeInBytes(const MachineInstr *MI) const {
     }
     }
   case AVRII::SizeSpecial:
-    /*
     switch (MI->getOpcode()) {
     default:
-      assert(0 && "Unknown instruction size!");
-    case AVR::SAR8r1c:
-    case AVR::SAR16r1c:
-    */
       return 4;
-    //}
+    // The variable 8-bit shifts expanded by the asm printer: MOV, a shift by
+    // 4 and then by 2 and 1, each instruction after a SBRC.
+    case AVR::Shl8:
+    case AVR::Srl8:
+      return 2 * (1 + 4 + 4 + 2);
+    case AVR::Sra8:
+      return 2 * (1 + 8 + 4 + 2);
+    }
   case AVRII::Size2Bytes:
     return 2;
   case AVRII::Size4Bytes:
@@ -15,7 +15,9 @@
 #define LLVM_TARGET_AVRINSTRINFO_H
 
 #include "llvm/Target/TargetInstrInfo.h"
+#include "AVR.h"
 #include "AVRRegisterInfo.h"
+#include "MCTargetDesc/AVRBaseInfo.h"
 
 #define GET_INSTRINFO_HEADER
 #include "AVRGenInstrInfo.inc"
@@ -24,22 +26,6 @@ namespace llvm {
 
 class AVRTargetMachine;
 
-/// AVRII - This namespace holds all of the target specific flags that
-/// instruction info tracks.
-///
-namespace AVRII {
-  enum {
-    SizeShift   = 2,
-    SizeMask    = 7 << SizeShift,
-
-    SizeUnknown = 0 << SizeShift,
-    SizeSpecial = 1 << SizeShift,
-    Size2Bytes  = 2 << SizeShift,
-    Size4Bytes  = 3 << SizeShift,
-    Size6Bytes  = 4 << SizeShift
-  };
-}
-
 class AVRInstrInfo : public AVRGenInstrInfo {
   const AVRRegisterInfo RI;
   AVRTargetMachine &TM;
@@ -71,6 +57,9 @@ public:
 
   unsigned GetInstSizeInBytes(const MachineInstr *MI) const;
 
+  /// getOppositeCondition - Return the inverse of the condition code CC.
+  static AVRCC::CondCodes getOppositeCondition(AVRCC::CondCodes CC);
+
   // Branch folding goodness
   bool ReverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond) const;
   bool isUnpredicatedTerminator(const MachineInstr *MI) const;
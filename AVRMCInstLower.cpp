@@ -13,6 +13,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "AVRMCInstLower.h"
+#include "AVRInstrInfo.h"
+#include "MCTargetDesc/AVRMCExpr.h"
+#include "llvm/Function.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineInstr.h"
@@ -30,7 +33,9 @@ MCSymbol *AVRMCInstLower::
 GetGlobalAddressSymbol(const MachineOperand &MO) const {
   switch (MO.getTargetFlags()) {
   default: llvm_unreachable("Unknown target flag on GV operand");
-  case 0: break;
+  case AVRII::MO_NO_FLAG:
+  case AVRII::MO_LO8:
+  case AVRII::MO_HI8: break;
   }
 
   return Printer.Mang->getSymbol(MO.getGlobal());
@@ -40,7 +45,9 @@ MCSymbol *AVRMCInstLower::
 GetExternalSymbolSymbol(const MachineOperand &MO) const {
   switch (MO.getTargetFlags()) {
   default: assert(0 && "Unknown target flag on GV operand");
-  case 0: break;
+  case AVRII::MO_NO_FLAG:
+  case AVRII::MO_LO8:
+  case AVRII::MO_HI8: break;
   }
 
   return Printer.GetExternalSymbolSymbol(MO.getSymbolName());
@@ -82,7 +89,9 @@ MCSymbol *AVRMCInstLower::
 GetBlockAddressSymbol(const MachineOperand &MO) const {
   switch (MO.getTargetFlags()) {
   default: assert(0 && "Unknown target flag on GV operand");
-  case 0: break;
+  case AVRII::MO_NO_FLAG:
+  case AVRII::MO_LO8:
+  case AVRII::MO_HI8: break;
   }
 
   return Printer.GetBlockAddressSymbol(MO.getBlockAddress());
@@ -94,15 +103,28 @@ LowerSymbolOperand(const MachineOperand &MO, MCSymbol *Sym) const {
   // lot of extra uniquing.
   const MCExpr *Expr = MCSymbolRefExpr::Create(Sym, Ctx);
 
-  switch (MO.getTargetFlags()) {
-  default: llvm_unreachable("Unknown target flag on GV operand");
-  case 0: break;
-  }
-
   if (!MO.isJTI() && MO.getOffset())
     Expr = MCBinaryExpr::CreateAdd(Expr,
                                    MCConstantExpr::Create(MO.getOffset(), Ctx),
                                    Ctx);
+
+  // Code is addressed in words, so a pointer to a function holds the word
+  // address, which the linker computes for pm_lo8 and pm_hi8.
+  bool isCode = MO.isGlobal() && isa<Function>(MO.getGlobal());
+
+  switch (MO.getTargetFlags()) {
+  default: llvm_unreachable("Unknown target flag on GV operand");
+  case AVRII::MO_NO_FLAG: break;
+  case AVRII::MO_LO8:
+    Expr = isCode ? AVRMCExpr::CreatePMLo8(Expr, Ctx)
+                  : AVRMCExpr::CreateLo8(Expr, Ctx);
+    break;
+  case AVRII::MO_HI8:
+    Expr = isCode ? AVRMCExpr::CreatePMHi8(Expr, Ctx)
+                  : AVRMCExpr::CreateHi8(Expr, Ctx);
+    break;
+  }
+
   return MCOperand::CreateExpr(Expr);
 }
 
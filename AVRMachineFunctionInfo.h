@@ -30,17 +30,42 @@ class AVRMachineFunctionInfo : public MachineFunctionInfo {
   /// ReturnAddrIndex - FrameIndex for return slot.
   int ReturnAddrIndex;
 
+  /// SavesSREG, SavesR0, SavesR1, SavesRAMPZ - Whether an interrupt service
+  /// routine saves the flags, R0, R1 and RAMPZ ahead of the callee-saved
+  /// registers. The flags and RAMPZ are saved through R0, and R1 is
+  /// cleared, which sets the flags.
+  bool SavesSREG, SavesR0, SavesR1, SavesRAMPZ;
+
 public:
-  AVRMachineFunctionInfo() : CalleeSavedFrameSize(0) {}
+  AVRMachineFunctionInfo()
+    : CalleeSavedFrameSize(0), SavesSREG(false), SavesR0(false),
+      SavesR1(false), SavesRAMPZ(false) {}
 
   explicit AVRMachineFunctionInfo(MachineFunction &MF)
-    : CalleeSavedFrameSize(0), ReturnAddrIndex(0) {}
+    : CalleeSavedFrameSize(0), ReturnAddrIndex(0), SavesSREG(false),
+      SavesR0(false), SavesR1(false), SavesRAMPZ(false) {}
 
   unsigned getCalleeSavedFrameSize() const { return CalleeSavedFrameSize; }
   void setCalleeSavedFrameSize(unsigned bytes) { CalleeSavedFrameSize = bytes; }
 
   int getRAIndex() const { return ReturnAddrIndex; }
   void setRAIndex(int Index) { ReturnAddrIndex = Index; }
+
+  bool savesSREG() const { return SavesSREG; }
+  bool savesR0() const { return SavesR0; }
+  bool savesR1() const { return SavesR1; }
+  bool savesRAMPZ() const { return SavesRAMPZ; }
+  void setInterruptSaves(bool SREG, bool R0, bool R1, bool RAMPZ) {
+    SavesR1 = R1;
+    SavesRAMPZ = RAMPZ;
+    SavesSREG = SREG || R1;
+    SavesR0 = R0 || SavesSREG || RAMPZ;
+  }
+
+  /// getInterruptSaveSize - Bytes pushed ahead of the callee-saved registers.
+  unsigned getInterruptSaveSize() const {
+    return SavesSREG + SavesR0 + SavesR1 + SavesRAMPZ;
+  }
 };
 
 } // End llvm namespace
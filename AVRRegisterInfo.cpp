@@ -21,9 +21,11 @@
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/ErrorHandling.h"
 
 #define GET_REGINFO_TARGET_DESC
@@ -39,41 +41,80 @@ AVRRegisterInfo::AVRRegisterInfo(AVRTargetMachine &tm,
 
 const unsigned*
 AVRRegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
-  const TargetFrameLowering *TFI = MF->getTarget().getFrameLowering();
-  //const Function* F = MF->getFunction();
+  const TargetFrameLowering *TFI = TM.getFrameLowering();
   static const unsigned CalleeSavedRegs[] = {
     AVR::R2, AVR::R3, AVR::R4, AVR::R5, AVR::R6,
     AVR::R7, AVR::R8, AVR::R9, AVR::R10, AVR::R11,
     AVR::R12, AVR::R13, AVR::R14, AVR::R15, AVR::R16, AVR::R17, 
     0
   };
-  static const unsigned CalleeSavedRegsFP[] = {
+  static const unsigned CalleeSavedRegsNoFP[] = {
     AVR::R28, AVR::R29, AVR::R2, AVR::R3, AVR::R4, AVR::R5, AVR::R6,
     AVR::R7, AVR::R8, AVR::R9, AVR::R10, AVR::R11,
     AVR::R12, AVR::R13, AVR::R14, AVR::R15, AVR::R16, AVR::R17,
     0
   };
-  /*
+  // Interrupt service routines save whatever they use but R0 and R1, which
+  // the prologue saves ahead of these.
   static const unsigned CalleeSavedRegsIntr[] = {
+    AVR::R2, AVR::R3, AVR::R4, AVR::R5, AVR::R6,
+    AVR::R7, AVR::R8, AVR::R9, AVR::R10, AVR::R11,
+    AVR::R12, AVR::R13, AVR::R14, AVR::R15, AVR::R16, AVR::R17,
+    AVR::R18, AVR::R19, AVR::R20, AVR::R21, AVR::R22, AVR::R23,
+    AVR::R24, AVR::R25, AVR::R26, AVR::R27, AVR::R30, AVR::R31,
     0
   };
-  static const unsigned CalleeSavedRegsIntrFP[] = {
+  static const unsigned CalleeSavedRegsIntrNoFP[] = {
+    AVR::R28, AVR::R29, AVR::R2, AVR::R3, AVR::R4, AVR::R5, AVR::R6,
+    AVR::R7, AVR::R8, AVR::R9, AVR::R10, AVR::R11,
+    AVR::R12, AVR::R13, AVR::R14, AVR::R15, AVR::R16, AVR::R17,
+    AVR::R18, AVR::R19, AVR::R20, AVR::R21, AVR::R22, AVR::R23,
+    AVR::R24, AVR::R25, AVR::R26, AVR::R27, AVR::R30, AVR::R31,
+    0
+  };
+  // Naked functions save nothing.
+  static const unsigned NoCalleeSavedRegs[] = {
     0
   };
-  */
 
-  // TODO : Change this when adding INTR calling conv
-  // Conservatively return regs with FP, as functions without FP also use R29:R28
-  // instead of the stack to do indexed loads and stores for stack slots.
-  return (CalleeSavedRegsFP);
+  if (!MF)
+    return CalleeSavedRegsIntrNoFP;
+
+  const Function *F = MF->getFunction();
+  if (F->hasFnAttr(Attribute::Naked))
+    return NoCalleeSavedRegs;
+
+  // Y is callee-saved as well. With a frame pointer it is reserved and
+  // saved by the prologue, otherwise it is allocated like the others.
+  bool hasFP = TFI->hasFP(*MF);
+  if (AVRCallingConv::isInterrupt(F->getCallingConv()))
+    return hasFP ? CalleeSavedRegsIntr : CalleeSavedRegsIntrNoFP;
+  return hasFP ? CalleeSavedRegs : CalleeSavedRegsNoFP;
 }
 
 BitVector AVRRegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   BitVector Reserved(getNumRegs());
   const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
 
-  if (TFI->hasFP(MF))
+  // The I/O registers are never handed out.
+  Reserved.set(AVR::SPH);
+  Reserved.set(AVR::SPL);
+  Reserved.set(AVR::RAMPZ);
+
+  // R0 is the scratch register of the frame code and of the instructions
+  // that leave their result there, and R1 holds zero for code compiled by
+  // avr-gcc.
+  Reserved.set(AVR::R0);
+  Reserved.set(AVR::R1);
+  Reserved.set(AVR::R1W);
+
+  // Y is only taken when it is the frame pointer. Its halves are reserved
+  // too, or they would still be handed out as 8-bit registers.
+  if (TFI->hasFP(MF)) {
     Reserved.set(AVR::Y);
+    Reserved.set(AVR::R28);
+    Reserved.set(AVR::R29);
+  }
 
   return Reserved;
 }
@@ -83,59 +124,94 @@ AVRRegisterInfo::getPointerRegClass(unsigned Kind) const {
   return &AVR::GR16RegClass;
 }
 
+/// isLiveAfter - Find out if the physical register Reg is live after MI, by
+/// looking for a read of it before it is written further down the block, or
+/// else for it being live into a successor.
+bool AVRRegisterInfo::isLiveAfter(MachineBasicBlock::iterator MI,
+                                  unsigned Reg) const {
+  MachineBasicBlock &MBB = *MI->getParent();
+  for (MachineBasicBlock::iterator I = llvm::next(MI), E = MBB.end();
+       I != E; ++I) {
+    bool isDefined = false;
+    for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i) {
+      const MachineOperand &MO = I->getOperand(i);
+      if (!MO.isReg() || !MO.getReg() || !regsOverlap(MO.getReg(), Reg))
+        continue;
+      if (MO.isUse() && !MO.isUndef())
+        return true;
+      if (MO.isDef())
+        isDefined = true;
+    }
+    if (isDefined)
+      return false;
+  }
+
+  for (MachineBasicBlock::succ_iterator SI = MBB.succ_begin(),
+       SE = MBB.succ_end(); SI != SE; ++SI)
+    for (MachineBasicBlock::livein_iterator LI = (*SI)->livein_begin(),
+         LE = (*SI)->livein_end(); LI != LE; ++LI)
+      if (regsOverlap(*LI, Reg))
+        return true;
+
+  // A returning block passes the return value on to the caller.
+  if (MBB.succ_empty()) {
+    const MachineRegisterInfo &MRI = MBB.getParent()->getRegInfo();
+    for (MachineRegisterInfo::liveout_iterator LI = MRI.liveout_begin(),
+         LE = MRI.liveout_end(); LI != LE; ++LI)
+      if (regsOverlap(*LI, Reg))
+        return true;
+  }
+
+  return false;
+}
+
+/// isFreeAt - Find out if the pair Reg may be written at MI: MI does not
+/// touch it and it is not live after MI. An interrupt service routine only
+/// saves the registers it was given, so there the pair must be one of them.
+static bool isFreeAt(MachineBasicBlock::iterator MI, unsigned Reg,
+                     const AVRRegisterInfo &TRI) {
+  MachineFunction &MF = *MI->getParent()->getParent();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  unsigned Lo = TRI.getSubReg(Reg, AVR::subreg_loreg);
+  unsigned Hi = TRI.getSubReg(Reg, AVR::subreg_hireg);
+
+  if (AVRCallingConv::isInterrupt(MF.getFunction()->getCallingConv()) &&
+      (!MRI.isPhysRegUsed(Lo) || !MRI.isPhysRegUsed(Hi)))
+    return false;
+
+  for (unsigned i = 0, e = MI->getNumOperands(); i != e; ++i) {
+    const MachineOperand &MO = MI->getOperand(i);
+    if (MO.isReg() && MO.getReg() && TRI.regsOverlap(MO.getReg(), Reg))
+      return false;
+  }
+
+  return !TRI.isLiveAfter(MI, Lo) && !TRI.isLiveAfter(MI, Hi);
+}
+
 void AVRRegisterInfo::
 eliminateCallFramePseudoInstr(MachineFunction &MF, MachineBasicBlock &MBB,
                               MachineBasicBlock::iterator I) const {
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  const AVRFrameLowering *TFI =
+    static_cast<const AVRFrameLowering*>(MF.getTarget().getFrameLowering());
+  MachineInstr *Old = I;
+  DebugLoc DL = Old->getDebugLoc();
 
+  // The call frame pseudos clobber Z, so it is free to move SP with.
   if (!TFI->hasReservedCallFrame(MF)) {
-    MachineInstr *Old = I;
-    uint64_t Amount = Old->getOperand(0).getImm();
-    if (Amount != 0) {
-      // We need to keep the stack aligned properly.  To do this, we round the
-      // amount of space needed for the outgoing arguments up to the next
-      // alignment boundary.
-      Amount = (Amount+StackAlign-1)/StackAlign*StackAlign;
-
-      MachineInstr *New = 0;
-      if (Old->getOpcode() == TII.getCallFrameSetupOpcode()) {
-          for (int i = 0; i<Amount; ++i) {
-            New = BuildMI(MF, Old->getDebugLoc(),
-                        TII.get(AVR::PUSH), AVR::R0);
-            MBB.insert(I, New);
-          }
-      } else {
-        assert(Old->getOpcode() == TII.getCallFrameDestroyOpcode());
-        // factor out the amount the callee already popped.
-        uint64_t CalleeAmt = Old->getOperand(1).getImm();
-        Amount -= CalleeAmt;
-        if (Amount)
-          for (int i = 0; i<Amount; ++i) {
-            New = BuildMI(MF, Old->getDebugLoc(),
-                        TII.get(AVR::POP), AVR::R0);
-            MBB.insert(I, New);
-          }
-      }
-
-      if (New) {
-        // The SRW implicit def is dead.
-        //New->getOperand(3).setIsDead();
-      }
+    int Amount = Old->getOperand(0).getImm();
+    if (Old->getOpcode() == TII.getCallFrameSetupOpcode())
+      TFI->adjustStackPointer(MBB, I, DL, -Amount, AVR::Z);
+    else {
+      assert(Old->getOpcode() == TII.getCallFrameDestroyOpcode());
+      // factor out the amount the callee already popped.
+      Amount -= Old->getOperand(1).getImm();
+      TFI->adjustStackPointer(MBB, I, DL, Amount, AVR::Z);
     }
   } else if (I->getOpcode() == TII.getCallFrameDestroyOpcode()) {
     // If we are performing frame pointer elimination and if the callee pops
     // something off the stack pointer, add it back.
-    if (uint64_t CalleeAmt = I->getOperand(1).getImm()) {
-      MachineInstr *Old = I;
-      MachineInstr *New = 0;
-      for (int i = 0; i<CalleeAmt; ++i) {
-        New = BuildMI(MF, Old->getDebugLoc(),
-		      TII.get(AVR::PUSH), AVR::R0);
-	      MBB.insert(I, New);
-      }
-      // The SRW implicit def is dead.
-      //New->getOperand(3).setIsDead();
-    }
+    if (int CalleeAmt = Old->getOperand(1).getImm())
+      TFI->adjustStackPointer(MBB, I, DL, -CalleeAmt, AVR::Z);
   }
 
   MBB.erase(I);
@@ -150,7 +226,8 @@ AVRRegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
   MachineInstr &MI = *II;
   MachineBasicBlock &MBB = *MI.getParent();
   MachineFunction &MF = *MBB.getParent();
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  const AVRFrameLowering *TFI =
+    static_cast<const AVRFrameLowering*>(MF.getTarget().getFrameLowering());
   DebugLoc dl = MI.getDebugLoc();
   while (!MI.getOperand(i).isFI()) {
     ++i;
@@ -158,8 +235,6 @@ AVRRegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
   }
 
   int FrameIndex = MI.getOperand(i).getIndex();
-
-  unsigned BasePtr = AVR::Y;
   int Offset = MF.getFrameInfo()->getObjectOffset(FrameIndex);
 
   // Fold imm into offset
@@ -168,29 +243,153 @@ AVRRegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
   // The offset from getObjectOffset is negative (stack grows down), 
   // calculated relative to the SP at the entry of the function 
   // (and includes FP).
-  // Add 2 bytes to skip past the saved Y, if any (even if not using FP, a constant 2 is given
-  // in TargetFrameLowering's constructor as the LocalAreaOffset). Add stack size to make it
-  // relative to top of the allocated space. Add 1, as the top address is unallocated and allocated space
-  // starts 1 below.
+  // Add 2 bytes to skip past the return address (a constant 2 is given in
+  // TargetFrameLowering's constructor as the LocalAreaOffset). Add stack
+  // size to make it relative to top of the allocated space. Add 1, as the
+  // top address is unallocated and allocated space starts 1 below.
   // Stack frame layout is
-  // Y -->
-  //            Local variables
-  //            ...
-  // SP@Start->Saved Y
   //            Return Address
+  // SP@Start-> Saved R1, R0, SREG and RAMPZ, if an ISR
+  //            Saved Y, if FP
+  //            Callee-saved registers
+  //            Local variables and spill slots
+  //            ...
+  // Y, SP -->
 
-    Offset += 2; 
-    Offset += MF.getFrameInfo()->getStackSize() + 1;
+  Offset += 2; 
+  Offset += MF.getFrameInfo()->getStackSize() + 1;
 
-  if (MI.getOpcode() == AVR::MOV8mr) 
-      MI.setDesc(TII.get(AVR::MOV8mr_INDEX));
-  else if (MI.getOpcode() == AVR::MOV8rm) 
-      MI.setDesc(TII.get(AVR::MOV8rm_INDEX));
+  // Interrupt service routines push R1, R0, the flags and RAMPZ on top of
+  // it all.
+  Offset += MF.getInfo<AVRMachineFunctionInfo>()->getInterruptSaveSize();
+
+  if (TFI->hasFP(MF)) {
+    // LDD and STD reach 63 bytes off Y. Further objects are reached off Z
+    // set to Y plus the excess, if Z is free, which is a MOVW and an add.
+    // Otherwise Y is moved there and back around the access. The adds
+    // clobber the flags, which are kept in R0 if they are live, as between
+    // a compare and its branch.
+    unsigned BasePtr = AVR::Y;
+    if (Offset > 63) {
+      int Adjust = Offset & ~63;
+      Offset -= Adjust;
+      bool SaveSREG = isLiveAfter(II, AVR::SREG);
+      if (SaveSREG)
+        BuildMI(MBB, II, dl, TII.get(AVR::INSREG), AVR::R0);
+      MachineBasicBlock::iterator RestorePt = II;
+      if (isFreeAt(II, AVR::Z, *this)) {
+        BasePtr = AVR::Z;
+        TII.copyPhysReg(MBB, II, dl, AVR::Z, AVR::Y, false);
+        TFI->addToPair(MBB, II, dl, AVR::Z, Adjust);
+      } else {
+        RestorePt = llvm::next(II);
+        TFI->addToPair(MBB, II, dl, AVR::Y, Adjust);
+        TFI->addToPair(MBB, RestorePt, dl, AVR::Y, -Adjust);
+      }
+      if (SaveSREG)
+        BuildMI(MBB, RestorePt, dl, TII.get(AVR::OUTSREG))
+          .addReg(AVR::R0, RegState::Kill);
+    }
+
+    MI.getOperand(i).ChangeToRegister(BasePtr, false);
+    MI.getOperand(i+1).ChangeToImmediate(Offset);
+    return;
+  }
+
+  // Without a frame pointer only spill slots are left. They are reached off
+  // a pointer loaded from SP, Z unless the spilled register is in Z. The
+  // pointer is saved around the access if it is live across it.
+  assert((MI.getOpcode() == AVR::MOV8rm_INDEX ||
+          MI.getOpcode() == AVR::MOV8mr_INDEX) &&
+         "Only spill slots are expected without a frame pointer!");
+  unsigned Data = MI.getOperand(i == 0 ? 2 : 0).getReg();
+  unsigned BasePtr = regsOverlap(Data, AVR::Z) ? AVR::Y : AVR::Z;
+  unsigned Lo = getSubReg(BasePtr, AVR::subreg_loreg);
+  unsigned Hi = getSubReg(BasePtr, AVR::subreg_hireg);
+  MachineBasicBlock::iterator Next = llvm::next(II);
+
+  if (isLiveAfter(II, Lo) || isLiveAfter(II, Hi)) {
+    BuildMI(MBB, II, dl, TII.get(AVR::PUSH)).addReg(Lo);
+    BuildMI(MBB, II, dl, TII.get(AVR::PUSH)).addReg(Hi);
+    BuildMI(MBB, Next, dl, TII.get(AVR::POP), Hi);
+    BuildMI(MBB, Next, dl, TII.get(AVR::POP), Lo);
+    Offset += 2;
+  }
+
+  // The flags are kept in R0 around an add, as above.
+  TFI->readSP(MBB, II, dl, BasePtr);
+  if (Offset > 63) {
+    bool SaveSREG = isLiveAfter(II, AVR::SREG);
+    if (SaveSREG)
+      BuildMI(MBB, II, dl, TII.get(AVR::INSREG), AVR::R0);
+    TFI->addToPair(MBB, II, dl, BasePtr, Offset & ~63);
+    if (SaveSREG)
+      BuildMI(MBB, II, dl, TII.get(AVR::OUTSREG))
+        .addReg(AVR::R0, RegState::Kill);
+    Offset &= 63;
+  }
 
   MI.getOperand(i).ChangeToRegister(BasePtr, false);
   MI.getOperand(i+1).ChangeToImmediate(Offset);
 }
 
+/// processFunctionBeforeCalleeSavedScan - Work out what an interrupt
+/// service routine has to save besides the registers it allocated: the
+/// flags, R0, R1 and RAMPZ if the body or its frame code touches them, and
+/// Z or Y when spill slots are reached through them.
+void
+AVRRegisterInfo::processFunctionBeforeCalleeSavedScan(MachineFunction &MF,
+                                                      RegScavenger *RS) const {
+  if (!AVRCallingConv::isInterrupt(MF.getFunction()->getCallingConv()))
+    return;
+
+  const MachineFrameInfo *MFI = MF.getFrameInfo();
+  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  AVRMachineFunctionInfo *AVRFI = MF.getInfo<AVRMachineFunctionInfo>();
+
+  // Anything called may use all of them, and moving SP for a frame clobbers
+  // the flags and R0.
+  bool UsesSREG = MFI->hasCalls() || MFI->hasStackObjects();
+  bool UsesR0 = UsesSREG;
+  bool UsesR1 = MFI->hasCalls();
+  bool UsesRAMPZ = MFI->hasCalls();
+  bool SpillsZ = false;
+
+  for (MachineFunction::iterator BB = MF.begin(), E = MF.end(); BB != E; ++BB)
+    for (MachineBasicBlock::iterator I = BB->begin(), IE = BB->end();
+         I != IE; ++I) {
+      // A spill slot access of a register in Z is made through Y instead.
+      if (I->getOpcode() == AVR::MOV8rm_INDEX)
+        SpillsZ |= regsOverlap(I->getOperand(0).getReg(), AVR::Z);
+      else if (I->getOpcode() == AVR::MOV8mr_INDEX)
+        SpillsZ |= regsOverlap(I->getOperand(2).getReg(), AVR::Z);
+
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i) {
+        const MachineOperand &MO = I->getOperand(i);
+        if (!MO.isReg() || !MO.getReg())
+          continue;
+        UsesSREG |= MO.getReg() == AVR::SREG;
+        UsesR0 |= regsOverlap(MO.getReg(), AVR::R0);
+        UsesR1 |= regsOverlap(MO.getReg(), AVR::R1);
+        UsesRAMPZ |= MO.getReg() == AVR::RAMPZ;
+      }
+    }
+
+  AVRFI->setInterruptSaves(UsesSREG, UsesR0, UsesR1, UsesRAMPZ);
+
+  // eliminateFrameIndex only saves the base pointer around an access when
+  // the routine itself still needs it, the interrupted code is left to the
+  // prologue and the epilogue.
+  if (MFI->hasStackObjects() && !TFI->hasFP(MF)) {
+    MF.getRegInfo().setPhysRegUsed(AVR::R30);
+    MF.getRegInfo().setPhysRegUsed(AVR::R31);
+    if (SpillsZ) {
+      MF.getRegInfo().setPhysRegUsed(AVR::R28);
+      MF.getRegInfo().setPhysRegUsed(AVR::R29);
+    }
+  }
+}
+
 void
 AVRRegisterInfo::processFunctionBeforeFrameFinalized(MachineFunction &MF)
                                                                          const {
@@ -206,10 +405,7 @@ AVRRegisterInfo::processFunctionBeforeFrameFinalized(MachineFunction &MF)
 }
 
 unsigned AVRRegisterInfo::getFrameRegister(const MachineFunction &MF) const {
-  /*
+  // SP has no register of its own, it is named by its low half.
   const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
-  return TFI->hasFP(MF) ? AVR::Y : AVR::SPW;
-  */
-
-  return AVR::Y;
+  return TFI->hasFP(MF) ? AVR::Y : AVR::SPL;
 }
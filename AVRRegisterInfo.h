@@ -28,10 +28,6 @@ struct AVRRegisterInfo : public AVRGenRegisterInfo {
 private:
   AVRTargetMachine &TM;
   const TargetInstrInfo &TII;
-
-  /// StackAlign - Default stack alignment.
-  ///
-  unsigned StackAlign;
 public:
   AVRRegisterInfo(AVRTargetMachine &tm, const TargetInstrInfo &tii);
   
@@ -48,10 +44,16 @@ public:
   void eliminateFrameIndex(MachineBasicBlock::iterator II,
                            int SPAdj, RegScavenger *RS = NULL) const;
 
+  void processFunctionBeforeCalleeSavedScan(MachineFunction &MF,
+                                            RegScavenger *RS = NULL) const;
   void processFunctionBeforeFrameFinalized(MachineFunction &MF) const;
 
   // Debug information queries.
   unsigned getFrameRegister(const MachineFunction &MF) const;
+
+  /// isLiveAfter - Find out if the physical register Reg is read after MI
+  /// before it is written.
+  bool isLiveAfter(MachineBasicBlock::iterator MI, unsigned Reg) const;
 };
 
 } // end namespace llvm
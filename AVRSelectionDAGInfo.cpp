@@ -0,0 +1,98 @@
+//===-- AVRSelectionDAGInfo.cpp - AVR SelectionDAG Info -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the AVRSelectionDAGInfo class.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "avr-selectiondag-info"
+#include "AVRTargetMachine.h"
+#include "llvm/Function.h"
+#include "llvm/CodeGen/SelectionDAG.h"
+using namespace llvm;
+
+// Copies and fills too big to unroll, see AVRTargetLowering, are done by a
+// loop of LD and ST with post-increment: 4 words, and 7 cycles a byte. The
+// memcpy and memset of avr-libc take as long a byte, so the loops only lose
+// to the libcall in size, once there is a counter to set up for each 256
+// bytes. Below that they save the call and the registers it clobbers.
+static const unsigned MaxLoopBytes = 1024;
+static const unsigned MaxLoopBytesOptSize = 256;
+
+AVRSelectionDAGInfo::AVRSelectionDAGInfo(const AVRTargetMachine &TM)
+  : TargetSelectionDAGInfo(TM) {
+}
+
+AVRSelectionDAGInfo::~AVRSelectionDAGInfo() {
+}
+
+/// getLoopBytes - The size of a copy or fill if it should be done by
+/// loops, or 0 if by the libcall.
+static uint64_t getLoopBytes(SelectionDAG &DAG, SDValue Size,
+                             bool AlwaysInline) {
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize)
+    return 0;
+
+  uint64_t Bytes = ConstantSize->getZExtValue();
+  bool OptSize = DAG.getMachineFunction().getFunction()->
+    hasFnAttr(Attribute::OptimizeForSize);
+  if (!AlwaysInline && Bytes > (OptSize ? MaxLoopBytesOptSize : MaxLoopBytes))
+    return 0;
+  return Bytes;
+}
+
+/// emitLoops - One loop for each 256 bytes, as the counter is a byte.
+static SDValue emitLoops(SelectionDAG &DAG, DebugLoc dl, unsigned Opcode,
+                         SDValue Chain, SDValue Dst, SDValue Src,
+                         uint64_t Bytes) {
+  EVT PtrVT = Dst.getValueType();
+  SmallVector<SDValue, 4> Chains;
+  for (uint64_t Offset = 0; Offset < Bytes; Offset += 256) {
+    SDValue Off = DAG.getConstant(Offset, PtrVT);
+    SDValue Value = Src;
+    if (Opcode == AVRISD::MEMCPY)
+      Value = DAG.getNode(ISD::ADD, dl, PtrVT, Src, Off);
+    Chains.push_back(DAG.getNode(Opcode, dl, MVT::Other, Chain,
+                                 DAG.getNode(ISD::ADD, dl, PtrVT, Dst, Off),
+                                 Value,
+                                 DAG.getConstant(std::min(Bytes - Offset,
+                                                          uint64_t(256)),
+                                                 MVT::i16)));
+  }
+  return DAG.getNode(ISD::TokenFactor, dl, MVT::Other,
+                     &Chains[0], Chains.size());
+}
+
+SDValue
+AVRSelectionDAGInfo::EmitTargetCodeForMemcpy(SelectionDAG &DAG, DebugLoc dl,
+                                             SDValue Chain, SDValue Dst,
+                                             SDValue Src, SDValue Size,
+                                             unsigned Align, bool isVolatile,
+                                             bool AlwaysInline,
+                                         MachinePointerInfo DstPtrInfo,
+                                         MachinePointerInfo SrcPtrInfo) const {
+  uint64_t Bytes = getLoopBytes(DAG, Size, AlwaysInline);
+  if (!Bytes)
+    return SDValue();
+  return emitLoops(DAG, dl, AVRISD::MEMCPY, Chain, Dst, Src, Bytes);
+}
+
+SDValue
+AVRSelectionDAGInfo::EmitTargetCodeForMemset(SelectionDAG &DAG, DebugLoc dl,
+                                             SDValue Chain, SDValue Dst,
+                                             SDValue Src, SDValue Size,
+                                             unsigned Align, bool isVolatile,
+                                         MachinePointerInfo DstPtrInfo) const {
+  uint64_t Bytes = getLoopBytes(DAG, Size, false);
+  if (!Bytes)
+    return SDValue();
+  Src = DAG.getZExtOrTrunc(Src, dl, MVT::i8);
+  return emitLoops(DAG, dl, AVRISD::MEMSET, Chain, Dst, Src, Bytes);
+}
@@ -0,0 +1,47 @@
+//===-- AVRSelectionDAGInfo.h - AVR SelectionDAG Info -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the AVR subclass for TargetSelectionDAGInfo.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AVRSELECTIONDAGINFO_H
+#define AVRSELECTIONDAGINFO_H
+
+#include "llvm/Target/TargetSelectionDAGInfo.h"
+
+namespace llvm {
+
+class AVRTargetMachine;
+
+class AVRSelectionDAGInfo : public TargetSelectionDAGInfo {
+public:
+  explicit AVRSelectionDAGInfo(const AVRTargetMachine &TM);
+  ~AVRSelectionDAGInfo();
+
+  virtual SDValue
+  EmitTargetCodeForMemcpy(SelectionDAG &DAG, DebugLoc dl,
+                          SDValue Chain,
+                          SDValue Dst, SDValue Src,
+                          SDValue Size, unsigned Align, bool isVolatile,
+                          bool AlwaysInline,
+                          MachinePointerInfo DstPtrInfo,
+                          MachinePointerInfo SrcPtrInfo) const;
+
+  virtual SDValue
+  EmitTargetCodeForMemset(SelectionDAG &DAG, DebugLoc dl,
+                          SDValue Chain,
+                          SDValue Dst, SDValue Src,
+                          SDValue Size, unsigned Align, bool isVolatile,
+                          MachinePointerInfo DstPtrInfo) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+//===-- AVRSpillToReg.cpp - Keep spilled bytes in free registers ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that runs after register allocation and moves
+// spill slots into call clobbered registers that are free over their whole
+// use. A spill slot costs an STD and an LDD of two cycles each, and a frame
+// with all it takes to set up and free if there is nothing else in it,
+// where a register takes a MOV of one cycle each way. Only slots whose
+// stores and reloads are in one basic block are taken, a byte at a time,
+// and the register must not be touched between the first and the last of
+// them, which rules out calls. Interrupt service routines are left alone,
+// as they would have to save the register.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "avr-spill-to-reg"
+#include "AVR.h"
+#include "AVRInstrInfo.h"
+#include "AVRRegisterInfo.h"
+#include "llvm/Function.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+using namespace llvm;
+
+STATISTIC(NumBytes, "Number of spilled bytes kept in registers");
+STATISTIC(NumSlots, "Number of spill slots removed");
+
+namespace {
+  struct AVRSpillToReg : public MachineFunctionPass {
+    static char ID;
+    AVRSpillToReg() : MachineFunctionPass(ID) {}
+
+    virtual bool runOnMachineFunction(MachineFunction &Fn);
+
+    virtual const char *getPassName() const {
+      return "AVR Spill To Register";
+    }
+
+  private:
+    typedef SmallVector<MachineInstr*, 4> AccessList;
+
+    unsigned findFreeReg(MachineBasicBlock::iterator First,
+                         MachineBasicBlock::iterator Last) const;
+    void rewrite(const AccessList &Accesses, unsigned Reg) const;
+
+    const TargetInstrInfo *TII;
+    const AVRRegisterInfo *TRI;
+    BitVector Reserved;
+  };
+  char AVRSpillToReg::ID = 0;
+}
+
+/// createAVRSpillToRegPass - returns an instance of the Spill To Register
+/// Pass
+///
+FunctionPass *llvm::createAVRSpillToRegPass() {
+  return new AVRSpillToReg();
+}
+
+// The call clobbered registers, Z last as it is the pointer to spill slots
+// when there is no frame pointer.
+static const unsigned CandidateRegs[] = {
+  AVR::R18, AVR::R19, AVR::R20, AVR::R21, AVR::R22, AVR::R23,
+  AVR::R24, AVR::R25, AVR::R26, AVR::R27, AVR::R30, AVR::R31
+};
+
+/// getSlotAccess - The frame index operand of a spill or reload, or -1 if
+/// MI is neither.
+static int getSlotAccess(const MachineInstr *MI) {
+  switch (MI->getOpcode()) {
+  case AVR::MOV8rm_INDEX: return MI->getOperand(1).isFI() ? 1 : -1;
+  case AVR::MOV8mr_INDEX: return MI->getOperand(0).isFI() ? 0 : -1;
+  default:                return -1;
+  }
+}
+
+/// findFreeReg - Find a call clobbered register that no instruction from
+/// First to Last touches, and whose value from before First is dead.
+unsigned AVRSpillToReg::findFreeReg(MachineBasicBlock::iterator First,
+                                    MachineBasicBlock::iterator Last) const {
+  for (unsigned r = 0; r != array_lengthof(CandidateRegs); ++r) {
+    unsigned Reg = CandidateRegs[r];
+    if (Reserved.test(Reg))
+      continue;
+
+    bool Touched = false;
+    for (MachineBasicBlock::iterator I = First; !Touched; ++I) {
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i) {
+        const MachineOperand &MO = I->getOperand(i);
+        if (MO.isReg() && MO.getReg() && TRI->regsOverlap(MO.getReg(), Reg)) {
+          Touched = true;
+          break;
+        }
+      }
+      if (I == Last)
+        break;
+    }
+
+    if (!Touched && !TRI->isLiveAfter(Last, Reg))
+      return Reg;
+  }
+
+  return 0;
+}
+
+/// rewrite - Turn the spills and reloads of a byte into moves to and from
+/// Reg.
+void AVRSpillToReg::rewrite(const AccessList &Accesses, unsigned Reg) const {
+  for (unsigned i = 0, e = Accesses.size(); i != e; ++i) {
+    MachineInstr *MI = Accesses[i];
+    MachineBasicBlock &MBB = *MI->getParent();
+    if (MI->getOpcode() == AVR::MOV8mr_INDEX) {
+      const MachineOperand &Src = MI->getOperand(2);
+      BuildMI(MBB, MI, MI->getDebugLoc(), TII->get(AVR::MOV8rr), Reg)
+        .addReg(Src.getReg(), getKillRegState(Src.isKill()));
+    } else {
+      BuildMI(MBB, MI, MI->getDebugLoc(), TII->get(AVR::MOV8rr),
+              MI->getOperand(0).getReg())
+        .addReg(Reg, getKillRegState(i + 1 == e));
+    }
+    MI->eraseFromParent();
+  }
+}
+
+bool AVRSpillToReg::runOnMachineFunction(MachineFunction &Fn) {
+  if (AVRCallingConv::isInterrupt(Fn.getFunction()->getCallingConv()))
+    return false;
+
+  TII = Fn.getTarget().getInstrInfo();
+  TRI = static_cast<const AVRRegisterInfo*>(Fn.getTarget().getRegisterInfo());
+  Reserved = TRI->getReservedRegs(Fn);
+  MachineRegisterInfo &MRI = Fn.getRegInfo();
+  MachineFrameInfo *MFI = Fn.getFrameInfo();
+
+  // Gather the accesses of each byte of each spill slot in the order of the
+  // function. A slot is given up on if it is used by anything else than a
+  // plain spill or reload, or in more than one block.
+  DenseMap<int, SmallVector<AccessList, 2> > Slots;
+  DenseMap<int, MachineBasicBlock*> SlotBlocks;
+  SmallVector<int, 8> Order;
+  DenseMap<int, bool> GivenUp;
+  for (MachineFunction::iterator BB = Fn.begin(), E = Fn.end(); BB != E; ++BB)
+    for (MachineBasicBlock::iterator I = BB->begin(), IE = BB->end();
+         I != IE; ++I) {
+      int Access = getSlotAccess(I);
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i) {
+        if (!I->getOperand(i).isFI())
+          continue;
+        int FI = I->getOperand(i).getIndex();
+        if (!MFI->isSpillSlotObjectIndex(FI) || int(i) != Access) {
+          GivenUp[FI] = true;
+          continue;
+        }
+
+        SmallVector<AccessList, 2> &Bytes = Slots[FI];
+        if (Bytes.empty()) {
+          Order.push_back(FI);
+          Bytes.resize(MFI->getObjectSize(FI));
+          SlotBlocks[FI] = BB;
+        } else if (SlotBlocks[FI] != BB)
+          GivenUp[FI] = true;
+
+        unsigned Byte = I->getOperand(i + 1).getImm();
+        if (Byte < Bytes.size())
+          Bytes[Byte].push_back(I);
+        else
+          GivenUp[FI] = true;
+      }
+    }
+
+  bool Changed = false;
+  for (unsigned s = 0, se = Order.size(); s != se; ++s) {
+    int FI = Order[s];
+    if (GivenUp.count(FI))
+      continue;
+
+    // Each byte of the slot goes into a register of its own. The first
+    // access to a byte must store it.
+    SmallVector<AccessList, 2> &Bytes = Slots[FI];
+    unsigned Moved = 0;
+    for (unsigned b = 0, be = Bytes.size(); b != be; ++b) {
+      AccessList &Accesses = Bytes[b];
+      if (Accesses.empty()) {
+        ++Moved;
+        continue;
+      }
+      if (Accesses.front()->getOpcode() != AVR::MOV8mr_INDEX)
+        continue;
+
+      unsigned Reg = findFreeReg(Accesses.front(), Accesses.back());
+      if (!Reg)
+        continue;
+
+      MRI.setPhysRegUsed(Reg);
+      rewrite(Accesses, Reg);
+      Changed = true;
+      ++Moved;
+      ++NumBytes;
+    }
+
+    if (Moved == Bytes.size()) {
+      MFI->RemoveStackObject(FI);
+      ++NumSlots;
+    }
+  }
+
+  return Changed;
+}
@@ -26,9 +26,29 @@ void AVRSubtarget::anchor() { }
 AVRSubtarget::AVRSubtarget(const std::string &TT,
                                  const std::string &CPU,
                                  const std::string &FS) :
-  AVRGenSubtargetInfo(TT, CPU, FS) {
-  std::string CPUName = "generic";
+  AVRGenSubtargetInfo(TT, CPU, FS), ELFArch(0), HasSRAM(false),
+  HasADDSUBIW(false), HasIJMPCALL(false), HasJMPCALL(false),
+  HasEIJMPCALL(false), HasMul(false), HasMOVW(false), HasLPM(false),
+  HasLPMX(false), HasELPM(false), HasELPMX(false), HasSPM(false),
+  HasSPMX(false), HasBREAK(false), HasDES(false), IsXMEGA(false),
+  HasTinyEncoding(false) {
+  std::string CPUName = CPU;
+  if (CPUName.empty())
+    CPUName = "generic";
 
   // Parse features string.
   ParseSubtargetFeatures(CPUName, FS);
+
+  InstrItins = getInstrItineraryForCPU(CPUName);
+}
+
+bool
+AVRSubtarget::enablePostRAScheduler(CodeGenOpt::Level OptLevel,
+                                    AntiDepBreakMode &Mode,
+                                    RegClassVector &CriticalPathRCs) const {
+  // There are too few registers free after allocation for renaming to pay
+  // off, so only reorder what is already independent.
+  Mode = TargetSubtargetInfo::ANTIDEP_NONE;
+  CriticalPathRCs.clear();
+  return OptLevel >= CodeGenOpt::Default;
 }
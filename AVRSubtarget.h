@@ -14,6 +14,7 @@
 #ifndef LLVM_TARGET_AVR_SUBTARGET_H
 #define LLVM_TARGET_AVR_SUBTARGET_H
 
+#include "llvm/MC/MCInstrItineraries.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 
 #define GET_SUBTARGETINFO_HEADER
@@ -26,7 +27,61 @@ class StringRef;
 
 class AVRSubtarget : public AVRGenSubtargetInfo {
   virtual void anchor();
-  bool ExtendedInsts;
+
+  /// ELFArch - The architecture number of the device family, as avr-gcc
+  /// puts it in the ELF header flags: 5 for avr5, 102 for avrxmega2.
+  unsigned ELFArch;
+
+  /// HasSRAM - True if the device has data memory besides the registers.
+  bool HasSRAM;
+
+  /// HasADDSUBIW - True if the device can add to and subtract from a
+  /// register pair with ADIW and SBIW.
+  bool HasADDSUBIW;
+
+  /// HasIJMPCALL, HasJMPCALL, HasEIJMPCALL - True if the device has the
+  /// jumps and calls through Z, the absolute ones for more than 8K of flash,
+  /// and the ones through EIND:Z for a 22-bit PC.
+  bool HasIJMPCALL;
+  bool HasJMPCALL;
+  bool HasEIJMPCALL;
+
+  /// HasMul - True if the device has the hardware multiplier (MUL, MULS,
+  /// MULSU, FMUL, FMULS and FMULSU).
+  bool HasMul;
+
+  /// HasMOVW - True if the device can copy register pairs with MOVW.
+  bool HasMOVW;
+
+  /// HasLPM, HasLPMX - True if the device reads program memory with LPM
+  /// into R0, and into any register with Z or Z+.
+  bool HasLPM;
+  bool HasLPMX;
+
+  /// HasELPM, HasELPMX - As HasLPM and HasLPMX, for ELPM past 64K.
+  bool HasELPM;
+  bool HasELPMX;
+
+  /// HasSPM, HasSPMX - True if the device writes its program memory with
+  /// SPM, and with SPM Z+.
+  bool HasSPM;
+  bool HasSPMX;
+
+  /// HasBREAK - True if the device has the BREAK instruction.
+  bool HasBREAK;
+
+  /// HasDES - True if the device has the DES instruction.
+  bool HasDES;
+
+  /// IsXMEGA - True for the XMEGA devices and their I/O layout.
+  bool IsXMEGA;
+
+  /// HasTinyEncoding - True for the reduced core of avrtiny, with only R16
+  /// to R31.
+  bool HasTinyEncoding;
+
+  /// InstrItins - The cycle counts of the instructions on the device.
+  InstrItineraryData InstrItins;
 public:
   /// This constructor initializes the data members to match that
   /// of the specified triple.
@@ -37,6 +92,42 @@ public:
   /// ParseSubtargetFeatures - Parses features string setting specified
   /// subtarget options.  Definition of function is auto generated by tblgen.
   void ParseSubtargetFeatures(StringRef CPU, StringRef FS);
+
+  unsigned getELFArch() const { return ELFArch; }
+
+  bool hasSRAM() const { return HasSRAM; }
+  bool hasADDSUBIW() const { return HasADDSUBIW; }
+  bool hasIJMPCALL() const { return HasIJMPCALL; }
+  bool hasJMPCALL() const { return HasJMPCALL; }
+  bool hasEIJMPCALL() const { return HasEIJMPCALL; }
+  bool hasMul() const { return HasMul; }
+  bool hasMOVW() const { return HasMOVW; }
+  bool hasLPM() const { return HasLPM; }
+  bool hasLPMX() const { return HasLPMX; }
+  bool hasELPM() const { return HasELPM; }
+  bool hasELPMX() const { return HasELPMX; }
+  bool hasSPM() const { return HasSPM; }
+  bool hasSPMX() const { return HasSPMX; }
+  bool hasBREAK() const { return HasBREAK; }
+  bool hasDES() const { return HasDES; }
+  bool isXMEGA() const { return IsXMEGA; }
+  bool hasTinyEncoding() const { return HasTinyEncoding; }
+
+  /// getIOBase - The data address of the first I/O register. The classic
+  /// devices map the registers below it, XMEGA and the reduced core do not.
+  unsigned getIOBase() const {
+    return IsXMEGA || HasTinyEncoding ? 0 : 0x20;
+  }
+
+  const InstrItineraryData &getInstrItineraryData() const {
+    return InstrItins;
+  }
+
+  /// enablePostRAScheduler - Reorder after register allocation, with the
+  /// cycle counts of the device, when optimizing.
+  virtual bool enablePostRAScheduler(CodeGenOpt::Level OptLevel,
+                                     AntiDepBreakMode &Mode,
+                                     RegClassVector &CriticalPathRCs) const;
 };
 } // End llvm namespace
 
@@ -33,8 +33,11 @@ AVRTargetMachine::AVRTargetMachine(const Target &T,
                                          CodeGenOpt::Level OL)
   : LLVMTargetMachine(T, TT, CPU, FS, Options, RM, CM, OL),
     Subtarget(TT, CPU, FS),
+    // Pointers into program memory are 16 bits as well, offsets into the
+    // 64K segment their address space stands for.
     DataLayout("e-p:16:16:16-i8:8:8-i16:16:16-i32:16:32-n8:16"),
-    InstrInfo(*this), TLInfo(*this)
+    InstrInfo(*this), TLInfo(*this), TSInfo(*this),
+    InstrItins(Subtarget.getInstrItineraryData())
 {
 }
 
@@ -42,3 +45,17 @@ bool AVRTargetMachine::addInstSelector(PassManagerBase &PM){
     PM.add(createAVRISelDag(*this, getOptLevel()));
     return false;
 }
+
+bool AVRTargetMachine::addPostRegAlloc(PassManagerBase &PM) {
+    // Spill slots are still frame indices until prologue/epilogue insertion.
+    if (getOptLevel() == CodeGenOpt::None)
+      return false;
+    PM.add(createAVRSpillToRegPass());
+    return true;
+}
+
+bool AVRTargetMachine::addPreEmitPass(PassManagerBase &PM) {
+    // Must run branch selection immediately preceding the asm printer.
+    PM.add(createAVRBranchSelectionPass());
+    return false;
+}
@@ -18,7 +18,7 @@
 #include "AVRInstrInfo.h"
 #include "AVRISelLowering.h"
 #include "AVRFrameLowering.h"
-//#include "AVRSelectionDAGInfo.h"
+#include "AVRSelectionDAGInfo.h"
 #include "AVRRegisterInfo.h"
 #include "AVRSubtarget.h"
 #include "llvm/Target/TargetData.h"
@@ -32,8 +32,9 @@ class AVRTargetMachine : public LLVMTargetMachine {
   const TargetData       DataLayout;       // Calculates type size & alignment
   AVRInstrInfo		 InstrInfo;
   AVRTargetLowering	 TLInfo;
-  //AVRSelectionDAGInfo	 TSInfo;
+  AVRSelectionDAGInfo	 TSInfo;
   AVRFrameLowering	 FrameLowering;
+  InstrItineraryData     InstrItins;
 
 public:
   AVRTargetMachine(const Target &T, StringRef TT,
@@ -54,15 +55,18 @@ public:
   virtual const AVRTargetLowering* getTargetLowering() const {
     return &TLInfo;
   }
+  virtual const InstrItineraryData *getInstrItineraryData() const {
+    return &InstrItins;
+  }
 
-  /*
   virtual const AVRSelectionDAGInfo* getSelectionDAGInfo() const {
     return &TSInfo;
   }
-  */
 
 
   virtual bool addInstSelector(PassManagerBase &PM);
+  virtual bool addPostRegAlloc(PassManagerBase &PM);
+  virtual bool addPreEmitPass(PassManagerBase &PM);
 }; 
 } // end namespace llvm
 
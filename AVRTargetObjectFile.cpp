@@ -0,0 +1,45 @@
+//===-- AVRTargetObjectFile.cpp - AVR Object Files ------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AVRTargetObjectFile.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/GlobalValue.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/ADT/StringExtras.h"
+using namespace llvm;
+
+void AVRTargetObjectFile::Initialize(MCContext &Ctx, const TargetMachine &TM){
+  TargetLoweringObjectFileELF::Initialize(Ctx, TM);
+
+  // The first segment goes in .progmem.data, the others in .progmem1.data
+  // and on, as avr-gcc names them for the linker script to place.
+  for (unsigned AS = AVRAS::PROGMEM; AS <= AVRAS::PROGMEM_LAST; ++AS) {
+    unsigned Segment = AVRAS::getSegment(AS);
+    std::string Name = ".progmem";
+    if (Segment)
+      Name += utostr(Segment);
+    Name += ".data";
+    ProgmemDataSections[Segment] =
+      getContext().getELFSection(Name, ELF::SHT_PROGBITS,
+                                 ELF::SHF_ALLOC, SectionKind::getReadOnly());
+  }
+}
+
+const MCSection *AVRTargetObjectFile::
+SelectSectionForGlobal(const GlobalValue *GV, SectionKind Kind,
+                       Mangler *Mang, const TargetMachine &TM) const {
+  unsigned AS = GV->getType()->getAddressSpace();
+  if (AVRAS::isProgramMemory(AS))
+    return ProgmemDataSections[AVRAS::getSegment(AS)];
+
+  return TargetLoweringObjectFileELF::SelectSectionForGlobal(GV, Kind, Mang,
+                                                             TM);
+}
@@ -0,0 +1,33 @@
+//===-- AVRTargetObjectFile.h - AVR Object Info -----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TARGET_AVR_TARGETOBJECTFILE_H
+#define LLVM_TARGET_AVR_TARGETOBJECTFILE_H
+
+#include "AVR.h"
+#include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
+
+namespace llvm {
+
+  /// AVRTargetObjectFile - Puts the globals of program memory into the
+  /// .progmem sections, one for each 64K segment.
+  class AVRTargetObjectFile : public TargetLoweringObjectFileELF {
+    const MCSection *ProgmemDataSections[AVRAS::PROGMEM_LAST -
+                                         AVRAS::PROGMEM + 1];
+  public:
+    void Initialize(MCContext &Ctx, const TargetMachine &TM);
+
+    const MCSection *SelectSectionForGlobal(const GlobalValue *GV,
+                                            SectionKind Kind,
+                                            Mangler *Mang,
+                                            const TargetMachine &TM) const;
+  };
+} // end namespace llvm
+
+#endif
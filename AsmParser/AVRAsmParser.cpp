@@ -0,0 +1,656 @@
+//===-- AVRAsmParser.cpp - Parse AVR assembly to MCInst instructions ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file parses the assembly of avr-gcc and avr-as, for inline asm and for
+// .s files, into MCInsts. The operand syntax it understands:
+//
+//   r0 - r31, X, Y, Z      registers, in either case
+//   r25:r24                a register pair, as the AsmPrinter writes it
+//   X+, -X                 post-increment and pre-decrement, for LD and ST
+//   Y+q                    the displacement of LDD and STD
+//   lo8(e), hi8(e)         the bytes of an address, for LDI and friends
+//   pm_lo8(e), pm_hi8(e)   the same for the word address of code, also
+//                          written lo8(pm(e)), or with gs() for pm()
+//   .+k, .-k               a branch offset in bytes from the next instruction
+//   __SREG__, __SP_L__ ... the I/O register names avr-gcc defines
+//
+//===----------------------------------------------------------------------===//
+
+#include "AVR.h"
+#include "MCTargetDesc/AVRBaseInfo.h"
+#include "MCTargetDesc/AVRMCExpr.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCParser/MCAsmLexer.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCParsedAsmOperand.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/MC/MCTargetAsmParser.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cctype>
+using namespace llvm;
+
+namespace {
+struct AVROperand;
+
+class AVRAsmParser : public MCTargetAsmParser {
+  MCSubtargetInfo &STI;
+  MCAsmParser &Parser;
+
+  MCAsmParser &getParser() const { return Parser; }
+  MCAsmLexer &getLexer() const { return Parser.getLexer(); }
+
+  bool Error(SMLoc L, const Twine &Msg) { return Parser.Error(L, Msg); }
+
+  bool MatchAndEmitInstruction(SMLoc IDLoc,
+                               SmallVectorImpl<MCParsedAsmOperand*> &Operands,
+                               MCStreamer &Out);
+
+  bool ParseRegister(unsigned &RegNo, SMLoc &StartLoc, SMLoc &EndLoc);
+
+  bool ParseInstruction(StringRef Name, SMLoc NameLoc,
+                        SmallVectorImpl<MCParsedAsmOperand*> &Operands);
+
+  bool ParseDirective(AsmToken DirectiveID);
+
+  bool ParseOperand(SmallVectorImpl<MCParsedAsmOperand*> &Operands);
+  bool ParseRegisterOperand(SmallVectorImpl<MCParsedAsmOperand*> &Operands,
+                            unsigned RegNo, SMLoc S);
+  bool ParseModifiedExpr(AVRMCExpr::VariantKind Kind, const MCExpr *&Res);
+  bool ParsePCRelOffset(const MCExpr *&Res);
+  unsigned TryParseRegister();
+
+  /// @name Auto-generated Match Functions
+  /// {
+
+#define GET_ASSEMBLER_HEADER
+#include "AVRGenAsmMatcher.inc"
+
+  /// }
+
+public:
+  AVRAsmParser(MCSubtargetInfo &_STI, MCAsmParser &_Parser)
+    : MCTargetAsmParser(), STI(_STI), Parser(_Parser) {
+    setAvailableFeatures(ComputeAvailableFeatures(STI.getFeatureBits()));
+
+    // avr-gcc defines these at the top of every file it writes. Define them
+    // for inline asm, and for .s files that expect them.
+    static const struct { const char *Name; int64_t Addr; } IORegs[] = {
+      { "__SREG__", 0x3f }, { "__SP_H__", 0x3e }, { "__SP_L__", 0x3d },
+      { "__RAMPZ__", 0x3b }
+    };
+    MCContext &Ctx = getParser().getContext();
+    for (unsigned i = 0; i != array_lengthof(IORegs); ++i) {
+      MCSymbol *Sym = Ctx.GetOrCreateSymbol(IORegs[i].Name);
+      if (!Sym->isVariable() && Sym->isUndefined())
+        Sym->setVariableValue(MCConstantExpr::Create(IORegs[i].Addr, Ctx));
+    }
+  }
+};
+
+/// AVROperand - Instances of this class represent a parsed AVR machine
+/// instruction.
+struct AVROperand : public MCParsedAsmOperand {
+  enum KindTy {
+    Token,
+    Register,
+    Immediate
+  } Kind;
+
+  SMLoc StartLoc, EndLoc;
+
+  union {
+    struct {
+      const char *Data;
+      unsigned Length;
+    } Tok;
+
+    struct {
+      unsigned RegNum;
+    } Reg;
+
+    struct {
+      const MCExpr *Val;
+    } Imm;
+  };
+
+  AVROperand(KindTy K) : MCParsedAsmOperand(), Kind(K) {}
+
+public:
+  /// getStartLoc - Get the location of the first token of this operand.
+  SMLoc getStartLoc() const { return StartLoc; }
+
+  /// getEndLoc - Get the location of the last token of this operand.
+  SMLoc getEndLoc() const { return EndLoc; }
+
+  unsigned getReg() const {
+    assert(Kind == Register && "Invalid access!");
+    return Reg.RegNum;
+  }
+
+  void setReg(unsigned RegNum) {
+    assert(Kind == Register && "Invalid access!");
+    Reg.RegNum = RegNum;
+  }
+
+  const MCExpr *getImm() const {
+    assert(Kind == Immediate && "Invalid access!");
+    return Imm.Val;
+  }
+
+  StringRef getToken() const {
+    assert(Kind == Token && "Invalid access!");
+    return StringRef(Tok.Data, Tok.Length);
+  }
+
+  bool isToken() const { return Kind == Token; }
+  bool isImm() const { return Kind == Immediate; }
+  bool isReg() const { return Kind == Register; }
+  bool isMem() const { return false; }
+
+  /// isIOAddr - IN and OUT reach the 64 addresses of the I/O space, which
+  /// have to be known when assembling.
+  bool isIOAddr() const {
+    if (!isImm())
+      return false;
+    const MCConstantExpr *CE = dyn_cast<MCConstantExpr>(getImm());
+    return CE && CE->getValue() >= 0 && CE->getValue() < 64;
+  }
+
+  /// isLowIOAddr - SBI, CBI, SBIS and SBIC reach the low 32 of them.
+  bool isLowIOAddr() const {
+    if (!isIOAddr())
+      return false;
+    return cast<MCConstantExpr>(getImm())->getValue() < 32;
+  }
+
+  void addExpr(MCInst &Inst, const MCExpr *Expr) const {
+    if (const MCConstantExpr *CE = dyn_cast<MCConstantExpr>(Expr))
+      Inst.addOperand(MCOperand::CreateImm(CE->getValue()));
+    else
+      Inst.addOperand(MCOperand::CreateExpr(Expr));
+  }
+
+  void addRegOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::CreateReg(getReg()));
+  }
+
+  void addImmOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    addExpr(Inst, getImm());
+  }
+
+  void addIOAddrOperands(MCInst &Inst, unsigned N) const {
+    addImmOperands(Inst, N);
+  }
+
+  void addLowIOAddrOperands(MCInst &Inst, unsigned N) const {
+    addImmOperands(Inst, N);
+  }
+
+  virtual void print(raw_ostream &OS) const;
+
+  static AVROperand *CreateToken(StringRef Str, SMLoc S) {
+    AVROperand *Op = new AVROperand(Token);
+    Op->Tok.Data = Str.data();
+    Op->Tok.Length = Str.size();
+    Op->StartLoc = S;
+    Op->EndLoc = S;
+    return Op;
+  }
+
+  static AVROperand *CreateReg(unsigned RegNum, SMLoc S, SMLoc E) {
+    AVROperand *Op = new AVROperand(Register);
+    Op->Reg.RegNum = RegNum;
+    Op->StartLoc = S;
+    Op->EndLoc = E;
+    return Op;
+  }
+
+  static AVROperand *CreateImm(const MCExpr *Val, SMLoc S, SMLoc E) {
+    AVROperand *Op = new AVROperand(Immediate);
+    Op->Imm.Val = Val;
+    Op->StartLoc = S;
+    Op->EndLoc = E;
+    return Op;
+  }
+};
+
+} // end anonymous namespace.
+
+void AVROperand::print(raw_ostream &OS) const {
+  switch (Kind) {
+  case Token:
+    OS << "'" << getToken() << "'";
+    break;
+  case Register:
+    OS << "<register " << getReg() << ">";
+    break;
+  case Immediate:
+    OS << *getImm();
+    break;
+  }
+}
+
+/// @name Auto-generated Match Functions
+/// {
+
+static unsigned MatchRegisterName(StringRef Name);
+
+/// }
+
+/// getPairForLowReg - The register pair whose low register is Reg, as MOVW,
+/// ADIW and SBIW name it in assembly. Zero if there is no such pair.
+static unsigned getPairForLowReg(unsigned Reg) {
+  switch (Reg) {
+  default:      return 0;
+  case AVR::R0:  return AVR::R1W;
+  case AVR::R2:  return AVR::R3W;
+  case AVR::R4:  return AVR::R5W;
+  case AVR::R6:  return AVR::R7W;
+  case AVR::R8:  return AVR::R9W;
+  case AVR::R10: return AVR::R11W;
+  case AVR::R12: return AVR::R13W;
+  case AVR::R14: return AVR::R15W;
+  case AVR::R16: return AVR::R17W;
+  case AVR::R18: return AVR::R19W;
+  case AVR::R20: return AVR::R21W;
+  case AVR::R22: return AVR::R23W;
+  case AVR::R24: return AVR::R25W;
+  case AVR::R26: return AVR::X;
+  case AVR::R28: return AVR::Y;
+  case AVR::R30: return AVR::Z;
+  }
+}
+
+/// getCondCodeSuffix - The condition of a BRxx mnemonic, from its suffix.
+static AVRCC::CondCodes getCondCodeSuffix(StringRef Suffix) {
+  return StringSwitch<AVRCC::CondCodes>(Suffix)
+    .Case("eq", AVRCC::COND_E)
+    .Case("ne", AVRCC::COND_NE)
+    .Case("sh", AVRCC::COND_HS)
+    .Case("cc", AVRCC::COND_HS)
+    .Case("lo", AVRCC::COND_LO)
+    .Case("cs", AVRCC::COND_LO)
+    .Case("ge", AVRCC::COND_GE)
+    .Case("lt", AVRCC::COND_L)
+    .Case("mi", AVRCC::COND_MI)
+    .Case("pl", AVRCC::COND_PL)
+    .Case("vs", AVRCC::COND_VS)
+    .Case("vc", AVRCC::COND_VC)
+    .Case("ts", AVRCC::COND_TS)
+    .Case("tc", AVRCC::COND_TC)
+    .Case("hs", AVRCC::COND_HCS)
+    .Case("hc", AVRCC::COND_HCC)
+    .Case("ie", AVRCC::COND_IE)
+    .Case("id", AVRCC::COND_ID)
+    .Default(AVRCC::COND_INVALID);
+}
+
+/// getCondCodeForFlag - The condition BRBS (or BRBC when Clear) tests for a
+/// flag of SREG, by number.
+static AVRCC::CondCodes getCondCodeForFlag(int64_t Flag, bool Clear) {
+  static const AVRCC::CondCodes Set[] = {
+    AVRCC::COND_LO, AVRCC::COND_E, AVRCC::COND_MI, AVRCC::COND_VS,
+    AVRCC::COND_L, AVRCC::COND_HCS, AVRCC::COND_TS, AVRCC::COND_IE
+  };
+  static const AVRCC::CondCodes Cleared[] = {
+    AVRCC::COND_HS, AVRCC::COND_NE, AVRCC::COND_PL, AVRCC::COND_VC,
+    AVRCC::COND_GE, AVRCC::COND_HCC, AVRCC::COND_TC, AVRCC::COND_ID
+  };
+
+  if (Flag < 0 || Flag > 7)
+    return AVRCC::COND_INVALID;
+  return Clear ? Cleared[Flag] : Set[Flag];
+}
+
+bool AVRAsmParser::
+MatchAndEmitInstruction(SMLoc IDLoc,
+                        SmallVectorImpl<MCParsedAsmOperand*> &Operands,
+                        MCStreamer &Out) {
+  MCInst Inst;
+  unsigned ErrorInfo;
+
+  switch (MatchInstructionImpl(Operands, Inst, ErrorInfo)) {
+  default: break;
+  case Match_Success:
+    Out.EmitInstruction(Inst);
+    return false;
+  case Match_MissingFeature:
+    return Error(IDLoc, "instruction not supported on this device");
+  case Match_MnemonicFail:
+    return Error(IDLoc, "unrecognized instruction mnemonic");
+  case Match_ConversionFail:
+    return Error(IDLoc, "unable to convert operands to instruction");
+  case Match_InvalidOperand: {
+    SMLoc ErrorLoc = IDLoc;
+    if (ErrorInfo != ~0U) {
+      if (ErrorInfo >= Operands.size())
+        return Error(IDLoc, "too few operands for instruction");
+
+      ErrorLoc = ((AVROperand*)Operands[ErrorInfo])->getStartLoc();
+      if (ErrorLoc == SMLoc()) ErrorLoc = IDLoc;
+    }
+
+    return Error(ErrorLoc, "invalid operand for instruction");
+  }
+  }
+
+  llvm_unreachable("Implement any new match types added!");
+}
+
+/// TryParseRegister - Consume and return the register the current token
+/// names, or return zero and leave the token alone.
+unsigned AVRAsmParser::TryParseRegister() {
+  const AsmToken &Tok = getLexer().getTok();
+  if (Tok.isNot(AsmToken::Identifier))
+    return 0;
+
+  std::string Name = Tok.getString().lower();
+  unsigned RegNo = StringSwitch<unsigned>(Name)
+    .Case("__tmp_reg__", AVR::R0)
+    .Case("__zero_reg__", AVR::R1)
+    .Default(MatchRegisterName(Name));
+
+  // Only the general purpose registers are written in assembly; the I/O
+  // registers are addresses there.
+  if (RegNo == 0 || RegNo == AVR::PC || RegNo == AVR::SREG ||
+      RegNo == AVR::SPH || RegNo == AVR::SPL || RegNo == AVR::RAMPZ)
+    return 0;
+
+  getLexer().Lex();
+  return RegNo;
+}
+
+bool AVRAsmParser::ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
+                                 SMLoc &EndLoc) {
+  StartLoc = getLexer().getTok().getLoc();
+  RegNo = TryParseRegister();
+  EndLoc = getLexer().getTok().getLoc();
+  return RegNo == 0;
+}
+
+/// ParseRegisterOperand - What follows the register RegNo: the register it
+/// pairs with (r25:r24), a post-increment (X+) or a displacement (Y+q).
+bool AVRAsmParser::
+ParseRegisterOperand(SmallVectorImpl<MCParsedAsmOperand*> &Operands,
+                     unsigned RegNo, SMLoc S) {
+  if (getLexer().is(AsmToken::Colon)) {
+    getLexer().Lex();
+    SMLoc LoLoc = getLexer().getTok().getLoc();
+    unsigned Lo = TryParseRegister();
+    unsigned Pair = Lo ? getPairForLowReg(Lo) : 0;
+    if (!Pair ||
+        getAVRRegisterNumbering(RegNo) != getAVRRegisterNumbering(Lo) + 1)
+      return Error(LoLoc, "invalid register pair");
+    RegNo = Pair;
+  }
+
+  SMLoc E = getLexer().getTok().getLoc();
+  Operands.push_back(AVROperand::CreateReg(RegNo, S, E));
+
+  if (getLexer().isNot(AsmToken::Plus))
+    return false;
+
+  SMLoc PlusLoc = getLexer().getTok().getLoc();
+  getLexer().Lex();
+  if (getLexer().is(AsmToken::Comma) ||
+      getLexer().is(AsmToken::EndOfStatement)) {
+    Operands.push_back(AVROperand::CreateToken("+", PlusLoc));
+    return false;
+  }
+
+  const MCExpr *Disp;
+  if (getParser().ParseExpression(Disp, E))
+    return true;
+  Operands.push_back(AVROperand::CreateImm(Disp, PlusLoc, E));
+  return false;
+}
+
+/// ParseModifiedExpr - The parenthesized expression after lo8 and friends,
+/// which may itself be pm(expr) or gs(expr) for the word address of code.
+bool AVRAsmParser::ParseModifiedExpr(AVRMCExpr::VariantKind Kind,
+                                     const MCExpr *&Res) {
+  if (getLexer().isNot(AsmToken::LParen))
+    return Error(getLexer().getTok().getLoc(), "expected '('");
+  getLexer().Lex();
+
+  SMLoc E;
+  const AsmToken &Tok = getLexer().getTok();
+  if (Tok.is(AsmToken::Identifier) &&
+      (Tok.getString() == "pm" || Tok.getString() == "gs")) {
+    if (Kind == AVRMCExpr::VK_AVR_LO8)
+      Kind = AVRMCExpr::VK_AVR_PM_LO8;
+    else if (Kind == AVRMCExpr::VK_AVR_HI8)
+      Kind = AVRMCExpr::VK_AVR_PM_HI8;
+    else
+      return Error(Tok.getLoc(), "unexpected pm() in this modifier");
+
+    getLexer().Lex();
+    if (getLexer().isNot(AsmToken::LParen))
+      return Error(getLexer().getTok().getLoc(), "expected '('");
+    getLexer().Lex();
+    if (getParser().ParseParenExpression(Res, E))
+      return true;
+    if (getLexer().isNot(AsmToken::RParen))
+      return Error(getLexer().getTok().getLoc(), "expected ')'");
+    getLexer().Lex();
+  } else if (getParser().ParseParenExpression(Res, E)) {
+    return true;
+  }
+
+  Res = AVRMCExpr::Create(Kind, Res, getParser().getContext());
+  return false;
+}
+
+/// ParsePCRelOffset - A branch target relative to the current instruction,
+/// .+k or .-k. avr-gcc counts k in bytes from the next instruction, as the
+/// instruction printer does, so it stays a plain immediate.
+bool AVRAsmParser::ParsePCRelOffset(const MCExpr *&Res) {
+  assert(getLexer().is(AsmToken::Dot) && "Expected '.'!");
+  getLexer().Lex();
+
+  int64_t Offset = 0;
+  if (getLexer().is(AsmToken::Plus) || getLexer().is(AsmToken::Minus)) {
+    bool Negate = getLexer().is(AsmToken::Minus);
+    getLexer().Lex();
+    if (getParser().ParseAbsoluteExpression(Offset))
+      return true;
+    if (Negate)
+      Offset = -Offset;
+  }
+
+  Res = MCConstantExpr::Create(Offset, getParser().getContext());
+  return false;
+}
+
+/// isPointerAfterMinus - Whether the '-' at P starts a pre-decrement, -X,
+/// -Y or -Z, rather than a negative number.
+static bool isPointerAfterMinus(const char *P) {
+  ++P;
+  while (*P == ' ' || *P == '\t')
+    ++P;
+  char C = tolower(*P);
+  if (C != 'x' && C != 'y' && C != 'z')
+    return false;
+  return !isalnum(P[1]) && P[1] != '_';
+}
+
+bool AVRAsmParser::
+ParseOperand(SmallVectorImpl<MCParsedAsmOperand*> &Operands) {
+  const AsmToken &Tok = getLexer().getTok();
+  SMLoc S = Tok.getLoc();
+
+  if (Tok.is(AsmToken::Minus) && isPointerAfterMinus(S.getPointer())) {
+    Operands.push_back(AVROperand::CreateToken("-", S));
+    getLexer().Lex();
+    SMLoc RegLoc = getLexer().getTok().getLoc();
+    unsigned RegNo = TryParseRegister();
+    assert(RegNo && "Expected X, Y or Z!");
+    Operands.push_back(AVROperand::CreateReg(RegNo, RegLoc,
+                                             getLexer().getTok().getLoc()));
+    return false;
+  }
+
+  if (unsigned RegNo = TryParseRegister())
+    return ParseRegisterOperand(Operands, RegNo, S);
+
+  const MCExpr *Expr;
+  SMLoc E;
+  if (Tok.is(AsmToken::Dot)) {
+    if (ParsePCRelOffset(Expr))
+      return true;
+  } else if (Tok.is(AsmToken::Identifier) &&
+             (Tok.getString() == "lo8" || Tok.getString() == "hi8" ||
+              Tok.getString() == "pm_lo8" || Tok.getString() == "pm_hi8")) {
+    AVRMCExpr::VariantKind Kind =
+      StringSwitch<AVRMCExpr::VariantKind>(Tok.getString())
+        .Case("lo8", AVRMCExpr::VK_AVR_LO8)
+        .Case("hi8", AVRMCExpr::VK_AVR_HI8)
+        .Case("pm_lo8", AVRMCExpr::VK_AVR_PM_LO8)
+        .Case("pm_hi8", AVRMCExpr::VK_AVR_PM_HI8);
+    getLexer().Lex();
+    if (ParseModifiedExpr(Kind, Expr))
+      return true;
+  } else if (getParser().ParseExpression(Expr, E)) {
+    return true;
+  }
+  E = getLexer().getTok().getLoc();
+
+  // Fold what is known now, such as the I/O register names, so that the
+  // operand matches as a constant.
+  int64_t Value;
+  if (Expr->EvaluateAsAbsolute(Value))
+    Expr = MCConstantExpr::Create(Value, getParser().getContext());
+
+  Operands.push_back(AVROperand::CreateImm(Expr, S, E));
+  return false;
+}
+
+bool AVRAsmParser::
+ParseInstruction(StringRef Name, SMLoc NameLoc,
+                 SmallVectorImpl<MCParsedAsmOperand*> &Operands) {
+  // The conditional branches are one instruction with the condition as an
+  // operand, which BRBS and BRBC give by the number of the flag.
+  bool IsBRBx = Name == "brbs" || Name == "brbc";
+  AVRCC::CondCodes CC = AVRCC::COND_INVALID;
+  if (Name.startswith("br") && !IsBRBx)
+    CC = getCondCodeSuffix(Name.substr(2));
+
+  if (CC != AVRCC::COND_INVALID || IsBRBx)
+    Operands.push_back(AVROperand::CreateToken(Name.substr(0, 2), NameLoc));
+  else
+    Operands.push_back(AVROperand::CreateToken(Name, NameLoc));
+
+  if (IsBRBx) {
+    SMLoc FlagLoc = getLexer().getTok().getLoc();
+    int64_t Flag;
+    if (getParser().ParseAbsoluteExpression(Flag))
+      return true;
+    CC = getCondCodeForFlag(Flag, Name == "brbc");
+    if (CC == AVRCC::COND_INVALID)
+      return Error(FlagLoc, "flag number must be between 0 and 7");
+    if (getLexer().isNot(AsmToken::Comma))
+      return Error(getLexer().getTok().getLoc(), "expected ','");
+    getLexer().Lex();
+  }
+
+  if (CC != AVRCC::COND_INVALID)
+    Operands.push_back(AVROperand::CreateImm(
+                         MCConstantExpr::Create(CC, getParser().getContext()),
+                         NameLoc, NameLoc));
+
+  // Read the comma separated operands.
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    if (ParseOperand(Operands))
+      return true;
+
+    while (getLexer().is(AsmToken::Comma)) {
+      getLexer().Lex(); // Consume the comma.
+      if (ParseOperand(Operands))
+        return true;
+    }
+  }
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    SMLoc Loc = getLexer().getTok().getLoc();
+    return Error(Loc, "unexpected token in argument list");
+  }
+  getLexer().Lex(); // Consume the EndOfStatement.
+
+  AVROperand *First = Operands.size() > 1 ? (AVROperand*)Operands[1] : 0;
+  MCContext &Ctx = getParser().getContext();
+
+  // MOVW, ADIW and SBIW name a pair by its low register.
+  if (Name == "movw" || Name == "adiw" || Name == "sbiw") {
+    for (unsigned i = 1, e = Operands.size(); i != e; ++i) {
+      AVROperand *Op = (AVROperand*)Operands[i];
+      if (Op->isReg() && getPairForLowReg(Op->getReg()))
+        Op->setReg(getPairForLowReg(Op->getReg()));
+    }
+  }
+
+  // The aliases of avr-as that are another instruction with operands of
+  // its own.
+  if ((Name == "clr" || Name == "tst") && Operands.size() == 2 &&
+      First->isReg()) {
+    // clr Rd is eor Rd, Rd, and tst Rd is and Rd, Rd.
+    delete Operands[0];
+    Operands[0] = AVROperand::CreateToken(Name == "clr" ? "eor" : "and",
+                                          NameLoc);
+    Operands.push_back(AVROperand::CreateReg(First->getReg(),
+                                             First->getStartLoc(),
+                                             First->getEndLoc()));
+  } else if (Name == "ser" && Operands.size() == 2) {
+    // ser Rd is ldi Rd, 0xff.
+    delete Operands[0];
+    Operands[0] = AVROperand::CreateToken("ldi", NameLoc);
+    Operands.push_back(AVROperand::CreateImm(MCConstantExpr::Create(0xff, Ctx),
+                                             NameLoc, NameLoc));
+  } else if (Name == "cbr" && Operands.size() == 3 &&
+             ((AVROperand*)Operands[2])->isImm()) {
+    // cbr Rd, K is andi Rd, ~K.
+    AVROperand *K = (AVROperand*)Operands[2];
+    delete Operands[0];
+    Operands[0] = AVROperand::CreateToken("andi", NameLoc);
+    K->Imm.Val = MCBinaryExpr::CreateXor(K->getImm(),
+                                         MCConstantExpr::Create(0xff, Ctx),
+                                         Ctx);
+    int64_t Value;
+    if (K->Imm.Val->EvaluateAsAbsolute(Value))
+      K->Imm.Val = MCConstantExpr::Create(Value, Ctx);
+  } else if (Name == "sbr" && Operands.size() == 3) {
+    // sbr Rd, K is ori Rd, K.
+    delete Operands[0];
+    Operands[0] = AVROperand::CreateToken("ori", NameLoc);
+  }
+
+  return false;
+}
+
+bool AVRAsmParser::ParseDirective(AsmToken DirectiveID) {
+  // avr-as has no directives of its own that avr-gcc uses, everything is
+  // handled by the generic ELF parser.
+  return true;
+}
+
+/// Force static initialization.
+extern "C" void LLVMInitializeAVRAsmParser() {
+  RegisterMCAsmParser<AVRAsmParser> X(TheAVRTarget);
+}
+
+#define GET_REGISTER_MATCHER
+#define GET_MATCHER_IMPLEMENTATION
+#include "AVRGenAsmMatcher.inc"
@@ -0,0 +1,295 @@
+//===-- AVRDisassembler.cpp - Disassembler for AVR ------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is part of the AVR Disassembler. It decodes the words of program
+// memory with the tables TableGen builds from the instruction encodings, for
+// llvm-objdump and llvm-mc.
+//
+// Instructions are tried as one word first, and as two words if that fails:
+// the first word of LDS, STS, JMP and CALL is no instruction of its own.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AVR.h"
+#include "MCTargetDesc/AVRMCTargetDesc.h"
+#include "llvm/MC/EDInstInfo.h"
+#include "llvm/MC/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/MemoryObject.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Pull the instruction information the enhanced disassembler wants.
+#include "AVRGenEDInfo.inc"
+
+using namespace llvm;
+
+typedef MCDisassembler::DecodeStatus DecodeStatus;
+
+namespace {
+
+/// AVRDisassembler - Disassembler for AVR program memory.
+class AVRDisassembler : public MCDisassembler {
+public:
+  AVRDisassembler(const MCSubtargetInfo &STI) : MCDisassembler(STI) {}
+
+  ~AVRDisassembler() {}
+
+  /// getInstruction - See MCDisassembler.
+  DecodeStatus getInstruction(MCInst &Instr, uint64_t &Size,
+                              const MemoryObject &Region, uint64_t Address,
+                              raw_ostream &VStream,
+                              raw_ostream &CStream) const;
+
+  /// getEDInfo - See MCDisassembler.
+  EDInstInfo *getEDInfo() const;
+};
+
+} // end anonymous namespace
+
+// The registers, after their number.
+static const unsigned GR8DecoderTable[] = {
+  AVR::R0,  AVR::R1,  AVR::R2,  AVR::R3,  AVR::R4,  AVR::R5,  AVR::R6,
+  AVR::R7,  AVR::R8,  AVR::R9,  AVR::R10, AVR::R11, AVR::R12, AVR::R13,
+  AVR::R14, AVR::R15, AVR::R16, AVR::R17, AVR::R18, AVR::R19, AVR::R20,
+  AVR::R21, AVR::R22, AVR::R23, AVR::R24, AVR::R25, AVR::R26, AVR::R27,
+  AVR::R28, AVR::R29, AVR::R30, AVR::R31
+};
+
+// Register pairs, after the number of their low register.
+static const unsigned GR16DecoderTable[] = {
+  AVR::R1W,  AVR::R3W,   AVR::R5W,   AVR::R7W,
+  AVR::R9W,  AVR::R11W,  AVR::R13W,  AVR::R15W,
+  AVR::R17W, AVR::R19W,  AVR::R21W,  AVR::R23W,
+  AVR::R25W, AVR::X,     AVR::Y,     AVR::Z
+};
+
+// The pairs of ADIW and SBIW, after their number less 24.
+static const unsigned IWR16DecoderTable[] = {
+  AVR::R25W, AVR::X, AVR::Y, AVR::Z
+};
+
+static DecodeStatus DecodeGR8RegisterClass(MCInst &Inst, unsigned RegNo,
+                                           uint64_t Address,
+                                           const void *Decoder) {
+  if (RegNo > 31)
+    return MCDisassembler::Fail;
+
+  Inst.addOperand(MCOperand::CreateReg(GR8DecoderTable[RegNo]));
+  return MCDisassembler::Success;
+}
+
+/// DecodeIGR8RegisterClass - The four bit register fields of the
+/// instructions that take a constant only reach R16 to R31.
+static DecodeStatus DecodeIGR8RegisterClass(MCInst &Inst, unsigned RegNo,
+                                            uint64_t Address,
+                                            const void *Decoder) {
+  if (RegNo > 15)
+    return MCDisassembler::Fail;
+
+  return DecodeGR8RegisterClass(Inst, RegNo + 16, Address, Decoder);
+}
+
+/// DecodeMGR8RegisterClass - The three bit register fields of MULSU and
+/// the fractional multiplies, R16 to R23.
+static DecodeStatus DecodeMGR8RegisterClass(MCInst &Inst, unsigned RegNo,
+                                            uint64_t Address,
+                                            const void *Decoder) {
+  if (RegNo > 7)
+    return MCDisassembler::Fail;
+
+  return DecodeGR8RegisterClass(Inst, RegNo + 16, Address, Decoder);
+}
+
+static DecodeStatus DecodeGR16RegisterClass(MCInst &Inst, unsigned RegNo,
+                                            uint64_t Address,
+                                            const void *Decoder) {
+  if (RegNo > 30 || (RegNo & 1))
+    return MCDisassembler::Fail;
+
+  Inst.addOperand(MCOperand::CreateReg(GR16DecoderTable[RegNo >> 1]));
+  return MCDisassembler::Success;
+}
+
+static DecodeStatus DecodeIWR16RegisterClass(MCInst &Inst, unsigned RegNo,
+                                             uint64_t Address,
+                                             const void *Decoder) {
+  if (RegNo > 6 || (RegNo & 1))
+    return MCDisassembler::Fail;
+
+  Inst.addOperand(MCOperand::CreateReg(IWR16DecoderTable[RegNo >> 1]));
+  return MCDisassembler::Success;
+}
+
+/// decodeMemri - The Y bit and the displacement of LDD and STD, see
+/// AVRMCCodeEmitter::encodeMemri.
+static DecodeStatus decodeMemri(MCInst &Inst, unsigned Insn,
+                                uint64_t Address, const void *Decoder) {
+  Inst.addOperand(MCOperand::CreateReg((Insn & 0x40) ? AVR::Y : AVR::Z));
+  Inst.addOperand(MCOperand::CreateImm(Insn & 0x3f));
+  return MCDisassembler::Success;
+}
+
+/// decodeRelCondBrTarget - Branch offsets are kept in bytes from the next
+/// instruction, as in "brne .+4".
+static DecodeStatus decodeRelCondBrTarget(MCInst &Inst, unsigned Insn,
+                                          uint64_t Address,
+                                          const void *Decoder) {
+  int64_t Offset = (Insn & 0x40) ? int64_t(Insn) - 0x80 : Insn;
+  Inst.addOperand(MCOperand::CreateImm(Offset * 2));
+  return MCDisassembler::Success;
+}
+
+static DecodeStatus decodeRelJmpTarget(MCInst &Inst, unsigned Insn,
+                                       uint64_t Address, const void *Decoder) {
+  int64_t Offset = (Insn & 0x800) ? int64_t(Insn) - 0x1000 : Insn;
+  Inst.addOperand(MCOperand::CreateImm(Offset * 2));
+  return MCDisassembler::Success;
+}
+
+/// decodeCallTarget - JMP and CALL hold the word address, which is shown
+/// as the byte address, as avr-objdump does.
+static DecodeStatus decodeCallTarget(MCInst &Inst, unsigned Insn,
+                                     uint64_t Address, const void *Decoder) {
+  Inst.addOperand(MCOperand::CreateImm(int64_t(Insn) * 2));
+  return MCDisassembler::Success;
+}
+
+/// decodeCondCode - The inverse of AVRMCCodeEmitter::encodeCondCode.
+static DecodeStatus decodeCondCode(MCInst &Inst, unsigned Insn,
+                                   uint64_t Address, const void *Decoder) {
+  static const AVRCC::CondCodes CondCodes[] = {
+    AVRCC::COND_LO, AVRCC::COND_E,   AVRCC::COND_MI, AVRCC::COND_VS,
+    AVRCC::COND_L,  AVRCC::COND_HCS, AVRCC::COND_TS, AVRCC::COND_IE,
+    AVRCC::COND_HS, AVRCC::COND_NE,  AVRCC::COND_PL, AVRCC::COND_VC,
+    AVRCC::COND_GE, AVRCC::COND_HCC, AVRCC::COND_TC, AVRCC::COND_ID
+  };
+
+  Inst.addOperand(MCOperand::CreateImm(CondCodes[Insn & 0xf]));
+  return MCDisassembler::Success;
+}
+
+/// decodeLoadProgram - LPM and ELPM into a register. Z is not in the
+/// encoding, and the post-increment ones have it twice, written and read.
+static DecodeStatus decodeLoadProgram(MCInst &Inst, unsigned Insn,
+                                      uint64_t Address, const void *Decoder) {
+  if (DecodeGR8RegisterClass(Inst, (Insn >> 4) & 0x1f, Address, Decoder) ==
+      MCDisassembler::Fail)
+    return MCDisassembler::Fail;
+
+  if (Inst.getOpcode() == AVR::LPM8rz_P || Inst.getOpcode() == AVR::ELPM8rz_P)
+    Inst.addOperand(MCOperand::CreateReg(AVR::Z));
+  Inst.addOperand(MCOperand::CreateReg(AVR::Z));
+  return MCDisassembler::Success;
+}
+
+/// decodeLoadStore - LD and ST through X, and the ones moving Y or Z along:
+/// 1001 00sd dddd ppmm. The plain accesses through Y and Z are LDD and STD
+/// with no displacement, and never get here. What is left of the group is
+/// LPM, POP, PUSH and the first word of LDS and STS, which are not LD or ST.
+static DecodeStatus decodeLoadStore(MCInst &Inst, unsigned Insn,
+                                    uint64_t Address, const void *Decoder) {
+  if (!(Insn & 0x1000))
+    return MCDisassembler::Fail;
+
+  unsigned Ptr;
+  switch ((Insn >> 2) & 0x3) {
+  case 0x3: Ptr = AVR::X; break;
+  case 0x2: Ptr = AVR::Y; break;
+  case 0x0: Ptr = AVR::Z; break;
+  default: return MCDisassembler::Fail;
+  }
+
+  // Only X has a plain access in this group.
+  bool MovesPtr = Insn & 0x3;
+  if (!MovesPtr && Ptr != AVR::X)
+    return MCDisassembler::Fail;
+
+  MCOperand Reg = MCOperand::CreateReg(GR8DecoderTable[(Insn >> 4) & 0x1f]);
+  MCOperand PtrReg = MCOperand::CreateReg(Ptr);
+
+  // Loads have the pointer after the loaded register, stores before the
+  // stored one. The pointer of the ones that move it is written back too.
+  bool IsStore = Insn & 0x200;
+  if (!IsStore)
+    Inst.addOperand(Reg);
+  if (MovesPtr)
+    Inst.addOperand(PtrReg);
+  Inst.addOperand(PtrReg);
+  if (IsStore)
+    Inst.addOperand(Reg);
+  return MCDisassembler::Success;
+}
+
+#include "AVRGenDisassemblerTables.inc"
+
+DecodeStatus AVRDisassembler::getInstruction(MCInst &Instr, uint64_t &Size,
+                                             const MemoryObject &Region,
+                                             uint64_t Address,
+                                             raw_ostream &VStream,
+                                             raw_ostream &CStream) const {
+  uint8_t Bytes[4];
+
+  // Program memory is made of little endian words.
+  if (Region.readBytes(Address, 2, Bytes, NULL) == -1) {
+    Size = 0;
+    return MCDisassembler::Fail;
+  }
+  uint16_t Insn16 = (Bytes[1] << 8) | Bytes[0];
+  Size = 2;
+
+  // LPM into R0 is only ever made by the code generator, and has no place
+  // in the tables.
+  if (Insn16 == 0x95c8) {
+    Instr.setOpcode(AVR::LPM);
+    Instr.addOperand(MCOperand::CreateReg(AVR::Z));
+    return MCDisassembler::Success;
+  }
+
+  DecodeStatus Result = decodeAVRInstruction16(Instr, Insn16, Address, this,
+                                               STI);
+  if (Result != MCDisassembler::Fail)
+    return Result;
+
+  Instr.clear();
+  Result = decodeLoadStoreInstruction16(Instr, Insn16, Address, this, STI);
+  if (Result != MCDisassembler::Fail)
+    return Result;
+
+  // The first word is in the upper half of two word instructions.
+  Instr.clear();
+  if (Region.readBytes(Address + 2, 2, Bytes + 2, NULL) == -1)
+    return MCDisassembler::Fail;
+  uint32_t Insn32 = (uint32_t(Insn16) << 16) | (Bytes[3] << 8) | Bytes[2];
+
+  Result = decodeAVRInstruction32(Instr, Insn32, Address, this, STI);
+  if (Result != MCDisassembler::Fail) {
+    Size = 4;
+    return Result;
+  }
+
+  Instr.clear();
+  return MCDisassembler::Fail;
+}
+
+EDInstInfo *AVRDisassembler::getEDInfo() const {
+  return instInfoAVR;
+}
+
+static MCDisassembler *createAVRDisassembler(const Target &T,
+                                             const MCSubtargetInfo &STI) {
+  return new AVRDisassembler(STI);
+}
+
+extern "C" void LLVMInitializeAVRDisassembler() {
+  // Register the disassembler.
+  TargetRegistry::RegisterMCDisassembler(TheAVRTarget,
+                                         createAVRDisassembler);
+}
@@ -34,9 +34,14 @@ void AVRInstPrinter::printInst(const MCInst *MI, raw_ostream &O,
 void AVRInstPrinter::printPCRelImmOperand(const MCInst *MI, unsigned OpNo,
                                              raw_ostream &O) {
   const MCOperand &Op = MI->getOperand(OpNo);
-  if (Op.isImm())
-    O << Op.getImm();
-  else {
+  if (Op.isImm()) {
+    // Offsets relative to the branch, as in "brne .+2".
+    int64_t Imm = Op.getImm();
+    O << '.';
+    if (Imm >= 0)
+      O << '+';
+    O << Imm;
+  } else {
     assert(Op.isExpr() && "unknown pcrel immediate operand");
     O << *Op.getExpr();
   }
@@ -101,7 +106,7 @@ void AVRInstPrinter::printCCOperand(const MCInst *MI, unsigned OpNo,
    O << "ne";
    break;
   case AVRCC::COND_HS:
-   O << "hs";
+   O << "sh";
    break;
   case AVRCC::COND_LO:
    O << "lo";
@@ -110,7 +115,37 @@ void AVRInstPrinter::printCCOperand(const MCInst *MI, unsigned OpNo,
    O << "ge";
    break;
   case AVRCC::COND_L:
-   O << 'l';
+   O << "lt";
+   break;
+  case AVRCC::COND_MI:
+   O << "mi";
+   break;
+  case AVRCC::COND_PL:
+   O << "pl";
+   break;
+  case AVRCC::COND_VS:
+   O << "vs";
+   break;
+  case AVRCC::COND_VC:
+   O << "vc";
+   break;
+  case AVRCC::COND_TS:
+   O << "ts";
+   break;
+  case AVRCC::COND_TC:
+   O << "tc";
+   break;
+  case AVRCC::COND_HCS:
+   O << "hs";
+   break;
+  case AVRCC::COND_HCC:
+   O << "hc";
+   break;
+  case AVRCC::COND_IE:
+   O << "ie";
+   break;
+  case AVRCC::COND_ID:
+   O << "id";
    break;
   }
 }
@@ -0,0 +1,186 @@
+//===-- AVRAsmBackend.cpp - AVR Assembler Backend -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the AVRAsmBackend class, which resolves the fixups
+// the code emitter leaves in the words of an instruction.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/AVRMCTargetDesc.h"
+#include "MCTargetDesc/AVRFixupKinds.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCFixupKindInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+namespace {
+class AVRAsmBackend : public MCAsmBackend {
+  uint8_t OSABI;
+
+  // The fixups left to a relocation. Their addend goes into the relocation,
+  // so applyFixup leaves their field zero for the linker to fill in.
+  mutable SmallPtrSet<const MCFixup *, 16> Unresolved;
+
+public:
+  AVRAsmBackend(uint8_t OSABI) : MCAsmBackend(), OSABI(OSABI) {}
+
+  MCObjectWriter *createObjectWriter(raw_ostream &OS) const {
+    return createAVRELFObjectWriter(OS, OSABI);
+  }
+
+  unsigned getNumFixupKinds() const { return AVR::NumTargetFixupKinds; }
+
+  const MCFixupKindInfo &getFixupKindInfo(MCFixupKind Kind) const {
+    const static MCFixupKindInfo Infos[AVR::NumTargetFixupKinds] = {
+      // This table *must* be in the order that the fixup_* kinds are defined
+      // in AVRFixupKinds.h.
+      //
+      // name                 offset  bits  flags
+      { "fixup_7_pcrel",        3,     7,   MCFixupKindInfo::FKF_IsPCRel },
+      { "fixup_13_pcrel",       0,    12,   MCFixupKindInfo::FKF_IsPCRel },
+      { "fixup_16",             0,    16,   0 },
+      { "fixup_lo8_ldi",        0,     8,   0 },
+      { "fixup_hi8_ldi",        0,     8,   0 },
+      { "fixup_lo8_ldi_pm",     0,     8,   0 },
+      { "fixup_hi8_ldi_pm",     0,     8,   0 },
+      { "fixup_call",           0,    22,   0 }
+    };
+
+    if (Kind < FirstTargetFixupKind)
+      return MCAsmBackend::getFixupKindInfo(Kind);
+
+    assert(unsigned(Kind - FirstTargetFixupKind) < getNumFixupKinds() &&
+           "Invalid kind!");
+    return Infos[Kind - FirstTargetFixupKind];
+  }
+
+  void processFixupValue(const MCAssembler &Asm, const MCAsmLayout &Layout,
+                         const MCFixup &Fixup, const MCFragment *DF,
+                         MCValue &Target, uint64_t &Value,
+                         bool &IsResolved) {
+    if (IsResolved)
+      Unresolved.erase(&Fixup);
+    else
+      Unresolved.insert(&Fixup);
+  }
+
+  void applyFixup(const MCFixup &Fixup, char *Data, unsigned DataSize,
+                  uint64_t Value) const;
+
+  // The branch selector has already picked branches that reach, so nothing
+  // is ever relaxed.
+  bool mayNeedRelaxation(const MCInst &Inst) const { return false; }
+
+  bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                            const MCInstFragment *DF,
+                            const MCAsmLayout &Layout) const {
+    return false;
+  }
+
+  void relaxInstruction(const MCInst &Inst, MCInst &Res) const {
+    llvm_unreachable("AVR instructions are not relaxed!");
+  }
+
+  /// writeNopData - NOP is the zero word.
+  bool writeNopData(uint64_t Count, MCObjectWriter *OW) const {
+    if (Count % 2)
+      return false;
+    for (uint64_t i = 0; i != Count; i += 2)
+      OW->Write16(0);
+    return true;
+  }
+};
+} // end anonymous namespace
+
+/// adjustPCRelWord - A PC relative fixup is resolved to the distance from the
+/// start of the instruction in bytes, while the branch counts the words from
+/// the instruction after it.
+static int64_t adjustPCRelWord(uint64_t Value, unsigned Bits) {
+  int64_t Offset = (int64_t(Value) - 2) >> 1;
+  if (Offset < -(1LL << (Bits - 1)) || Offset >= (1LL << (Bits - 1)))
+    report_fatal_error("branch target out of range");
+  return Offset & ((1LL << Bits) - 1);
+}
+
+/// applyWord - Or Bits into the little endian word at Data.
+static void applyWord(char *Data, unsigned Bits) {
+  Data[0] |= uint8_t(Bits & 0xff);
+  Data[1] |= uint8_t((Bits >> 8) & 0xff);
+}
+
+/// applyLDIByte - Spread the byte over the two nibbles of the constant of
+/// LDI: 1110 KKKK dddd KKKK.
+static void applyLDIByte(char *Data, unsigned Byte) {
+  applyWord(Data, ((Byte & 0xf0) << 4) | (Byte & 0x0f));
+}
+
+void AVRAsmBackend::applyFixup(const MCFixup &Fixup, char *Data,
+                               unsigned DataSize, uint64_t Value) const {
+  unsigned Offset = Fixup.getOffset();
+  assert(Offset + 2 <= DataSize && "Invalid fixup offset!");
+  Data += Offset;
+
+  // Value is only the addend of a relocation, which the RELA entry already
+  // carries. Put into a PC relative field it would not even be right.
+  if (Unresolved.erase(&Fixup))
+    return;
+
+  switch ((unsigned)Fixup.getKind()) {
+  default: llvm_unreachable("Unknown fixup kind!");
+  case FK_Data_1:
+    Data[0] = uint8_t(Value);
+    break;
+  case FK_Data_2:
+  case AVR::fixup_16:
+    Data[0] = uint8_t(Value);
+    Data[1] = uint8_t(Value >> 8);
+    break;
+  case FK_Data_4:
+    for (unsigned i = 0; i != 4; ++i)
+      Data[i] = uint8_t(Value >> (i * 8));
+    break;
+  case AVR::fixup_7_pcrel:
+    applyWord(Data, adjustPCRelWord(Value, 7) << 3);
+    break;
+  case AVR::fixup_13_pcrel:
+    applyWord(Data, adjustPCRelWord(Value, 12));
+    break;
+  case AVR::fixup_lo8_ldi:
+    applyLDIByte(Data, Value & 0xff);
+    break;
+  case AVR::fixup_hi8_ldi:
+    applyLDIByte(Data, (Value >> 8) & 0xff);
+    break;
+  case AVR::fixup_lo8_ldi_pm:
+    applyLDIByte(Data, (Value >> 1) & 0xff);
+    break;
+  case AVR::fixup_hi8_ldi_pm:
+    applyLDIByte(Data, (Value >> 9) & 0xff);
+    break;
+  case AVR::fixup_call: {
+    // 1001 010k kkkk 11ck kkkk kkkk kkkk kkkk, of the word address.
+    uint64_t Word = Value >> 1;
+    if (Word >= (1 << 22))
+      report_fatal_error("call target out of range");
+    applyWord(Data, (((Word >> 17) & 0x1f) << 4) | ((Word >> 16) & 1));
+    applyWord(Data + 2, Word & 0xffff);
+    break;
+  }
+  }
+}
+
+MCAsmBackend *llvm::createAVRAsmBackend(const Target &T, StringRef TT) {
+  // avr-gcc and avr-libc use the System V ABI number.
+  return new AVRAsmBackend(ELF::ELFOSABI_NONE);
+}
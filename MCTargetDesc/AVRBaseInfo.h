@@ -0,0 +1,98 @@
+//===-- AVRBaseInfo.h - Top level definitions for AVR MC --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains small standalone helper functions and enum definitions
+// for the AVR target useful for the compiler back-end and the MC libraries.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AVRBASEINFO_H
+#define AVRBASEINFO_H
+
+#include "AVRMCTargetDesc.h"
+#include "llvm/Support/ErrorHandling.h"
+
+namespace llvm {
+
+/// AVRII - This namespace holds all of the target specific flags that
+/// instruction info tracks.
+///
+namespace AVRII {
+  enum {
+    SizeShift   = 0,
+    SizeMask    = 7 << SizeShift,
+
+    SizeUnknown = 0 << SizeShift,
+    SizeSpecial = 1 << SizeShift,
+    Size2Bytes  = 2 << SizeShift,
+    Size4Bytes  = 3 << SizeShift,
+    Size6Bytes  = 4 << SizeShift
+  };
+
+  /// Target operand flags, on the address operands of LDI.
+  enum TOF {
+    MO_NO_FLAG,
+
+    /// MO_LO8 - The low byte of the address, lo8(sym).
+    MO_LO8,
+
+    /// MO_HI8 - The high byte of the address, hi8(sym).
+    MO_HI8
+  };
+}
+
+/// getAVRRegisterNumbering - Given the enum value for some register, return
+/// the number that goes into the encoding of an instruction. A register pair
+/// is numbered after its low register, and the I/O registers after their
+/// address in the I/O space.
+inline static unsigned getAVRRegisterNumbering(unsigned RegEnum) {
+  switch (RegEnum) {
+  case AVR::R0:  case AVR::R1W:  return 0;
+  case AVR::R1:  return 1;
+  case AVR::R2:  case AVR::R3W:  return 2;
+  case AVR::R3:  return 3;
+  case AVR::R4:  case AVR::R5W:  return 4;
+  case AVR::R5:  return 5;
+  case AVR::R6:  case AVR::R7W:  return 6;
+  case AVR::R7:  return 7;
+  case AVR::R8:  case AVR::R9W:  return 8;
+  case AVR::R9:  return 9;
+  case AVR::R10: case AVR::R11W: return 10;
+  case AVR::R11: return 11;
+  case AVR::R12: case AVR::R13W: return 12;
+  case AVR::R13: return 13;
+  case AVR::R14: case AVR::R15W: return 14;
+  case AVR::R15: return 15;
+  case AVR::R16: case AVR::R17W: return 16;
+  case AVR::R17: return 17;
+  case AVR::R18: case AVR::R19W: return 18;
+  case AVR::R19: return 19;
+  case AVR::R20: case AVR::R21W: return 20;
+  case AVR::R21: return 21;
+  case AVR::R22: case AVR::R23W: return 22;
+  case AVR::R23: return 23;
+  case AVR::R24: case AVR::R25W: return 24;
+  case AVR::R25: return 25;
+  case AVR::R26: case AVR::X:    return 26;
+  case AVR::R27: return 27;
+  case AVR::R28: case AVR::Y:    return 28;
+  case AVR::R29: return 29;
+  case AVR::R30: case AVR::Z:    return 30;
+  case AVR::R31: return 31;
+  case AVR::RAMPZ: return 0x3b;
+  case AVR::SPL:   return 0x3d;
+  case AVR::SPH:   return 0x3e;
+  case AVR::SREG:  return 0x3f;
+  default: llvm_unreachable("Unknown register number!");
+  }
+}
+
+} // end namespace llvm
+
+#endif
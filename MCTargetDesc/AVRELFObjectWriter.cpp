@@ -0,0 +1,79 @@
+//===-- AVRELFObjectWriter.cpp - AVR ELF Writer ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/AVRMCTargetDesc.h"
+#include "MCTargetDesc/AVRFixupKinds.h"
+#include "llvm/MC/MCELFObjectWriter.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/Support/ErrorHandling.h"
+using namespace llvm;
+
+namespace {
+  // The relocations of the AVR ELF ABI, as numbered by avr binutils. Only the
+  // ones the code emitter makes are listed.
+  enum {
+    R_AVR_NONE       = 0,
+    R_AVR_32         = 1,
+    R_AVR_7_PCREL    = 2,
+    R_AVR_13_PCREL   = 3,
+    R_AVR_16         = 4,
+    R_AVR_LO8_LDI    = 6,
+    R_AVR_HI8_LDI    = 7,
+    R_AVR_LO8_LDI_PM = 12,
+    R_AVR_HI8_LDI_PM = 13,
+    R_AVR_CALL       = 18,
+    R_AVR_8          = 26
+  };
+
+  class AVRELFObjectWriter : public MCELFObjectTargetWriter {
+  public:
+    AVRELFObjectWriter(uint8_t OSABI);
+
+    virtual ~AVRELFObjectWriter();
+  protected:
+    virtual unsigned GetRelocType(const MCValue &Target, const MCFixup &Fixup,
+                                  bool IsPCRel, bool IsRelocWithSymbol,
+                                  int64_t Addend) const;
+  };
+}
+
+AVRELFObjectWriter::AVRELFObjectWriter(uint8_t OSABI)
+  : MCELFObjectTargetWriter(/*Is64Bit*/ false, OSABI, ELF::EM_AVR,
+                            /*HasRelocationAddend*/ true) {}
+
+AVRELFObjectWriter::~AVRELFObjectWriter() {}
+
+unsigned AVRELFObjectWriter::GetRelocType(const MCValue &Target,
+                                          const MCFixup &Fixup,
+                                          bool IsPCRel,
+                                          bool IsRelocWithSymbol,
+                                          int64_t Addend) const {
+  switch ((unsigned)Fixup.getKind()) {
+  default: llvm_unreachable("invalid fixup kind!");
+  case FK_Data_1:             return R_AVR_8;
+  case FK_Data_2:             return R_AVR_16;
+  case FK_Data_4:             return R_AVR_32;
+  case AVR::fixup_7_pcrel:    return R_AVR_7_PCREL;
+  case AVR::fixup_13_pcrel:   return R_AVR_13_PCREL;
+  case AVR::fixup_16:         return R_AVR_16;
+  case AVR::fixup_lo8_ldi:    return R_AVR_LO8_LDI;
+  case AVR::fixup_hi8_ldi:    return R_AVR_HI8_LDI;
+  case AVR::fixup_lo8_ldi_pm: return R_AVR_LO8_LDI_PM;
+  case AVR::fixup_hi8_ldi_pm: return R_AVR_HI8_LDI_PM;
+  case AVR::fixup_call:       return R_AVR_CALL;
+  }
+}
+
+MCObjectWriter *llvm::createAVRELFObjectWriter(raw_ostream &OS,
+                                               uint8_t OSABI) {
+  MCELFObjectTargetWriter *MOTW = new AVRELFObjectWriter(OSABI);
+  return createELFObjectWriter(MOTW, OS, /*IsLittleEndian*/ true);
+}
@@ -0,0 +1,47 @@
+//===-- AVRFixupKinds.h - AVR Specific Fixup Entries ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_AVR_AVRFIXUPKINDS_H
+#define LLVM_AVR_AVRFIXUPKINDS_H
+
+#include "llvm/MC/MCFixup.h"
+
+namespace llvm {
+namespace AVR {
+  // Each of these has a relocation of the same name in the AVR ELF ABI,
+  // see AVRELFObjectWriter.cpp.
+  enum Fixups {
+    // Word offset of a conditional branch, 7 bits, BRxx.
+    fixup_7_pcrel = FirstTargetFixupKind,
+
+    // Word offset of RJMP and RCALL, 12 bits.
+    fixup_13_pcrel,
+
+    // A 16-bit data address, the second word of LDS and STS.
+    fixup_16,
+
+    // The bytes of a data address, in the constant of LDI.
+    fixup_lo8_ldi,
+    fixup_hi8_ldi,
+
+    // The bytes of the word address of a function, pm_lo8 and pm_hi8.
+    fixup_lo8_ldi_pm,
+    fixup_hi8_ldi_pm,
+
+    // The 22-bit word address of JMP and CALL.
+    fixup_call,
+
+    // Marker
+    LastTargetFixupKind,
+    NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
+  };
+} // end namespace AVR
+} // end namespace llvm
+
+#endif
@@ -23,6 +23,7 @@ AVRMCAsmInfo::AVRMCAsmInfo(const Target &T, StringRef TT) {
   WeakRefDirective ="\t.weak\t";
   PCSymbol=".";
   CommentString = ";";
+  SeparatorString = "$";
 
   AlignmentIsInBytes = false;
   AllowNameToStartWithDigit = true;
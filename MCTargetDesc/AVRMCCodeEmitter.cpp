@@ -0,0 +1,281 @@
+//===-- AVRMCCodeEmitter.cpp - Convert AVR code to machine code -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the AVRMCCodeEmitter class, which turns an MCInst into
+// the words of program memory it is made of.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "mccodeemitter"
+#include "AVR.h"
+#include "MCTargetDesc/AVRBaseInfo.h"
+#include "MCTargetDesc/AVRFixupKinds.h"
+#include "MCTargetDesc/AVRMCExpr.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+STATISTIC(MCNumEmitted, "Number of MC instructions emitted");
+
+namespace {
+class AVRMCCodeEmitter : public MCCodeEmitter {
+  AVRMCCodeEmitter(const AVRMCCodeEmitter &); // DO NOT IMPLEMENT
+  void operator=(const AVRMCCodeEmitter &); // DO NOT IMPLEMENT
+  const MCInstrInfo &MCII;
+  const MCSubtargetInfo &STI;
+  MCContext &Ctx;
+
+public:
+  AVRMCCodeEmitter(const MCInstrInfo &mcii, const MCSubtargetInfo &sti,
+                   MCContext &ctx)
+    : MCII(mcii), STI(sti), Ctx(ctx) {}
+
+  ~AVRMCCodeEmitter() {}
+
+  /// EmitWord - Program memory is made of little endian words.
+  void EmitWord(unsigned Val, raw_ostream &OS) const {
+    OS << (char)(Val & 0xff);
+    OS << (char)((Val >> 8) & 0xff);
+  }
+
+  void EncodeInstruction(const MCInst &MI, raw_ostream &OS,
+                         SmallVectorImpl<MCFixup> &Fixups) const;
+
+  // getBinaryCodeForInstr - TableGen'erated function for getting the
+  // binary encoding for an instruction.
+  uint64_t getBinaryCodeForInstr(const MCInst &MI,
+                                 SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// getMachineOpValue - Return binary encoding of operand. If the machine
+  /// operand requires relocation, record the relocation and return zero.
+  unsigned getMachineOpValue(const MCInst &MI, const MCOperand &MO,
+                             SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeMemri - The pointer register and displacement of LDD and STD, as
+  /// the Y bit followed by the six bits of the displacement.
+  unsigned encodeMemri(const MCInst &MI, unsigned OpNo,
+                       SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeRelCondBrTarget - The word offset of a conditional branch. An
+  /// immediate target is a byte offset, as in "brne .+4".
+  unsigned encodeRelCondBrTarget(const MCInst &MI, unsigned OpNo,
+                                 SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeRelJmpTarget - The word offset of RJMP and RCALL.
+  unsigned encodeRelJmpTarget(const MCInst &MI, unsigned OpNo,
+                              SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeCallTarget - The word address of JMP and CALL.
+  unsigned encodeCallTarget(const MCInst &MI, unsigned OpNo,
+                            SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeAddr16 - The data address of LDS and STS, in the second word.
+  unsigned encodeAddr16(const MCInst &MI, unsigned OpNo,
+                        SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// encodeCondCode - A condition as the branch-if-cleared bit followed by
+  /// the number of the flag in SREG.
+  unsigned encodeCondCode(const MCInst &MI, unsigned OpNo,
+                          SmallVectorImpl<MCFixup> &Fixups) const;
+
+  /// loadStorePostEncoder - Put in which pointer register LD or ST goes
+  /// through.
+  unsigned loadStorePostEncoder(const MCInst &MI, unsigned EncodedValue) const;
+
+private:
+  unsigned encodeRelTarget(const MCInst &MI, unsigned OpNo, unsigned Bits,
+                           AVR::Fixups Kind,
+                           SmallVectorImpl<MCFixup> &Fixups) const;
+}; // class AVRMCCodeEmitter
+}  // namespace
+
+MCCodeEmitter *llvm::createAVRMCCodeEmitter(const MCInstrInfo &MCII,
+                                            const MCSubtargetInfo &STI,
+                                            MCContext &Ctx) {
+  return new AVRMCCodeEmitter(MCII, STI, Ctx);
+}
+
+/// EncodeInstruction - Emit the instruction. Instructions of two words have
+/// the first one in the upper half of the encoding.
+void AVRMCCodeEmitter::
+EncodeInstruction(const MCInst &MI, raw_ostream &OS,
+                  SmallVectorImpl<MCFixup> &Fixups) const {
+  const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+  uint64_t Binary = getBinaryCodeForInstr(MI, Fixups);
+
+  switch (Desc.TSFlags & AVRII::SizeMask) {
+  default: llvm_unreachable("Unknown size of instruction!");
+  case AVRII::SizeSpecial:
+    llvm_unreachable("Pseudo instruction reached the code emitter!");
+  case AVRII::Size2Bytes:
+    EmitWord(Binary, OS);
+    break;
+  case AVRII::Size4Bytes:
+    EmitWord(Binary >> 16, OS);
+    EmitWord(Binary, OS);
+    break;
+  }
+
+  ++MCNumEmitted;  // Keep track of the # of mi's emitted.
+}
+
+unsigned AVRMCCodeEmitter::
+getMachineOpValue(const MCInst &MI, const MCOperand &MO,
+                  SmallVectorImpl<MCFixup> &Fixups) const {
+  if (MO.isReg())
+    return getAVRRegisterNumbering(MO.getReg());
+  if (MO.isImm())
+    return static_cast<unsigned>(MO.getImm());
+
+  // The constant of LDI may be a byte of an address. A bare symbol is its
+  // low byte, as avr-as takes it.
+  assert(MO.isExpr() && "Unknown operand kind!");
+  const MCExpr *Expr = MO.getExpr();
+  if (!isa<AVRMCExpr>(Expr)) {
+    Fixups.push_back(MCFixup::Create(0, Expr,
+                                     MCFixupKind(AVR::fixup_lo8_ldi)));
+    return 0;
+  }
+
+  AVR::Fixups Kind;
+  switch (cast<AVRMCExpr>(Expr)->getKind()) {
+  default: llvm_unreachable("Unknown kind of expression!");
+  case AVRMCExpr::VK_AVR_LO8:    Kind = AVR::fixup_lo8_ldi; break;
+  case AVRMCExpr::VK_AVR_HI8:    Kind = AVR::fixup_hi8_ldi; break;
+  case AVRMCExpr::VK_AVR_PM_LO8: Kind = AVR::fixup_lo8_ldi_pm; break;
+  case AVRMCExpr::VK_AVR_PM_HI8: Kind = AVR::fixup_hi8_ldi_pm; break;
+  }
+
+  // The fixup picks the byte out of the symbol's value itself.
+  Fixups.push_back(MCFixup::Create(0, cast<AVRMCExpr>(Expr)->getSubExpr(),
+                                   MCFixupKind(Kind)));
+  return 0;
+}
+
+unsigned AVRMCCodeEmitter::
+encodeMemri(const MCInst &MI, unsigned OpNo,
+            SmallVectorImpl<MCFixup> &Fixups) const {
+  const MCOperand &Base = MI.getOperand(OpNo);
+  const MCOperand &Disp = MI.getOperand(OpNo+1);
+  assert(Disp.isImm() && "Expected an immediate displacement!");
+
+  unsigned IsY;
+  switch (Base.getReg()) {
+  default: llvm_unreachable("LDD and STD only go through Y and Z!");
+  case AVR::Y: IsY = 1; break;
+  case AVR::Z: IsY = 0; break;
+  }
+
+  assert(Disp.getImm() >= 0 && Disp.getImm() < 64 &&
+         "Displacement out of range!");
+  return (IsY << 6) | (Disp.getImm() & 0x3f);
+}
+
+unsigned AVRMCCodeEmitter::
+encodeRelTarget(const MCInst &MI, unsigned OpNo, unsigned Bits,
+                AVR::Fixups Kind, SmallVectorImpl<MCFixup> &Fixups) const {
+  const MCOperand &MO = MI.getOperand(OpNo);
+  if (MO.isImm())
+    return (MO.getImm() >> 1) & ((1U << Bits) - 1);
+
+  assert(MO.isExpr() && "Unknown branch target!");
+  Fixups.push_back(MCFixup::Create(0, MO.getExpr(), MCFixupKind(Kind)));
+  return 0;
+}
+
+unsigned AVRMCCodeEmitter::
+encodeRelCondBrTarget(const MCInst &MI, unsigned OpNo,
+                      SmallVectorImpl<MCFixup> &Fixups) const {
+  return encodeRelTarget(MI, OpNo, 7, AVR::fixup_7_pcrel, Fixups);
+}
+
+unsigned AVRMCCodeEmitter::
+encodeRelJmpTarget(const MCInst &MI, unsigned OpNo,
+                   SmallVectorImpl<MCFixup> &Fixups) const {
+  return encodeRelTarget(MI, OpNo, 12, AVR::fixup_13_pcrel, Fixups);
+}
+
+unsigned AVRMCCodeEmitter::
+encodeCallTarget(const MCInst &MI, unsigned OpNo,
+                 SmallVectorImpl<MCFixup> &Fixups) const {
+  const MCOperand &MO = MI.getOperand(OpNo);
+  if (MO.isImm())
+    return (MO.getImm() >> 1) & 0x3fffff;
+
+  assert(MO.isExpr() && "Unknown call target!");
+  Fixups.push_back(MCFixup::Create(0, MO.getExpr(),
+                                   MCFixupKind(AVR::fixup_call)));
+  return 0;
+}
+
+unsigned AVRMCCodeEmitter::
+encodeAddr16(const MCInst &MI, unsigned OpNo,
+             SmallVectorImpl<MCFixup> &Fixups) const {
+  const MCOperand &MO = MI.getOperand(OpNo);
+  if (MO.isImm())
+    return MO.getImm() & 0xffff;
+
+  assert(MO.isExpr() && "Unknown data address!");
+  Fixups.push_back(MCFixup::Create(2, MO.getExpr(),
+                                   MCFixupKind(AVR::fixup_16)));
+  return 0;
+}
+
+unsigned AVRMCCodeEmitter::
+encodeCondCode(const MCInst &MI, unsigned OpNo,
+               SmallVectorImpl<MCFixup> &Fixups) const {
+  // The flags are numbered C, Z, N, V, S, H, T and I.
+  switch (MI.getOperand(OpNo).getImm()) {
+  default: llvm_unreachable("Unknown condition code!");
+  case AVRCC::COND_LO:  return 0x0;
+  case AVRCC::COND_E:   return 0x1;
+  case AVRCC::COND_MI:  return 0x2;
+  case AVRCC::COND_VS:  return 0x3;
+  case AVRCC::COND_L:   return 0x4;
+  case AVRCC::COND_HCS: return 0x5;
+  case AVRCC::COND_TS:  return 0x6;
+  case AVRCC::COND_IE:  return 0x7;
+  case AVRCC::COND_HS:  return 0x8;
+  case AVRCC::COND_NE:  return 0x9;
+  case AVRCC::COND_PL:  return 0xa;
+  case AVRCC::COND_VC:  return 0xb;
+  case AVRCC::COND_GE:  return 0xc;
+  case AVRCC::COND_HCC: return 0xd;
+  case AVRCC::COND_TC:  return 0xe;
+  case AVRCC::COND_ID:  return 0xf;
+  }
+}
+
+unsigned AVRMCCodeEmitter::
+loadStorePostEncoder(const MCInst &MI, unsigned EncodedValue) const {
+  // Loads have the pointer after the loaded register, stores before the
+  // stored one.
+  bool IsStore = EncodedValue & (1 << 9);
+  unsigned Ptr = MI.getOperand(IsStore ? 0 : 1).getReg();
+
+  switch (Ptr) {
+  default: llvm_unreachable("LD and ST only go through X, Y and Z!");
+  case AVR::X: EncodedValue |= 0x100c; break;
+  case AVR::Y: EncodedValue |= 0x0008; break;
+  case AVR::Z: break;
+  }
+
+  // Post-increment and pre-decrement are in the 1001 group for Y and Z too.
+  if (EncodedValue & 0x3)
+    EncodedValue |= 0x1000;
+
+  return EncodedValue;
+}
+
+#include "AVRGenMCCodeEmitter.inc"
@@ -0,0 +1,82 @@
+//===-- AVRMCExpr.h - AVR specific MC expression classes --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the expressions for the bytes of an address, which LDI
+// loads one at a time.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AVRMCEXPR_H
+#define AVRMCEXPR_H
+
+#include "llvm/MC/MCExpr.h"
+
+namespace llvm {
+
+class AVRMCExpr : public MCTargetExpr {
+public:
+  enum VariantKind {
+    VK_AVR_None,
+    VK_AVR_LO8,    // lo8(expr), bits 0-7
+    VK_AVR_HI8,    // hi8(expr), bits 8-15
+    VK_AVR_PM_LO8, // pm_lo8(expr), bits 1-8, the word address of code
+    VK_AVR_PM_HI8  // pm_hi8(expr), bits 9-16
+  };
+
+private:
+  const VariantKind Kind;
+  const MCExpr *Expr;
+
+  explicit AVRMCExpr(VariantKind Kind, const MCExpr *Expr)
+    : Kind(Kind), Expr(Expr) {}
+
+public:
+  static const AVRMCExpr *Create(VariantKind Kind, const MCExpr *Expr,
+                                 MCContext &Ctx);
+
+  static const AVRMCExpr *CreateLo8(const MCExpr *Expr, MCContext &Ctx) {
+    return Create(VK_AVR_LO8, Expr, Ctx);
+  }
+
+  static const AVRMCExpr *CreateHi8(const MCExpr *Expr, MCContext &Ctx) {
+    return Create(VK_AVR_HI8, Expr, Ctx);
+  }
+
+  static const AVRMCExpr *CreatePMLo8(const MCExpr *Expr, MCContext &Ctx) {
+    return Create(VK_AVR_PM_LO8, Expr, Ctx);
+  }
+
+  static const AVRMCExpr *CreatePMHi8(const MCExpr *Expr, MCContext &Ctx) {
+    return Create(VK_AVR_PM_HI8, Expr, Ctx);
+  }
+
+  /// getKind - Get the kind of this expression.
+  VariantKind getKind() const { return Kind; }
+
+  /// getSubExpr - Get the child of this expression.
+  const MCExpr *getSubExpr() const { return Expr; }
+
+  void PrintImpl(raw_ostream &OS) const;
+  bool EvaluateAsRelocatableImpl(MCValue &Res,
+                                 const MCAsmLayout *Layout) const;
+  void AddValueSymbols(MCAssembler *) const;
+  const MCSection *FindAssociatedSection() const {
+    return getSubExpr()->FindAssociatedSection();
+  }
+
+  static bool classof(const MCExpr *E) {
+    return E->getKind() == MCExpr::Target;
+  }
+
+  static bool classof(const AVRMCExpr *) { return true; }
+};
+
+} // end namespace llvm
+
+#endif
@@ -14,13 +14,29 @@
 #ifndef AVRMCTARGETDESC_H
 #define AVRMCTARGETDESC_H
 
+#include "llvm/Support/DataTypes.h"
+
 namespace llvm {
+class MCAsmBackend;
+class MCCodeEmitter;
+class MCContext;
+class MCInstrInfo;
+class MCObjectWriter;
 class MCSubtargetInfo;
 class Target;
 class StringRef;
+class raw_ostream;
 
 extern Target TheAVRTarget;
 
+MCCodeEmitter *createAVRMCCodeEmitter(const MCInstrInfo &MCII,
+                                      const MCSubtargetInfo &STI,
+                                      MCContext &Ctx);
+
+MCAsmBackend *createAVRAsmBackend(const Target &T, StringRef TT);
+
+MCObjectWriter *createAVRELFObjectWriter(raw_ostream &OS, uint8_t OSABI);
+
 } // End llvm namespace
 
 // Defines symbolic names for AVR registers.
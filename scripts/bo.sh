@@ -0,0 +1,12 @@
+clear
+echo "Source"
+echo "------"
+cat $1
+echo "------"
+rm test.o
+~/Code/llvm/Debug+Asserts/bin/llc -march=avr -mtriple=avr $1 -o test.o -filetype=obj -disable-fp-elim
+echo "Disassembly"
+echo "----------"
+echo llvm-objdump -d -r test.o
+~/Code/llvm/Debug+Asserts/bin/llvm-objdump -d -r test.o
+echo "----------"
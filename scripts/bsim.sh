@@ -0,0 +1,12 @@
+clear
+echo "Source"
+echo "------"
+cat $1
+echo "------"
+rm test.o
+~/Code/llvm/Debug+Asserts/bin/llc -march=avr -mtriple=avr $1 -o test.o -filetype=obj -mcpu=avr5
+echo "Simulation"
+echo "----------"
+echo avr-sim -mcpu=avr5 -histogram test.o
+~/Code/llvm/Debug+Asserts/bin/avr-sim -mcpu=avr5 -histogram test.o
+echo "----------"
@@ -0,0 +1,17 @@
+/* Shared by the benchmark kernels. They are freestanding and get nothing
+   from avr-libc, so that the numbers are the backend's alone. Each main
+   returns a checksum of its results, which run.sh checks against the
+   EXPECT line of the kernel. */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NOINLINE __attribute__((noinline))
+
+void *memcpy(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+
+#endif
@@ -0,0 +1,51 @@
+/* CRC-16/CCITT and CRC-32, bit at a time, as in bootloaders and protocol
+   stacks that cannot spare flash for tables.
+   EXPECT: -22707 */
+
+#include "bench.h"
+
+uint8_t Message[64];
+
+NOINLINE uint16_t crc16(const uint8_t *p, uint8_t n)
+{
+	uint16_t crc = 0xffff;
+	uint8_t i;
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			if (crc & 0x8000)
+				crc = (uint16_t)(crc << 1) ^ 0x1021;
+			else
+				crc = (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+NOINLINE uint32_t crc32(const uint8_t *p, uint8_t n)
+{
+	uint32_t crc = 0xffffffff;
+	uint8_t i;
+	while (n--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			if (crc & 1)
+				crc = (crc >> 1) ^ 0xedb88320;
+			else
+				crc >>= 1;
+	}
+	return ~crc;
+}
+
+int main(void)
+{
+	uint8_t i;
+	uint16_t a;
+	uint32_t b;
+
+	for (i = 0; i < sizeof Message; i++)
+		Message[i] = i * 7 + 3;
+
+	a = crc16(Message, sizeof Message);
+	b = crc32(Message, sizeof Message);
+	return a ^ (uint16_t)b ^ (uint16_t)(b >> 16);
+}
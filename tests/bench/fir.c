@@ -0,0 +1,42 @@
+/* A 16 tap low pass FIR filter in Q15, the inner loop of sensor and audio
+   processing on parts without DSP instructions.
+   EXPECT: -8550 */
+
+#include "bench.h"
+
+#define TAPS 16
+#define SAMPLES 64
+
+const int16_t Coeffs[TAPS] = {
+	-120, -310, -420, 0, 1350, 3580, 5870, 7230,
+	7230, 5870, 3580, 1350, 0, -420, -310, -120
+};
+
+int16_t Input[SAMPLES + TAPS];
+int16_t Output[SAMPLES];
+
+NOINLINE void fir(const int16_t *x, int16_t *y, uint8_t n)
+{
+	uint8_t i, j;
+	for (i = 0; i < n; i++) {
+		int32_t acc = 0;
+		for (j = 0; j < TAPS; j++)
+			acc += (int32_t)x[i + j] * Coeffs[j];
+		y[i] = (int16_t)(acc >> 15);
+	}
+}
+
+int main(void)
+{
+	uint8_t i;
+	uint16_t sum = 0;
+
+	for (i = 0; i < SAMPLES + TAPS; i++)
+		Input[i] = (i & 8) ? 12000 - i * 50 : -9000 + i * 40;
+
+	fir(Input, Output, SAMPLES);
+
+	for (i = 0; i < SAMPLES; i++)
+		sum = (uint16_t)(sum << 1 | sum >> 15) ^ (uint16_t)Output[i];
+	return sum;
+}
@@ -0,0 +1,78 @@
+/* A printf style formatter for a log line. The backend has no varargs yet,
+   so the arguments come as an array.
+   EXPECT: -29294 */
+
+#include "bench.h"
+
+char Line[64];
+
+static char *put_uint(char *out, uint16_t v, uint8_t base, uint8_t width)
+{
+	char digits[6];
+	uint8_t n = 0;
+	do {
+		uint8_t d = v % base;
+		digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+		v /= base;
+	} while (v);
+	while (width > n) {
+		*out++ = '0';
+		width--;
+	}
+	while (n)
+		*out++ = digits[--n];
+	return out;
+}
+
+NOINLINE uint8_t format(char *out, const char *fmt, const int16_t *args)
+{
+	char *start = out;
+	while (*fmt) {
+		uint8_t width = 0;
+		if (*fmt != '%') {
+			*out++ = *fmt++;
+			continue;
+		}
+		fmt++;
+		while (*fmt >= '0' && *fmt <= '9')
+			width = width * 10 + *fmt++ - '0';
+		switch (*fmt++) {
+		case 'd': {
+			int16_t v = *args++;
+			if (v < 0) {
+				*out++ = '-';
+				v = -v;
+			}
+			out = put_uint(out, v, 10, width);
+			break;
+		}
+		case 'u':
+			out = put_uint(out, *args++, 10, width);
+			break;
+		case 'x':
+			out = put_uint(out, *args++, 16, width);
+			break;
+		case 'c':
+			*out++ = *args++;
+			break;
+		case '%':
+			*out++ = '%';
+			break;
+		}
+	}
+	*out = 0;
+	return out - start;
+}
+
+const int16_t Args[] = { 1234, -567, 0x3fa, 'k', 7, 65000 };
+
+int main(void)
+{
+	uint8_t i, n;
+	uint16_t sum = 0;
+
+	n = format(Line, "t=%u dv=%d reg=%04x %c [%3u%%] %u", Args);
+	for (i = 0; i < n; i++)
+		sum = sum * 31 + (uint8_t)Line[i];
+	return sum;
+}
@@ -0,0 +1,120 @@
+/* The library functions the kernels and the code generator call. They are
+   linked with every kernel, but not counted in its size. */
+
+#include "bench.h"
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	while (n--)
+		*d++ = *s++;
+	return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	if (d < s)
+		return memcpy(dst, src, n);
+	while (n--)
+		d[n] = s[n];
+	return dst;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+	uint8_t *d = dst;
+	while (n--)
+		*d++ = c;
+	return dst;
+}
+
+/* The libcalls of LLVM's default names, by shifts and adds. */
+
+uint32_t __mulsi3(uint32_t a, uint32_t b)
+{
+	uint32_t r = 0;
+	while (b) {
+		if (b & 1)
+			r += a;
+		a <<= 1;
+		b >>= 1;
+	}
+	return r;
+}
+
+static uint32_t udivmodsi4(uint32_t n, uint32_t d, uint32_t *rem)
+{
+	uint32_t q = 0, r = 0;
+	uint8_t i;
+	for (i = 0; i < 32; i++) {
+		r = (r << 1) | (n >> 31);
+		n <<= 1;
+		q <<= 1;
+		if (r >= d) {
+			r -= d;
+			q |= 1;
+		}
+	}
+	*rem = r;
+	return q;
+}
+
+static uint16_t udivmodhi4(uint16_t n, uint16_t d, uint16_t *rem)
+{
+	uint16_t q = 0, r = 0;
+	uint8_t i;
+	for (i = 0; i < 16; i++) {
+		r = (uint16_t)(r << 1) | (n >> 15);
+		n <<= 1;
+		q <<= 1;
+		if (r >= d) {
+			r -= d;
+			q |= 1;
+		}
+	}
+	*rem = r;
+	return q;
+}
+
+uint32_t __udivsi3(uint32_t n, uint32_t d)
+{
+	uint32_t r;
+	return udivmodsi4(n, d, &r);
+}
+
+uint32_t __umodsi3(uint32_t n, uint32_t d)
+{
+	uint32_t r;
+	udivmodsi4(n, d, &r);
+	return r;
+}
+
+uint16_t __udivhi3(uint16_t n, uint16_t d)
+{
+	uint16_t r;
+	return udivmodhi4(n, d, &r);
+}
+
+uint16_t __umodhi3(uint16_t n, uint16_t d)
+{
+	uint16_t r;
+	udivmodhi4(n, d, &r);
+	return r;
+}
+
+int16_t __divhi3(int16_t n, int16_t d)
+{
+	uint16_t r;
+	uint16_t q = udivmodhi4(n < 0 ? -n : n, d < 0 ? -d : d, &r);
+	return (n < 0) != (d < 0) ? -(int16_t)q : (int16_t)q;
+}
+
+int16_t __modhi3(int16_t n, int16_t d)
+{
+	uint16_t r;
+	udivmodhi4(n < 0 ? -n : n, d < 0 ? -d : d, &r);
+	return n < 0 ? -(int16_t)r : (int16_t)r;
+}
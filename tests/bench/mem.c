@@ -0,0 +1,56 @@
+/* Block copies and fills: the structure assignments and clears of
+   buffers that most firmware is full of, of a few bytes and of many.
+   EXPECT: 3113 */
+
+#include "bench.h"
+
+struct packet {
+	uint8_t kind;
+	uint8_t length;
+	uint16_t id;
+	uint8_t payload[12];
+};
+
+struct packet Queue[4];
+uint8_t Buffer[128];
+uint8_t Shadow[128];
+
+NOINLINE void push(const struct packet *p, uint8_t slot)
+{
+	Queue[slot & 3] = *p;
+}
+
+NOINLINE void clear(void)
+{
+	memset(Buffer, 0, sizeof Buffer);
+}
+
+NOINLINE void snapshot(void)
+{
+	memcpy(Shadow, Buffer, sizeof Buffer);
+}
+
+int main(void)
+{
+	struct packet p;
+	uint16_t sum = 0;
+	uint8_t i;
+
+	clear();
+	for (i = 0; i < sizeof Buffer; i += 3)
+		Buffer[i] = i;
+	snapshot();
+
+	memset(&p, 0x5a, sizeof p);
+	for (i = 0; i < 8; i++) {
+		p.id = i;
+		p.payload[i] = i;
+		push(&p, i);
+	}
+
+	for (i = 0; i < sizeof Shadow; i++)
+		sum += Shadow[i];
+	for (i = 0; i < 4; i++)
+		sum += Queue[i].id + Queue[i].payload[i + 4] + Queue[i].kind;
+	return sum;
+}
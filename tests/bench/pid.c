@@ -0,0 +1,51 @@
+/* A fixed-point PID controller closing the loop around a first order
+   plant, as a motor or heater controller does every tick.
+   EXPECT: -27949 */
+
+#include "bench.h"
+
+struct pid {
+	int16_t kp, ki, kd;     /* Q8 gains */
+	int32_t integral;
+	int16_t last_error;
+	int16_t out_min, out_max;
+};
+
+struct pid Controller = { 320, 24, 96, 0, 0, -1000, 1000 };
+
+NOINLINE int16_t pid_step(struct pid *c, int16_t setpoint, int16_t measured)
+{
+	int16_t error = setpoint - measured;
+	int32_t out;
+
+	c->integral += error;
+	if (c->integral > 20000)
+		c->integral = 20000;
+	else if (c->integral < -20000)
+		c->integral = -20000;
+
+	out = (int32_t)c->kp * error + (int32_t)c->ki * c->integral +
+	      (int32_t)c->kd * (error - c->last_error);
+	c->last_error = error;
+
+	out >>= 8;
+	if (out > c->out_max)
+		return c->out_max;
+	if (out < c->out_min)
+		return c->out_min;
+	return out;
+}
+
+int main(void)
+{
+	int16_t plant = 0, u;
+	uint16_t sum = 0;
+	uint8_t t;
+
+	for (t = 0; t < 100; t++) {
+		u = pid_step(&Controller, t < 50 ? 500 : -200, plant);
+		plant += (u - plant) >> 3;
+		sum = (uint16_t)(sum * 5) ^ (uint16_t)plant;
+	}
+	return sum;
+}
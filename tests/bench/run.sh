@@ -0,0 +1,100 @@
+#!/bin/sh
+#
+# Builds the kernels of this directory at -O0, -Os and -O2, and records the
+# size of each one and the cycles it takes on avr-sim:
+#
+#   run.sh            compare the results against baseline.txt
+#   run.sh -update    and then make them the new baseline
+#
+# LLVM_BIN is where clang, llc, llvm-size and avr-sim are, MCPU the device
+# to build for and OUT where the objects and results go.
+
+LLVM_BIN=${LLVM_BIN:-~/Code/llvm/Debug+Asserts/bin}
+MCPU=${MCPU:-atmega328p}
+OUT=${OUT:-bench-out}
+DIR=$(cd $(dirname $0) && pwd)
+
+KERNELS="crc mem fir format aes pid uart"
+LEVELS="-O0 -Os -O2"
+
+mkdir -p $OUT
+RESULTS=$OUT/results.txt
+echo "# kernel level text data bss cycles" > $RESULTS
+
+# compile <source> <level> <object>
+compile() {
+	llc_level=-O2
+	[ $2 = -O0 ] && llc_level=-O0
+	$LLVM_BIN/clang -ccc-host-triple avr-pc-linux-gnu -ffreestanding \
+		-S -emit-llvm $2 -I$DIR $1 -o $3.ll &&
+	$LLVM_BIN/llc -march=avr -mcpu=$MCPU $llc_level -filetype=obj \
+		$3.ll -o $3
+}
+
+# Flash is .text and .progmem, SRAM .data, .rodata and .bss.
+sizes() {
+	$LLVM_BIN/llvm-size -A $1 | awk '
+		$1 ~ /^\.(text|progmem)/ { text += $2 }
+		$1 ~ /^\.(data|rodata)/  { data += $2 }
+		$1 ~ /^\.bss/            { bss += $2 }
+		END { print text + 0, data + 0, bss + 0 }'
+}
+
+for level in $LEVELS; do
+	lib=$OUT/lib$level.o
+	if ! compile $DIR/lib.c $level $lib; then
+		echo "lib.c does not build at $level" >&2
+		continue
+	fi
+
+	for kernel in $KERNELS; do
+		obj=$OUT/$kernel$level.o
+		if ! compile $DIR/$kernel.c $level $obj; then
+			echo "$kernel does not build at $level" >&2
+			echo "$kernel $level - - - -" >> $RESULTS
+			continue
+		fi
+
+		expected=$(sed -n 's/.*EXPECT: *\(-*[0-9]*\).*/\1/p' $DIR/$kernel.c)
+		sim=$($LLVM_BIN/avr-sim -mcpu=$MCPU $obj $lib)
+		returned=$(echo "$sim" | awk '/^returned:/ { print $2 }')
+		cycles=$(echo "$sim" | awk '/^cycles:/ { print $2 }')
+		if [ "$returned" != "$expected" ]; then
+			echo "$kernel at $level returned '$returned'," \
+			     "not $expected" >&2
+			cycles=-
+		fi
+
+		echo "$kernel $level $(sizes $obj) $cycles" >> $RESULTS
+	done
+done
+
+# The report: every number, and how much it moved from the baseline.
+awk '
+	function delta(new, old) {
+		if (old == "" || old == "-" || new == "-" || new == old)
+			return ""
+		return sprintf("%+d", new - old)
+	}
+	FNR == 1 { file++ }
+	/^#/ { next }
+	file == 1 { base[$1 " " $2] = $0; next }
+	{
+		key = $1 " " $2
+		split(base[key], b)
+		note = key in base ? "" : "  (new)"
+		printf "%-8s %-4s", $1, $2
+		for (i = 3; i <= 6; i++)
+			printf " %7s %-7s", $i, delta($i, b[i])
+		print note
+	}
+' $DIR/baseline.txt $RESULTS | {
+	printf "%-8s %-4s %15s %15s %15s %15s\n" \
+	       kernel level text data bss cycles
+	cat
+}
+
+if [ "$1" = -update ]; then
+	cp $RESULTS $DIR/baseline.txt
+	echo "baseline.txt updated"
+fi
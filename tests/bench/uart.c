@@ -0,0 +1,58 @@
+/* An interrupt driven UART transmitter with a ring buffer. The interrupt
+   handler is called by hand, as the simulator raises no interrupts, and
+   writes to UDR0 of the ATmega328P; "-console-port 0xc6" shows them.
+   EXPECT: -4240 */
+
+#include "bench.h"
+
+#define UDR0 (*(volatile uint8_t *)0xc6)
+#define TX_SIZE 16
+
+struct ring {
+	volatile uint8_t head, tail;
+	uint8_t data[TX_SIZE];
+};
+
+struct ring Tx;
+uint16_t Sent;
+
+NOINLINE uint8_t uart_putc(uint8_t c)
+{
+	uint8_t next = (Tx.head + 1) & (TX_SIZE - 1);
+	if (next == Tx.tail)
+		return 0;
+	Tx.data[Tx.head] = c;
+	Tx.head = next;
+	return 1;
+}
+
+/* USART_UDRE_vect */
+NOINLINE void uart_udre(void)
+{
+	uint8_t c;
+	if (Tx.head == Tx.tail)
+		return;
+	c = Tx.data[Tx.tail];
+	Tx.tail = (Tx.tail + 1) & (TX_SIZE - 1);
+	UDR0 = c;
+	Sent = (uint16_t)(Sent << 1 | Sent >> 15) ^ c;
+}
+
+NOINLINE void uart_puts(const char *s)
+{
+	while (*s) {
+		if (uart_putc(*s))
+			s++;
+		else
+			uart_udre();
+	}
+}
+
+int main(void)
+{
+	uart_puts("benchmark: ring buffer uart driver\n");
+	uart_puts("the quick brown fox jumps over the lazy dog\n");
+	while (Tx.head != Tx.tail)
+		uart_udre();
+	return Sent;
+}
@@ -0,0 +1,54 @@
+; Single bit tests are SBRC or SBRS over a RJMP, on whichever register holds
+; the byte of the bit, and single bit extracts and inserts BST and BLD.
+
+declare void @f()
+
+; Bit 2 of r25, with SBRC or SBRS.
+define void @test16(i16 %x)
+{
+entry:
+	%b = and i16 %x, 1024;
+	%c = icmp ne i16 %b, 0;
+	br i1 %c, label %call, label %done;
+
+call:
+	call void @f();
+	br label %done;
+
+done:
+	ret void;
+}
+
+; The byte is in r18, out of the reach of ANDI.
+define void @testlow(i16 %a, i16 %b, i16 %c, i8 %x)
+{
+entry:
+	%b0 = and i8 %x, 1;
+	%c0 = icmp eq i8 %b0, 0;
+	br i1 %c0, label %call, label %done;
+
+call:
+	call void @f();
+	br label %done;
+
+done:
+	ret void;
+}
+
+; bst r24, 5, and a bld into a zero.
+define i8 @extract(i8 %x)
+{
+	%s = lshr i8 %x, 5;
+	%b = and i8 %s, 1;
+	ret i8 %b;
+}
+
+; Bit 7 of %x to bit 1 of %y: bst r22, 7 and bld r24, 1.
+define i8 @insert(i8 %y, i8 %x)
+{
+	%s = lshr i8 %x, 6;
+	%b = and i8 %s, 2;
+	%k = and i8 %y, -3;
+	%r = or i8 %k, %b;
+	ret i8 %r;
+}
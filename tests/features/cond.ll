@@ -15,3 +15,14 @@ define i8 @test(i8 %a, i8 %b)
 	   ret i8 2;
 }
 
+
+define i8 @negative(i16 %a)
+{
+	%cond = icmp slt i16 %a, 0;
+	br i1 %cond, label %Negative, label %Positive;
+
+	Negative:
+	   ret i8 1;
+    Positive:
+	   ret i8 2;
+}
@@ -0,0 +1,23 @@
+declare void @fill(i8*)
+
+define i8 @buffer()
+{
+	%buf = alloca [40 x i8];
+	%p = getelementptr [40 x i8]* %buf, i16 0, i16 0;
+	call void @fill(i8* %p);
+	%last.p = getelementptr [40 x i8]* %buf, i16 0, i16 39;
+	%last = load i8* %last.p;
+	ret i8 %last;
+}
+
+define i8 @pair()
+{
+	%x = alloca i8;
+	%y = alloca i8;
+	call void @fill(i8* %x);
+	call void @fill(i8* %y);
+	%x_val = load i8* %x;
+	%y_val = load i8* %y;
+	%r = add i8 %x_val, %y_val;
+	ret i8 %r;
+}
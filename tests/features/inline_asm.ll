@@ -0,0 +1,25 @@
+@port = global i8 0
+
+define void @toggle() nounwind
+{
+	call void asm sideeffect "in r24, 0x05\0A\09ldi r25, 0x20\0A\09eor r24, r25\0A\09out 0x05, r24", "~{r24},~{r25}"();
+	ret void;
+}
+
+define void @irq_off() nounwind
+{
+	call void asm sideeffect "in __tmp_reg__, __SREG__\0A\09cli\0A\09out __SREG__, __tmp_reg__", ""();
+	ret void;
+}
+
+define i8 @skip(i8 %a) nounwind
+{
+	%r = call i8 asm "sbrc $1, 0\0A\09inc $0\0A\09breq .+2\0A\09clr $0", "=r,r,0"(i8 %a, i8 %a);
+	ret i8 %r;
+}
+
+define void @copy(i8* %p) nounwind
+{
+	call void asm sideeffect "ld __tmp_reg__, X+\0A\09st -X, __tmp_reg__\0A\09ldd r24, Y+3\0A\09ldi r30, lo8(port)\0A\09ldi r31, hi8(port)", "{x},~{r24},~{r30},~{r31}"(i8* %p);
+	ret void;
+}
@@ -0,0 +1,58 @@
+; Accesses at constant addresses in the I/O space are IN and OUT, and those
+; that change or test a single bit of the low 32 I/O registers SBI, CBI, SBIS
+; and SBIC. With the avr5 layout, PORTB is at data address 0x25, I/O address
+; 0x05, and OCR0A at 0x47, 0x27.
+
+define void @out(i8 %x)
+{
+	%portb = inttoptr i16 37 to i8*;
+	store volatile i8 %x, i8* %portb;
+	ret void;
+}
+
+define i8 @in()
+{
+	%ocr0a = inttoptr i16 71 to i8*;
+	%x = load volatile i8* %ocr0a;
+	ret i8 %x;
+}
+
+; sbi 0x05, 3 and cbi 0x05, 0
+define void @setclear()
+{
+	%portb = inttoptr i16 37 to i8*;
+	%a = load volatile i8* %portb;
+	%b = or i8 %a, 8;
+	store volatile i8 %b, i8* %portb;
+	%c = load volatile i8* %portb;
+	%d = and i8 %c, -2;
+	store volatile i8 %d, i8* %portb;
+	ret void;
+}
+
+; OCR0A is past the reach of SBI, it is read, changed and written back.
+define void @sethigh()
+{
+	%ocr0a = inttoptr i16 71 to i8*;
+	%a = load volatile i8* %ocr0a;
+	%b = or i8 %a, 8;
+	store volatile i8 %b, i8* %ocr0a;
+	ret void;
+}
+
+; Waits for bit 5 of PINB with SBIS over a RJMP back.
+define void @wait()
+{
+entry:
+	%pinb = inttoptr i16 35 to i8*;
+	br label %loop;
+
+loop:
+	%a = load volatile i8* %pinb;
+	%b = and i8 %a, 32;
+	%c = icmp eq i8 %b, 0;
+	br i1 %c, label %loop, label %done;
+
+done:
+	ret void;
+}
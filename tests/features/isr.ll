@@ -0,0 +1,30 @@
+@ticks = global i16 0
+@flag = global i8 0
+
+declare void @handler()
+
+define cc 84 void @timer_isr() nounwind
+{
+	%ticks = load volatile i16* @ticks;
+	%next = add i16 %ticks, 1;
+	store volatile i16 %next, i16* @ticks;
+	ret void;
+}
+
+define cc 85 void @adc_isr() nounwind
+{
+	store volatile i8 1, i8* @flag;
+	ret void;
+}
+
+define cc 85 void @calling_isr() nounwind
+{
+	call void @handler();
+	ret void;
+}
+
+define void @naked() naked nounwind
+{
+	call void asm sideeffect "reti", ""();
+	unreachable;
+}
@@ -0,0 +1,43 @@
+define i32 @add32(i32 %a, i32 %b)
+{
+	%sum = add i32 %a, %b;
+	ret i32 %sum;
+}
+
+define i32 @sub32(i32 %a, i32 %b)
+{
+	%diff = sub i32 %a, %b;
+	ret i32 %diff;
+}
+
+define i64 @add64(i64 %a, i64 %b)
+{
+	%sum = add i64 %a, %b;
+	ret i64 %sum;
+}
+
+define i32 @mixed(i8 %a, i32 %b, i16 %c)
+{
+	%x = zext i8 %a to i32;
+	%y = sext i16 %c to i32;
+	%s = add i32 %x, %b;
+	%t = sub i32 %s, %y;
+	ret i32 %t;
+}
+
+define i32 @max32(i32 %a, i32 %b)
+{
+entry:
+	%c = icmp slt i32 %a, %b;
+	br i1 %c, label %less, label %done;
+less:
+	ret i32 %b;
+done:
+	ret i32 %a;
+}
+
+define i32 @counter(i32 %n)
+{
+	%r = call i32 @add32(i32 %n, i32 1);
+	ret i32 %r;
+}
@@ -0,0 +1,46 @@
+%struct.packet = type { i8, i8, i16, [12 x i8] }
+
+@queue = global [4 x %struct.packet] zeroinitializer
+@buffer = global [100 x i8] zeroinitializer
+@shadow = global [100 x i8] zeroinitializer
+
+declare void @llvm.memcpy.p0i8.p0i8.i16(i8*, i8*, i16, i32, i1)
+declare void @llvm.memset.p0i8.i16(i8*, i8, i16, i32, i1)
+
+; Small: unrolled word moves.
+define void @copy_small(i8* %dst, i8* %src)
+{
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %dst, i8* %src, i16 6, i32 1, i1 false);
+	ret void;
+}
+
+; Medium: a loop of ld X+ and st Z+.
+define void @copy_struct(%struct.packet* %p)
+{
+	%d = bitcast [4 x %struct.packet]* @queue to i8*;
+	%s = bitcast %struct.packet* %p to i8*;
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d, i8* %s, i16 16, i32 2, i1 false);
+	ret void;
+}
+
+define void @snapshot()
+{
+	%d = getelementptr [100 x i8]* @shadow, i16 0, i16 0;
+	%s = getelementptr [100 x i8]* @buffer, i16 0, i16 0;
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d, i8* %s, i16 100, i32 1, i1 false);
+	ret void;
+}
+
+define void @clear(i8 %c)
+{
+	%d = getelementptr [100 x i8]* @buffer, i16 0, i16 0;
+	call void @llvm.memset.p0i8.i16(i8* %d, i8 %c, i16 100, i32 1, i1 false);
+	ret void;
+}
+
+; Unknown size: the libcall.
+define void @copy_n(i8* %dst, i8* %src, i16 %n)
+{
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %dst, i8* %src, i16 %n, i32 1, i1 false);
+	ret void;
+}
@@ -0,0 +1,33 @@
+define i8 @mul8(i8 %a, i8 %b)
+{
+	%p = mul i8 %a, %b;
+	ret i8 %p;
+}
+
+define i16 @mul16(i16 %a, i16 %b)
+{
+	%p = mul i16 %a, %b;
+	ret i16 %p;
+}
+
+define i16 @umul8x8(i8 %a, i8 %b)
+{
+	%x = zext i8 %a to i16;
+	%y = zext i8 %b to i16;
+	%p = mul i16 %x, %y;
+	ret i16 %p;
+}
+
+define i16 @smul8x8(i8 %a, i8 %b)
+{
+	%x = sext i8 %a to i16;
+	%y = sext i8 %b to i16;
+	%p = mul i16 %x, %y;
+	ret i16 %p;
+}
+
+define i32 @mul32(i32 %a, i32 %b)
+{
+	%p = mul i32 %a, %b;
+	ret i32 %p;
+}
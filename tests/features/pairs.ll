@@ -0,0 +1,35 @@
+; Many 16-bit values live at once: they stay in register pairs, the call
+; clobbered ones first, and only then the callee saved ones from r17:r16
+; down to r3:r2.
+
+define i16 @mix(i16 %a, i16 %b, i16 %c, i16 %d)
+{
+	%e = add i16 %a, %b;
+	%f = xor i16 %c, %d;
+	%g = sub i16 %a, %d;
+	%h = or i16 %b, %c;
+	%i = add i16 %e, 1234;
+	%j = and i16 %f, 4095;
+	%k = add i16 %g, %h;
+	%l = xor i16 %e, %f;
+	%m = add i16 %i, %j;
+	%n = sub i16 %k, %l;
+	%o = add i16 %m, %n;
+	%p = xor i16 %o, %g;
+	%q = add i16 %p, %h;
+	%r = add i16 %q, %i;
+	ret i16 %r;
+}
+
+; The constants are loaded with LDI into pairs above r16.
+define void @table(i16* %out)
+{
+	%p1 = getelementptr i16* %out, i16 1;
+	%p2 = getelementptr i16* %out, i16 2;
+	%p3 = getelementptr i16* %out, i16 3;
+	store volatile i16 4660, i16* %out;
+	store volatile i16 22136, i16* %p1;
+	store volatile i16 -21555, i16* %p2;
+	store volatile i16 -1, i16* %p3;
+	ret void;
+}
@@ -0,0 +1,29 @@
+@crc_table = addrspace(1) constant [4 x i16] [i16 0, i16 4129, i16 8258, i16 12387]
+@glyphs = addrspace(1) constant [8 x i8] c"\00\18\24\42\7E\42\42\00"
+@far_table = addrspace(2) constant [2 x i8] c"\01\02"
+
+define i16 @crc_lookup(i8 %index)
+{
+	%idx = zext i8 %index to i16;
+	%p = getelementptr [4 x i16] addrspace(1)* @crc_table, i16 0, i16 %idx;
+	%val = load i16 addrspace(1)* %p;
+	ret i16 %val;
+}
+
+define i8 @glyph_sum()
+{
+	%p0 = getelementptr [8 x i8] addrspace(1)* @glyphs, i16 0, i16 0;
+	%p1 = getelementptr [8 x i8] addrspace(1)* @glyphs, i16 0, i16 1;
+	%a = load i8 addrspace(1)* %p0;
+	%b = load i8 addrspace(1)* %p1;
+	%sum = add i8 %a, %b;
+	ret i8 %sum;
+}
+
+define i8 @far_lookup(i8 %index)
+{
+	%idx = zext i8 %index to i16;
+	%p = getelementptr [2 x i8] addrspace(2)* @far_table, i16 0, i16 %idx;
+	%val = load i8 addrspace(2)* %p;
+	ret i8 %val;
+}
@@ -0,0 +1,34 @@
+define i8 @main()
+{
+	%x = call i8 @lt(i8 1, i8 2);
+	%y = call i16 @max(i16 1, i16 2);
+	ret i8 %x;
+}
+
+define i8 @lt(i8 %a, i8 %b)
+{
+	%cond = icmp ult i8 %a, %b;
+	%x = zext i1 %cond to i8;
+	ret i8 %x;
+}
+
+define i8 @eq(i8 %a, i8 %b)
+{
+	%cond = icmp eq i8 %a, %b;
+	%x = zext i1 %cond to i8;
+	ret i8 %x;
+}
+
+define i16 @max(i16 %a, i16 %b)
+{
+	%cond = icmp sge i16 %a, %b;
+	%x = select i1 %cond, i16 %a, i16 %b;
+	ret i16 %x;
+}
+
+define i8 @clamp(i32 %a, i8 %b)
+{
+	%cond = icmp ugt i32 %a, 255;
+	%x = select i1 %cond, i8 255, i8 %b;
+	ret i8 %x;
+}
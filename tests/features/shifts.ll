@@ -24,3 +24,51 @@ define i8 @shra_func(i8 %t)
   ret i8 %x;
 }
 
+
+define i8 @shl_var(i8 %t, i8 %n)
+{
+  %x = shl i8 %t, %n;
+  ret i8 %x;
+}
+
+define i8 @shra_var(i8 %t, i8 %n)
+{
+  %x = ashr i8 %t, %n;
+  ret i8 %x;
+}
+
+define i16 @shl16_func(i16 %t)
+{
+  %x = shl i16 %t, 12;
+  ret i16 %x;
+}
+
+define i16 @shr16_func(i16 %t)
+{
+  %x = lshr i16 %t, 4;
+  ret i16 %x;
+}
+
+define i16 @shra16_func(i16 %t)
+{
+  %x = ashr i16 %t, 15;
+  ret i16 %x;
+}
+
+define i16 @shl16_var(i16 %t, i16 %n)
+{
+  %x = shl i16 %t, %n;
+  ret i16 %x;
+}
+
+define i32 @shl32_func(i32 %t)
+{
+  %x = shl i32 %t, 7;
+  ret i32 %x;
+}
+
+define i32 @shra32_func(i32 %t)
+{
+  %x = ashr i32 %t, 20;
+  ret i32 %x;
+}
@@ -0,0 +1,35 @@
+; More values live than there are registers: spills and reloads of pairs,
+; bytes and pointers, kept in free call clobbered registers where nothing
+; in between needs them, and reached off Z past 63 bytes of frame.
+
+define i32 @pressure(i32 %a, i32 %b, i32 %c)
+{
+	%d = mul i32 %a, %b;
+	%e = add i32 %a, %c;
+	%f = xor i32 %b, %c;
+	%g = sub i32 %d, %e;
+	%h = or i32 %f, %g;
+	%i = add i32 %h, %d;
+	%j = and i32 %i, %e;
+	%k = add i32 %j, %f;
+	%l = xor i32 %k, %a;
+	%m = add i32 %l, %b;
+	%n = add i32 %m, %c;
+	%o = xor i32 %n, %d;
+	%p = add i32 %o, %e;
+	%q = add i32 %p, %g;
+	ret i32 %q;
+}
+
+define i8 @far(i8 %x, i8* %y)
+{
+	%buf = alloca [100 x i8];
+	%lo = getelementptr [100 x i8]* %buf, i16 0, i16 2;
+	%hi = getelementptr [100 x i8]* %buf, i16 0, i16 90;
+	store volatile i8 %x, i8* %lo;
+	store volatile i8 %x, i8* %hi;
+	%v = load volatile i8* %y;
+	store volatile i8 %v, i8* %hi;
+	%r = load volatile i8* %hi;
+	ret i8 %r;
+}
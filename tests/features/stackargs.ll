@@ -0,0 +1,25 @@
+; Arguments that do not fit in the 18 bytes of argument registers, and all
+; arguments of varargs functions, are stored above SP, in the room the
+; prologue reserves for the calls of the function.
+
+declare i16 @many(i16, i16, i16, i16, i16, i16, i16, i16, i16, i16, i32)
+declare i16 @report(i8*, ...)
+
+@fmt = constant [6 x i8] c"%d %d\00"
+
+; The last two arguments go to SP+1 and SP+3.
+define i16 @spill_args(i16 %x)
+{
+	%r = call i16 @many(i16 %x, i16 1, i16 2, i16 3, i16 4, i16 5, i16 6,
+	                    i16 7, i16 8, i16 9, i32 70000);
+	ret i16 %r;
+}
+
+; The format string goes to SP+1, the two values to SP+3 and SP+5.
+define i16 @varargs(i16 %a, i8 %b)
+{
+	%f = getelementptr [6 x i8]* @fmt, i16 0, i16 0;
+	%c = zext i8 %b to i16;
+	%r = call i16 (i8*, ...)* @report(i8* %f, i16 %a, i16 %c);
+	ret i16 %r;
+}
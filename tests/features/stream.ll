@@ -0,0 +1,43 @@
+define void @copy(i8* %dst, i8* %src, i8 %n)
+{
+entry:
+	%empty = icmp eq i8 %n, 0;
+	br i1 %empty, label %done, label %loop;
+
+loop:
+	%d = phi i8* [ %dst, %entry ], [ %d.next, %loop ];
+	%s = phi i8* [ %src, %entry ], [ %s.next, %loop ];
+	%i = phi i8 [ %n, %entry ], [ %i.next, %loop ];
+	%x = load i8* %s;
+	store i8 %x, i8* %d;
+	%d.next = getelementptr i8* %d, i16 1;
+	%s.next = getelementptr i8* %s, i16 1;
+	%i.next = sub i8 %i, 1;
+	%more = icmp ne i8 %i.next, 0;
+	br i1 %more, label %loop, label %done;
+
+done:
+	ret void;
+}
+
+define i16 @sum(i16* %p, i8 %n)
+{
+entry:
+	%empty = icmp eq i8 %n, 0;
+	br i1 %empty, label %done, label %loop;
+
+loop:
+	%q = phi i16* [ %p, %entry ], [ %q.next, %loop ];
+	%i = phi i8 [ %n, %entry ], [ %i.next, %loop ];
+	%acc = phi i16 [ 0, %entry ], [ %acc.next, %loop ];
+	%x = load i16* %q;
+	%acc.next = add i16 %acc, %x;
+	%q.next = getelementptr i16* %q, i16 1;
+	%i.next = sub i8 %i, 1;
+	%more = icmp ne i8 %i.next, 0;
+	br i1 %more, label %loop, label %done;
+
+done:
+	%r = phi i16 [ 0, %entry ], [ %acc.next, %loop ];
+	ret i16 %r;
+}
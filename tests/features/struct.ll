@@ -0,0 +1,24 @@
+%packet = type { i8, i8, i16, [60 x i8], i8, i16 }
+
+@last = global i16 0
+
+define i16 @checksum(%packet* %p)
+{
+entry:
+	%kind.p = getelementptr %packet* %p, i16 0, i32 1;
+	%kind = load i8* %kind.p;
+	%len.p = getelementptr %packet* %p, i16 0, i32 2;
+	%len = load i16* %len.p;
+	%tail.p = getelementptr %packet* %p, i16 0, i32 4;
+	%tail = load i8* %tail.p;
+	%crc.p = getelementptr %packet* %p, i16 0, i32 5;
+	%crc = load i16* %crc.p;
+	%k = zext i8 %kind to i16;
+	%t = zext i8 %tail to i16;
+	%a = add i16 %len, %k;
+	%b = add i16 %a, %t;
+	%c = xor i16 %b, %crc;
+	store i16 %c, i16* @last;
+	store i16 %c, i16* %len.p;
+	ret i16 %c;
+}
@@ -0,0 +1,65 @@
+; Tail calls become a JMP, or a RJMP on devices without it, after the
+; epilogue, and calls through a pointer an IJMP.
+
+%struct.pair = type { i16, i16 }
+
+@handlers = global [2 x void (i8)*] [void (i8)* @on_byte, void (i8)* @on_idle]
+
+declare void @consume(i8)
+declare i16 @scale(i16, i16)
+declare i16 @many(i16, i16, i16, i16, i16)
+declare void @fill(%struct.pair* sret)
+
+define void @on_byte(i8 %c)
+{
+	tail call void @consume(i8 %c);
+	ret void;
+}
+
+define void @on_idle(i8 %c)
+{
+	ret void;
+}
+
+; The return value of the callee is passed on as it is.
+define i16 @twice(i16 %x)
+{
+	%r = tail call i16 @scale(i16 %x, i16 2);
+	ret i16 %r;
+}
+
+; Dispatch through a table: ijmp.
+define void @dispatch(i8 %state, i8 %c)
+{
+	%i = zext i8 %state to i16;
+	%p = getelementptr [2 x void (i8)*]* @handlers, i16 0, i16 %i;
+	%h = load void (i8)** %p;
+	tail call void %h(i8 %c);
+	ret void;
+}
+
+; The frame is freed before the jump.
+define i16 @framed(i16 %x)
+{
+	%buf = alloca [8 x i16];
+	%p = getelementptr [8 x i16]* %buf, i16 0, i16 3;
+	store volatile i16 %x, i16* %p;
+	%v = load volatile i16* %p;
+	%r = tail call i16 @scale(i16 %v, i16 3);
+	ret i16 %r;
+}
+
+; Not a tail call: the fifth argument is in R16 and R17, which the epilogue
+; restores.
+define i16 @five(i16 %a)
+{
+	%r = tail call i16 @many(i16 %a, i16 %a, i16 %a, i16 %a, i16 %a);
+	ret i16 %r;
+}
+
+; Not a tail call: struct return.
+define void @outer(%struct.pair* sret %p)
+{
+	tail call void @fill(%struct.pair* sret %p);
+	ret void;
+}
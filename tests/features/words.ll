@@ -0,0 +1,61 @@
+; Adding and subtracting small constants on the pairs that have ADIW and
+; SBIW, r25:r24, X, Y and Z, and copying pairs with MOVW. Run with
+; -mcpu=avr5 for those, and with -mcpu=avrtiny, which has neither: there
+; the additions are a SUBI and a SBCI of the negated constant and the
+; copies two MOVs.
+
+; adiw r24, 1 and sbiw r24, 63
+define i16 @inc(i16 %x)
+{
+	%r = add i16 %x, 1;
+	ret i16 %r;
+}
+
+define i16 @dec63(i16 %x)
+{
+	%r = sub i16 %x, 63;
+	ret i16 %r;
+}
+
+; 64 is past the 6 bits of ADIW and SBIW, it is a SUBI and a SBCI.
+define i16 @add64(i16 %x)
+{
+	%r = add i16 %x, 64;
+	ret i16 %r;
+}
+
+define i16 @sub64(i16 %x)
+{
+	%r = sub i16 %x, 64;
+	ret i16 %r;
+}
+
+; A counter moved down with SBIW and a pointer moved on with ADIW, Z being
+; loaded through and the counter tested by the flags of the SBIW.
+define i16 @sum(i16* %p, i16 %n)
+{
+entry:
+	%empty = icmp eq i16 %n, 0;
+	br i1 %empty, label %exit, label %loop;
+
+loop:
+	%i = phi i16 [ %n, %entry ], [ %i1, %loop ];
+	%q = phi i16* [ %p, %entry ], [ %q1, %loop ];
+	%s = phi i16 [ 0, %entry ], [ %s1, %loop ];
+	%v = load volatile i16* %q;
+	%s1 = add i16 %s, %v;
+	%q1 = getelementptr i16* %q, i16 16;
+	%i1 = sub i16 %i, 1;
+	%done = icmp eq i16 %i1, 0;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	%r = phi i16 [ 0, %entry ], [ %s1, %loop ];
+	ret i16 %r;
+}
+
+; The second argument, in r23:r22, is copied to r25:r24 with a MOVW.
+define i16 @second(i16 %a, i16 %b)
+{
+	ret i16 %b;
+}
@@ -0,0 +1,41 @@
+; RUN: llvm-mc -triple=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: llvm-objdump -d -triple=avr %t.o | FileCheck %s
+
+; A mix of the instruction formats, assembled and disassembled again.
+; Pairs are shown as r25:r24, or x, y and z for the pointer registers.
+; Branches within the section are resolved by the assembler and shown as
+; byte offsets from the next instruction. JMP and CALL are absolute and
+; left to relocations, so their field reads zero.
+
+start:
+; CHECK: ldd r24, y+3
+	ldd	r24, Y+3
+; CHECK: std z+5, r25
+	std	Z+5, r25
+; CHECK: adiw r25:r24, 10
+	adiw	r25:r24, 10
+; CHECK: sbiw z, 63
+	sbiw	Z, 63
+; CHECK: sbis 5, 3
+	sbis	5, 3
+; CHECK: brne .-12
+	brne	start
+; CHECK: ld r24, x+
+	ld	r24, X+
+; CHECK: ld r25, -z
+	ld	r25, -Z
+; CHECK: st y+, r24
+	st	Y+, r24
+; CHECK: st -x, r25
+	st	-X, r25
+; CHECK: movw r25:r24, r23:r22
+	movw	r25:r24, r23:r22
+; CHECK: rjmp .-24
+	rjmp	start
+; CHECK: jmp 0
+	jmp	start
+; CHECK: call 0
+	call	end
+end:
+; CHECK: ret
+	ret
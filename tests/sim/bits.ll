@@ -0,0 +1,47 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 1152
+
+; Every byte has bit 4 tested with SBRS, bit 5 copied to bit 2 of another
+; byte and bit 6 taken out with BST and BLD.
+
+define i16 @main() nounwind
+{
+entry:
+	br label %loop;
+
+loop:
+	%i = phi i16 [ 0, %entry ], [ %i1, %next ];
+	%n = phi i16 [ 0, %entry ], [ %n1, %next ];
+	%y = phi i8 [ 0, %entry ], [ %y1, %next ];
+	%x = trunc i16 %i to i8;
+	%b = and i8 %x, 16;
+	%isset = icmp ne i8 %b, 0;
+	br i1 %isset, label %set, label %clear;
+
+set:
+	%n2 = add i16 %n, 3;
+	br label %next;
+
+clear:
+	%n3 = add i16 %n, 1;
+	br label %next;
+
+next:
+	%n4 = phi i16 [ %n2, %set ], [ %n3, %clear ];
+	%s = lshr i8 %x, 3;
+	%s1 = and i8 %s, 4;
+	%k = and i8 %y, -5;
+	%y1 = or i8 %k, %s1;
+	%e = lshr i8 %x, 6;
+	%e1 = and i8 %e, 1;
+	%f = add i8 %e1, %y1;
+	%f1 = zext i8 %f to i16;
+	%n1 = add i16 %n4, %f1;
+	%i1 = add i16 %i, 1;
+	%done = icmp eq i16 %i1, 256;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	ret i16 %n1;
+}
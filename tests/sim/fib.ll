@@ -0,0 +1,28 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 55
+; CHECK: cycles:
+
+define i16 @main() nounwind
+{
+	%x = call i16 @fib(i16 10);
+	ret i16 %x;
+}
+
+define i16 @fib(i16 %n) nounwind
+{
+entry:
+	br label %loop;
+
+loop:
+	%i = phi i16 [ 0, %entry ], [ %i.next, %loop ];
+	%a = phi i16 [ 0, %entry ], [ %b, %loop ];
+	%b = phi i16 [ 1, %entry ], [ %sum, %loop ];
+	%sum = add i16 %a, %b;
+	%i.next = add i16 %i, 1;
+	%done = icmp eq i16 %i.next, %n;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	ret i16 %b;
+}
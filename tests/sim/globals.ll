@@ -0,0 +1,29 @@
+; RUN: llc -march=avr -mcpu=atxmega128a1 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=atxmega128a1 %t.o | FileCheck %s
+; CHECK: returned: 15
+; CHECK: stack:
+
+@table = global [5 x i8] c"\01\02\03\04\05"
+@total = global i16 0
+
+define i16 @main() nounwind
+{
+entry:
+	br label %loop;
+
+loop:
+	%i = phi i16 [ 0, %entry ], [ %i.next, %loop ];
+	%acc = phi i16 [ 0, %entry ], [ %acc.next, %loop ];
+	%p = getelementptr [5 x i8]* @table, i16 0, i16 %i;
+	%v = load i8* %p;
+	%w = zext i8 %v to i16;
+	%acc.next = add i16 %acc, %w;
+	%i.next = add i16 %i, 1;
+	%done = icmp eq i16 %i.next, 5;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	store i16 %acc.next, i16* @total;
+	%r = load volatile i16* @total;
+	ret i16 %r;
+}
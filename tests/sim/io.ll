@@ -0,0 +1,50 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 442
+
+; Bit 3 of PORTB flipped a hundred times with SBI and CBI, after a SBIC on
+; it, then a byte through OCR0A, out of the reach of the bit instructions.
+
+define i16 @main() nounwind
+{
+entry:
+	%portb = inttoptr i16 37 to i8*;
+	store volatile i8 0, i8* %portb;
+	br label %loop;
+
+loop:
+	%i = phi i16 [ 0, %entry ], [ %i1, %next ];
+	%n = phi i16 [ 0, %entry ], [ %n1, %next ];
+	%a = load volatile i8* %portb;
+	%b = and i8 %a, 8;
+	%isset = icmp ne i8 %b, 0;
+	br i1 %isset, label %clear, label %set;
+
+set:
+	%c = load volatile i8* %portb;
+	%d = or i8 %c, 8;
+	store volatile i8 %d, i8* %portb;
+	%n2 = add i16 %n, 3;
+	br label %next;
+
+clear:
+	%e = load volatile i8* %portb;
+	%f = and i8 %e, -9;
+	store volatile i8 %f, i8* %portb;
+	%n3 = add i16 %n, 5;
+	br label %next;
+
+next:
+	%n1 = phi i16 [ %n2, %set ], [ %n3, %clear ];
+	%i1 = add i16 %i, 1;
+	%done = icmp eq i16 %i1, 100;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	%ocr0a = inttoptr i16 71 to i8*;
+	store volatile i8 42, i8* %ocr0a;
+	%g = load volatile i8* %ocr0a;
+	%h = zext i8 %g to i16;
+	%r = add i16 %n1, %h;
+	ret i16 %r;
+}
@@ -0,0 +1,46 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 8940
+
+; Copies of each size class, unrolled, one loop and more than one loop,
+; after a fill. The result is the sum of the bytes copied.
+
+@src = global [300 x i8] zeroinitializer
+@dst = global [300 x i8] zeroinitializer
+
+declare void @llvm.memcpy.p0i8.p0i8.i16(i8*, i8*, i16, i32, i1)
+declare void @llvm.memset.p0i8.i16(i8*, i8, i16, i32, i1)
+
+define i16 @sum(i8* %p, i16 %n) nounwind
+{
+entry:
+	br label %loop;
+
+loop:
+	%i = phi i16 [ 0, %entry ], [ %i.next, %loop ];
+	%acc = phi i16 [ 0, %entry ], [ %acc.next, %loop ];
+	%q = getelementptr i8* %p, i16 %i;
+	%v = load i8* %q;
+	%w = zext i8 %v to i16;
+	%acc.next = add i16 %acc, %w;
+	%i.next = add i16 %i, 1;
+	%done = icmp eq i16 %i.next, %n;
+	br i1 %done, label %exit, label %loop;
+
+exit:
+	ret i16 %acc.next;
+}
+
+define i16 @main() nounwind
+{
+	%s = getelementptr [300 x i8]* @src, i16 0, i16 0;
+	%d = getelementptr [300 x i8]* @dst, i16 0, i16 0;
+	call void @llvm.memset.p0i8.i16(i8* %s, i8 30, i16 298, i32 1, i1 false);
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d, i8* %s, i16 3, i32 1, i1 false);
+	%d1 = getelementptr [300 x i8]* @dst, i16 0, i16 3;
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d1, i8* %s, i16 40, i32 1, i1 false);
+	%d2 = getelementptr [300 x i8]* @dst, i16 0, i16 43;
+	call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d2, i8* %s, i16 255, i32 1, i1 false);
+	%r = call i16 @sum(i8* %d, i16 300);
+	ret i16 %r;
+}
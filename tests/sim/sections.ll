@@ -0,0 +1,34 @@
+; RUN: llc -march=avr -mcpu=avr25 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr25 %t.o | FileCheck %s
+; CHECK: returned: 142
+
+; Without JMP and CALL, calls and tail calls to another section are a RCALL
+; and a RJMP left to a relocation. The callees are local, so the relocations
+; are against the section, @second with an addend.
+
+define internal i16 @first(i16 %x) noinline nounwind section ".text.far"
+{
+	%a = add i16 %x, %x;
+	%r = add i16 %a, %x;
+	ret i16 %r;
+}
+
+define internal i16 @second(i16 %x) noinline nounwind section ".text.far"
+{
+	%r = add i16 %x, 100;
+	ret i16 %r;
+}
+
+define i16 @twice(i16 %x) noinline nounwind
+{
+	%a = shl i16 %x, 1;
+	%r = tail call i16 @second(i16 %a);
+	ret i16 %r;
+}
+
+define i16 @main() nounwind
+{
+	%a = call i16 @first(i16 7);
+	%r = call i16 @twice(i16 %a);
+	ret i16 %r;
+}
@@ -0,0 +1,42 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 22375
+
+; Twelve 32-bit values live at once, more than the registers hold.
+
+define i16 @mix(i32 %a, i32 %b, i32 %c) nounwind noinline
+{
+	%d = add i32 %a, %b;
+	%e = xor i32 %a, %c;
+	%f = sub i32 %b, %c;
+	%g = add i32 %d, 305419896;
+	%h = xor i32 %e, -1412567295;
+	%i = add i32 %f, %g;
+	%j = sub i32 %h, %d;
+	%k = xor i32 %i, %e;
+	%l = add i32 %j, %f;
+	%m = xor i32 %k, %g;
+	%n = add i32 %l, %h;
+	%o = sub i32 %m, %n;
+	%p = xor i32 %o, %i;
+	%q = add i32 %p, %j;
+	%r = xor i32 %q, %k;
+	%s = add i32 %r, %l;
+	%t = add i32 %s, %a;
+	%u = xor i32 %t, %b;
+	%v = add i32 %u, %c;
+	%w = add i32 %v, %d;
+	%x = xor i32 %w, %e;
+	%y = add i32 %x, %f;
+	%z = xor i32 %y, %m;
+	%hi = lshr i32 %z, 16;
+	%sum = add i32 %z, %hi;
+	%ret = trunc i32 %sum to i16;
+	ret i16 %ret;
+}
+
+define i16 @main() nounwind
+{
+	%r = call i16 @mix(i32 123456789, i32 -559038737, i32 42);
+	ret i16 %r;
+}
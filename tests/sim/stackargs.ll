@@ -0,0 +1,43 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 1398
+
+; Arguments past the 18 bytes of argument registers are stored above SP
+; before the call, next to a local of the caller that must survive it.
+
+define i16 @weigh(i16 %a1, i16 %a2, i16 %a3, i16 %a4, i16 %a5, i16 %a6,
+                  i16 %a7, i16 %a8, i16 %a9, i16 %a10, i8 %a11,
+                  i32 %a12) noinline nounwind
+{
+	%s1 = add i16 %a1, %a2;
+	%s2 = add i16 %s1, %a3;
+	%s3 = add i16 %s2, %a4;
+	%s4 = add i16 %s3, %a5;
+	%s5 = add i16 %s4, %a6;
+	%s6 = add i16 %s5, %a7;
+	%s7 = add i16 %s6, %a8;
+	%s8 = add i16 %s7, %a9;
+	%w10 = mul i16 %a10, 3;
+	%s9 = add i16 %s8, %w10;
+	%x11 = zext i8 %a11 to i16;
+	%w11 = mul i16 %x11, 5;
+	%s10 = add i16 %s9, %w11;
+	%lo = trunc i32 %a12 to i16;
+	%h = lshr i32 %a12, 16;
+	%hi = trunc i32 %h to i16;
+	%s11 = add i16 %s10, %lo;
+	%s12 = add i16 %s11, %hi;
+	ret i16 %s12;
+}
+
+define i16 @main() nounwind
+{
+	%buf = alloca [4 x i16];
+	%p = getelementptr [4 x i16]* %buf, i16 0, i16 3;
+	store volatile i16 1000, i16* %p;
+	%r = call i16 @weigh(i16 1, i16 2, i16 3, i16 4, i16 5, i16 6, i16 7,
+	                     i16 8, i16 9, i16 100, i8 7, i32 131088);
+	%v = load volatile i16* %p;
+	%s = add i16 %r, %v;
+	ret i16 %s;
+}
@@ -0,0 +1,42 @@
+; RUN: llc -march=avr -mcpu=avr5 -filetype=obj %s -o %t.o
+; RUN: avr-sim -mcpu=avr5 %t.o | FileCheck %s
+; CHECK: returned: 751
+; CHECK: stack: {{[0-9]|1[0-9]}} bytes
+
+; A state machine of tail calls, direct and through a table, 3000 deep.
+; Without tail calls it would take 6000 bytes of stack.
+
+@states = global [2 x i16 (i16, i16)*] [i16 (i16, i16)* @even,
+                                        i16 (i16, i16)* @odd]
+
+define i16 @even(i16 %n, i16 %acc) nounwind
+{
+	%done = icmp eq i16 %n, 0;
+	br i1 %done, label %exit, label %next;
+
+next:
+	%m = sub i16 %n, 1;
+	%a = add i16 %acc, 1;
+	%r = tail call i16 @odd(i16 %m, i16 %a);
+	ret i16 %r;
+
+exit:
+	ret i16 %acc;
+}
+
+define i16 @odd(i16 %n, i16 %acc) nounwind
+{
+	%m = sub i16 %n, 1;
+	%bit = and i16 %n, 2;
+	%i = lshr i16 %bit, 1;
+	%p = getelementptr [2 x i16 (i16, i16)*]* @states, i16 0, i16 %i;
+	%f = load i16 (i16, i16)** %p;
+	%r = tail call i16 %f(i16 %m, i16 %acc);
+	ret i16 %r;
+}
+
+define i16 @main() nounwind
+{
+	%r = call i16 @even(i16 3000, i16 1);
+	ret i16 %r;
+}
@@ -0,0 +1,1236 @@
+//===-- avr-sim.cpp - Cycle counting simulator for AVR code ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program runs the code of the AVR backend and counts the cycles it
+// takes. It loads relocatable objects, as llc -filetype=obj writes them, and
+// links them itself: code and .progmem go to flash, everything else to data
+// memory. Executables linked by avr-ld are loaded as they are.
+//
+// Instructions are decoded by the AVR disassembler and cost what the
+// itineraries of the -mcpu device say, with the extra cycles of taken
+// branches and skips added. The run starts at -entry with a return address
+// that ends it, or at the reset vector of an executable, which ends in the
+// "rjmp .-2" of _exit. The I/O space is plain memory apart from SREG, SP and
+// an optional console port.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AVR.h"
+#include "MCTargetDesc/AVRBaseInfo.h"
+#include "llvm/MC/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCInstrItineraries.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MemoryObject.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+#include <algorithm>
+#include <vector>
+using namespace llvm;
+
+extern "C" void LLVMInitializeAVRTargetInfo();
+extern "C" void LLVMInitializeAVRTargetMC();
+extern "C" void LLVMInitializeAVRDisassembler();
+
+static cl::list<std::string>
+InputFilenames(cl::Positional, cl::desc("<input objects>"), cl::OneOrMore);
+
+static cl::opt<std::string>
+MCPU("mcpu", cl::desc("The device, as given to llc (default: generic)"),
+     cl::value_desc("cpu-name"), cl::init("generic"));
+
+static cl::opt<std::string>
+EntryName("entry", cl::desc("Function to run (default: main, or the reset "
+                            "vector of an executable)"),
+          cl::value_desc("symbol"));
+
+static cl::opt<unsigned>
+RAMStart("ram-start", cl::desc("First address of SRAM (default: 0x100, "
+                               "0x2000 for XMEGA)"));
+
+static cl::opt<unsigned>
+RAMSize("ram-size", cl::desc("Size of SRAM in bytes (default: 0x800, "
+                             "0x2000 for XMEGA)"));
+
+static cl::opt<unsigned>
+ConsolePort("console-port", cl::desc("Data address whose writes are "
+                                     "printed as characters"));
+
+static cl::opt<unsigned long long>
+MaxCycles("max-cycles", cl::desc("Give up after this many cycles"),
+          cl::init(1000000000ULL));
+
+static cl::opt<bool>
+Histogram("histogram", cl::desc("Print the instructions run and their "
+                                "cycles, by opcode"));
+
+static const char *ToolName;
+
+static void fatal(const Twine &Msg) LLVM_ATTRIBUTE_NORETURN;
+static void fatal(const Twine &Msg) {
+  errs() << ToolName << ": " << Msg << "\n";
+  exit(1);
+}
+
+//===----------------------------------------------------------------------===//
+// Loading
+//===----------------------------------------------------------------------===//
+
+namespace {
+  // The relocations of the AVR ELF ABI that AVRELFObjectWriter writes.
+  enum {
+    R_AVR_NONE       = 0,
+    R_AVR_32         = 1,
+    R_AVR_7_PCREL    = 2,
+    R_AVR_13_PCREL   = 3,
+    R_AVR_16         = 4,
+    R_AVR_LO8_LDI    = 6,
+    R_AVR_HI8_LDI    = 7,
+    R_AVR_LO8_LDI_PM = 12,
+    R_AVR_HI8_LDI_PM = 13,
+    R_AVR_CALL       = 18,
+    R_AVR_8          = 26
+  };
+
+  // Data addresses are offset by this in the ELF files of avr-ld.
+  const uint32_t DataOffset = 0x800000;
+
+  /// Image - Flash and data memory as loaded, and where the run starts.
+  struct Image {
+    std::vector<uint8_t> Flash;
+    std::vector<uint8_t> Data;   // The whole 64K of data space
+    uint32_t DataEnd;            // End of .data and .bss
+    uint32_t Entry;              // Byte address in flash
+    bool FromReset;              // Entry is the reset vector of an executable
+    StringMap<uint32_t> Symbols; // Defined symbols
+
+    Image() : Data(0x10000), DataEnd(0), Entry(0), FromReset(false) {}
+  };
+
+  /// ELFFile - The parts of an ELF32 file of AVR that the loader needs.
+  class ELFFile {
+    StringRef Buf;
+    std::string Name;
+
+  public:
+    ELFFile(StringRef Buf, StringRef Name) : Buf(Buf), Name(Name) {}
+
+    uint8_t read8(uint32_t Off) const {
+      if (Off >= Buf.size())
+        fatal(Name + ": truncated file");
+      return Buf[Off];
+    }
+    uint16_t read16(uint32_t Off) const {
+      return read8(Off) | (read8(Off + 1) << 8);
+    }
+    uint32_t read32(uint32_t Off) const {
+      return read16(Off) | (uint32_t(read16(Off + 2)) << 16);
+    }
+    StringRef bytes(uint32_t Off, uint32_t Size) const {
+      if (Off > Buf.size() || Size > Buf.size() - Off)
+        fatal(Name + ": truncated file");
+      return Buf.substr(Off, Size);
+    }
+    StringRef string(uint32_t Off) const {
+      if (Off >= Buf.size())
+        fatal(Name + ": bad string table offset");
+      return StringRef(Buf.data() + Off);
+    }
+
+    const std::string &getName() const { return Name; }
+
+    void check() const {
+      if (Buf.size() < 52 || Buf.substr(0, 4) != "\177ELF")
+        fatal(Name + ": not an ELF file");
+      if (read8(ELF::EI_CLASS) != ELF::ELFCLASS32 ||
+          read8(ELF::EI_DATA) != ELF::ELFDATA2LSB ||
+          read16(18) != ELF::EM_AVR)
+        fatal(Name + ": not an AVR ELF file");
+    }
+
+    uint16_t getType() const { return read16(16); }
+    uint32_t getEntry() const { return read32(24); }
+    unsigned getNumSections() const { return read16(48); }
+    unsigned getNumSegments() const { return read16(44); }
+
+    // Section header fields.
+    uint32_t sh(unsigned Idx, unsigned Field) const {
+      return read32(read32(32) + Idx * read16(46) + Field * 4);
+    }
+    StringRef getSectionName(unsigned Idx) const {
+      return string(sh(read16(50), 4) + sh(Idx, 0));
+    }
+    uint32_t getSectionType(unsigned Idx) const { return sh(Idx, 1); }
+    uint32_t getSectionFlags(unsigned Idx) const { return sh(Idx, 2); }
+    uint32_t getSectionOffset(unsigned Idx) const { return sh(Idx, 4); }
+    uint32_t getSectionSize(unsigned Idx) const { return sh(Idx, 5); }
+    uint32_t getSectionLink(unsigned Idx) const { return sh(Idx, 6); }
+    uint32_t getSectionInfo(unsigned Idx) const { return sh(Idx, 7); }
+    uint32_t getSectionAlign(unsigned Idx) const { return sh(Idx, 8); }
+
+    // Program header fields.
+    uint32_t ph(unsigned Idx, unsigned Field) const {
+      return read32(read32(28) + Idx * read16(42) + Field * 4);
+    }
+  };
+
+  /// Symbol - A symbol of a relocatable object, by its place in the file.
+  struct Symbol {
+    StringRef Name;
+    uint32_t Value;
+    uint16_t Section;
+    uint8_t Binding;
+    uint32_t Size;
+  };
+}
+
+/// isFlashSection - Code, and constants put in program memory.
+static bool isFlashSection(const ELFFile &F, unsigned Idx) {
+  return (F.getSectionFlags(Idx) & ELF::SHF_EXECINSTR) ||
+         F.getSectionName(Idx).startswith(".progmem");
+}
+
+/// getProgmemSegment - .progmemN.data is read with RAMPZ set to N, so it has
+/// to be in the Nth 64K of flash.
+static unsigned getProgmemSegment(StringRef Name) {
+  unsigned Segment = 0;
+  if (Name.startswith(".progmem") && Name.size() > 8 &&
+      Name[8] >= '1' && Name[8] <= '5')
+    Segment = Name[8] - '0';
+  return Segment;
+}
+
+static uint32_t alignTo(uint32_t Value, uint32_t Align) {
+  if (Align < 2)
+    return Value;
+  return (Value + Align - 1) / Align * Align;
+}
+
+/// getRelocationSize - The bytes a relocation changes.
+static unsigned getRelocationSize(unsigned Type) {
+  switch (Type) {
+  case R_AVR_8:    return 1;
+  case R_AVR_32:
+  case R_AVR_CALL: return 4;
+  default:         return 2;
+  }
+}
+
+/// applyWord - Replace the field Mask of the little endian word at P with
+/// Bits. Whatever the assembler left in the field is dropped, as avr-ld
+/// does.
+static void applyWord(uint8_t *P, unsigned Mask, unsigned Bits) {
+  unsigned W = P[0] | (P[1] << 8);
+  W = (W & ~Mask) | (Bits & Mask);
+  P[0] = W & 0xff;
+  P[1] = (W >> 8) & 0xff;
+}
+
+/// applyLDIByte - The constant of LDI: 1110 KKKK dddd KKKK.
+static void applyLDIByte(uint8_t *P, unsigned Byte) {
+  applyWord(P, 0x0f0f, ((Byte & 0xf0) << 4) | (Byte & 0x0f));
+}
+
+/// applyRelocation - Put the value of a relocation into its place, as
+/// avr-ld does. P is the address of the place, and the same kind of
+/// address as S for the relative ones.
+static void applyRelocation(const ELFFile &F, uint8_t *Place, unsigned Type,
+                            uint32_t S, int32_t A, uint32_t P) {
+  uint32_t Value = S + A;
+  switch (Type) {
+  default:
+    fatal(F.getName() + ": unsupported relocation type " + Twine(Type));
+  case R_AVR_NONE:
+    break;
+  case R_AVR_8:
+    Place[0] = Value;
+    break;
+  case R_AVR_16:
+    Place[0] = Value;
+    Place[1] = Value >> 8;
+    break;
+  case R_AVR_32:
+    for (unsigned i = 0; i != 4; ++i)
+      Place[i] = Value >> (i * 8);
+    break;
+  case R_AVR_7_PCREL:
+  case R_AVR_13_PCREL: {
+    unsigned Bits = Type == R_AVR_7_PCREL ? 7 : 12;
+    int32_t Offset = (int32_t(Value - P) - 2) >> 1;
+    if (Offset < -(1 << (Bits - 1)) || Offset >= (1 << (Bits - 1)))
+      fatal(F.getName() + ": branch target out of range");
+    Offset &= (1 << Bits) - 1;
+    if (Type == R_AVR_7_PCREL)
+      applyWord(Place, 0x7f << 3, Offset << 3);
+    else
+      applyWord(Place, 0xfff, Offset);
+    break;
+  }
+  case R_AVR_LO8_LDI:    applyLDIByte(Place, Value & 0xff); break;
+  case R_AVR_HI8_LDI:    applyLDIByte(Place, (Value >> 8) & 0xff); break;
+  case R_AVR_LO8_LDI_PM: applyLDIByte(Place, (Value >> 1) & 0xff); break;
+  case R_AVR_HI8_LDI_PM: applyLDIByte(Place, (Value >> 9) & 0xff); break;
+  case R_AVR_CALL: {
+    uint32_t Word = Value >> 1;
+    applyWord(Place, 0x01f1,
+              (((Word >> 17) & 0x1f) << 4) | ((Word >> 16) & 1));
+    applyWord(Place + 2, 0xffff, Word & 0xffff);
+    break;
+  }
+  }
+}
+
+/// loadExecutable - Load the segments of a file linked by avr-ld. The
+/// initial values of .data are put in data memory as well as in flash, for
+/// the entry points that do not run the startup code.
+static void loadExecutable(const ELFFile &F, Image &Img) {
+  for (unsigned i = 0, e = F.getNumSegments(); i != e; ++i) {
+    if (F.ph(i, 0) != ELF::PT_LOAD)
+      continue;
+    uint32_t Offset = F.ph(i, 1), VAddr = F.ph(i, 2), PAddr = F.ph(i, 3);
+    uint32_t FileSize = F.ph(i, 4), MemSize = F.ph(i, 5);
+    StringRef Contents = F.bytes(Offset, FileSize);
+
+    if (VAddr >= DataOffset) {
+      uint32_t Addr = VAddr - DataOffset;
+      if (Addr + MemSize > Img.Data.size())
+        fatal(F.getName() + ": segment outside data memory");
+      std::copy(Contents.begin(), Contents.end(), Img.Data.begin() + Addr);
+      Img.DataEnd = std::max(Img.DataEnd, Addr + MemSize);
+      if (PAddr >= DataOffset || FileSize == 0)
+        continue;
+    }
+
+    if (PAddr + FileSize > Img.Flash.size())
+      Img.Flash.resize(PAddr + FileSize, 0xff);
+    std::copy(Contents.begin(), Contents.end(), Img.Flash.begin() + PAddr);
+  }
+
+  // The symbols are only needed for -entry.
+  for (unsigned i = 0, e = F.getNumSections(); i != e; ++i) {
+    if (F.getSectionType(i) != ELF::SHT_SYMTAB)
+      continue;
+    unsigned StrTab = F.getSectionLink(i);
+    for (uint32_t Off = F.getSectionOffset(i) + 16,
+         End = F.getSectionOffset(i) + F.getSectionSize(i);
+         Off < End; Off += 16) {
+      if (F.read16(Off + 14) == ELF::SHN_UNDEF)
+        continue;
+      StringRef Name = F.string(F.getSectionOffset(StrTab) + F.read32(Off));
+      if (!Name.empty())
+        Img.Symbols[Name] = F.read32(Off + 4);
+    }
+  }
+
+  Img.Entry = F.getEntry();
+  Img.FromReset = true;
+}
+
+/// loadObjects - Lay the sections of relocatable objects out in memory,
+/// one file after the other, and resolve their relocations against each
+/// other.
+static void loadObjects(const std::vector<ELFFile*> &Files, Image &Img,
+                        uint32_t DataStart) {
+  std::vector<std::vector<uint32_t> > SectionAddrs(Files.size());
+  std::vector<std::vector<Symbol> > Symbols(Files.size());
+  StringMap<bool> WeakSymbols;
+  uint32_t FlashEnd[6] = { 0, 0, 0, 0, 0, 0 };
+  uint32_t DataEnd = DataStart;
+
+  // Place the sections.
+  for (unsigned f = 0; f != Files.size(); ++f) {
+    const ELFFile &F = *Files[f];
+    SectionAddrs[f].resize(F.getNumSections(), 0);
+    for (unsigned i = 1, e = F.getNumSections(); i != e; ++i) {
+      if (!(F.getSectionFlags(i) & ELF::SHF_ALLOC))
+        continue;
+      uint32_t Size = F.getSectionSize(i);
+      uint32_t Align = F.getSectionAlign(i);
+
+      if (isFlashSection(F, i)) {
+        unsigned Segment = getProgmemSegment(F.getSectionName(i));
+        uint32_t Addr = alignTo(FlashEnd[Segment], std::max(Align, 2U));
+        SectionAddrs[f][i] = (Segment << 16) + Addr;
+        FlashEnd[Segment] = Addr + Size;
+        if (FlashEnd[Segment] > 0x10000)
+          fatal(F.getName() + ": " + F.getSectionName(i) +
+                " does not fit its 64K of flash");
+        continue;
+      }
+
+      uint32_t Addr = alignTo(DataEnd, Align);
+      SectionAddrs[f][i] = Addr;
+      DataEnd = Addr + Size;
+    }
+  }
+
+  // Read the symbols. Common ones are given space after .bss.
+  for (unsigned f = 0; f != Files.size(); ++f) {
+    const ELFFile &F = *Files[f];
+    for (unsigned i = 0, e = F.getNumSections(); i != e; ++i) {
+      if (F.getSectionType(i) != ELF::SHT_SYMTAB)
+        continue;
+      unsigned StrTab = F.getSectionLink(i);
+      for (uint32_t Off = F.getSectionOffset(i),
+           End = Off + F.getSectionSize(i); Off < End; Off += 16) {
+        Symbol Sym;
+        Sym.Name = F.string(F.getSectionOffset(StrTab) + F.read32(Off));
+        Sym.Value = F.read32(Off + 4);
+        Sym.Size = F.read32(Off + 8);
+        Sym.Binding = F.read8(Off + 12) >> 4;
+        Sym.Section = F.read16(Off + 14);
+
+        if (Sym.Section == ELF::SHN_COMMON) {
+          uint32_t Addr = alignTo(DataEnd, Sym.Value);
+          DataEnd = Addr + Sym.Size;
+          Sym.Value = Addr;
+        } else if (Sym.Section != ELF::SHN_UNDEF &&
+                   Sym.Section < ELF::SHN_LORESERVE) {
+          Sym.Value += SectionAddrs[f][Sym.Section];
+        }
+        Symbols[f].push_back(Sym);
+
+        // A weak definition gives way to any other.
+        if (Sym.Binding == ELF::STB_LOCAL || Sym.Section == ELF::SHN_UNDEF ||
+            Sym.Name.empty())
+          continue;
+        bool IsWeak = Sym.Binding == ELF::STB_WEAK;
+        if (Img.Symbols.count(Sym.Name)) {
+          if (IsWeak)
+            continue;
+          if (!WeakSymbols[Sym.Name])
+            fatal(F.getName() + ": " + Sym.Name + " is defined twice");
+        }
+        Img.Symbols[Sym.Name] = Sym.Value;
+        WeakSymbols[Sym.Name] = IsWeak;
+      }
+    }
+  }
+
+  // Copy the contents.
+  Img.Flash.resize(std::max(FlashEnd[0], 2U), 0xff);
+  for (unsigned Segment = 1; Segment != 6; ++Segment)
+    if (FlashEnd[Segment])
+      Img.Flash.resize((Segment << 16) + FlashEnd[Segment], 0xff);
+  if (DataEnd > Img.Data.size())
+    fatal("data does not fit in data memory");
+  Img.DataEnd = DataEnd;
+
+  for (unsigned f = 0; f != Files.size(); ++f) {
+    const ELFFile &F = *Files[f];
+    for (unsigned i = 1, e = F.getNumSections(); i != e; ++i) {
+      if (!(F.getSectionFlags(i) & ELF::SHF_ALLOC) ||
+          F.getSectionType(i) == ELF::SHT_NOBITS)
+        continue;
+      StringRef Contents = F.bytes(F.getSectionOffset(i),
+                                   F.getSectionSize(i));
+      std::vector<uint8_t> &Mem = isFlashSection(F, i) ? Img.Flash : Img.Data;
+      std::copy(Contents.begin(), Contents.end(),
+                Mem.begin() + SectionAddrs[f][i]);
+    }
+  }
+
+  // Resolve the relocations.
+  for (unsigned f = 0; f != Files.size(); ++f) {
+    const ELFFile &F = *Files[f];
+    for (unsigned i = 0, e = F.getNumSections(); i != e; ++i) {
+      if (F.getSectionType(i) != ELF::SHT_RELA)
+        continue;
+      unsigned Target = F.getSectionInfo(i);
+      if (!(F.getSectionFlags(Target) & ELF::SHF_ALLOC))
+        continue;
+      bool InFlash = isFlashSection(F, Target);
+      std::vector<uint8_t> &Mem = InFlash ? Img.Flash : Img.Data;
+
+      for (uint32_t Off = F.getSectionOffset(i),
+           End = Off + F.getSectionSize(i); Off < End; Off += 12) {
+        uint32_t P = SectionAddrs[f][Target] + F.read32(Off);
+        uint32_t Info = F.read32(Off + 4);
+        int32_t Addend = F.read32(Off + 8);
+        const Symbol &Sym = Symbols[f][Info >> 8];
+
+        uint32_t S = Sym.Value;
+        if (Sym.Section == ELF::SHN_UNDEF && !Sym.Name.empty()) {
+          StringMap<uint32_t>::const_iterator I = Img.Symbols.find(Sym.Name);
+          if (I != Img.Symbols.end())
+            S = I->second;
+          else if (Sym.Binding != ELF::STB_WEAK)
+            fatal(F.getName() + ": undefined symbol " + Sym.Name);
+        }
+
+        unsigned Type = Info & 0xff;
+        if (P + getRelocationSize(Type) > Mem.size())
+          fatal(F.getName() + ": relocation outside its section");
+        applyRelocation(F, &Mem[P], Type, S, Addend, P);
+      }
+    }
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Running
+//===----------------------------------------------------------------------===//
+
+namespace {
+  /// FlashObject - Flash, as the disassembler reads it.
+  class FlashObject : public MemoryObject {
+    const std::vector<uint8_t> &Flash;
+
+  public:
+    FlashObject(const std::vector<uint8_t> &Flash) : Flash(Flash) {}
+
+    uint64_t getBase() const { return 0; }
+    uint64_t getExtent() const { return Flash.size(); }
+
+    int readByte(uint64_t Addr, uint8_t *Byte) const {
+      if (Addr >= getExtent())
+        return -1;
+      *Byte = Flash[Addr];
+      return 0;
+    }
+  };
+
+  /// Decoded - An instruction of flash, decoded on first use.
+  struct Decoded {
+    MCInst Inst;
+    unsigned Words;   // 0 until decoded
+    unsigned Cycles;  // From the itinerary
+    bool Valid;
+
+    Decoded() : Words(0), Cycles(0), Valid(false) {}
+  };
+
+  enum {
+    SREG_C = 0, SREG_Z, SREG_N, SREG_V, SREG_S, SREG_H, SREG_T, SREG_I
+  };
+
+  // I/O addresses of the core registers, the same on all devices.
+  enum {
+    IO_RAMPZ = 0x3b,
+    IO_SPL   = 0x3d,
+    IO_SPH   = 0x3e,
+    IO_SREG  = 0x3f
+  };
+
+  class Simulator {
+    Image &Img;
+    const MCDisassembler &Dis;
+    const MCInstrInfo &MII;
+    InstrItineraryData Itins;
+    FlashObject FlashObj;
+    std::vector<Decoded> Code;
+
+    // Classic devices map the registers to data addresses 0 to 31 and the
+    // I/O space after them, XMEGA has the I/O space at 0.
+    bool IsXMEGA;
+    bool Has22BitPC;
+    unsigned IOBase;
+
+    uint8_t R[32];
+    uint8_t SREG;
+    uint16_t SP;
+    uint32_t PC;
+
+  public:
+    uint64_t Cycles;
+    uint64_t Instructions;
+    uint16_t MinSP;
+    std::vector<uint64_t> OpcodeCounts;
+    std::vector<uint64_t> OpcodeCycles;
+
+    Simulator(Image &Img, const MCDisassembler &Dis, const MCInstrInfo &MII,
+              const MCSubtargetInfo &STI, StringRef CPU, uint16_t RAMEnd)
+      : Img(Img), Dis(Dis), MII(MII),
+        Itins(STI.getInstrItineraryForCPU(CPU)), FlashObj(Img.Flash),
+        Code(Img.Flash.size() / 2), SREG(0), SP(RAMEnd), PC(0), Cycles(0),
+        Instructions(0), MinSP(RAMEnd),
+        OpcodeCounts(MII.getNumOpcodes()), OpcodeCycles(MII.getNumOpcodes()) {
+      IsXMEGA = STI.getFeatureBits() & AVR::FeatureXMEGA;
+      Has22BitPC = STI.getFeatureBits() & AVR::FeatureEIJMPCALL;
+      IOBase = IsXMEGA ? 0 : 0x20;
+      std::fill(R, R + 32, 0);
+    }
+
+    uint16_t getReturnValue() const { return R[24] | (R[25] << 8); }
+
+    void pushPC(uint32_t Value);
+    uint32_t popPC();
+    bool run(uint32_t Start, uint32_t Exit);
+
+  private:
+    const Decoded &decode(uint32_t Addr);
+    void execute(const Decoded &D);
+
+    bool getFlag(unsigned Bit) const { return SREG & (1 << Bit); }
+    void setFlag(unsigned Bit, bool Value) {
+      if (Value)
+        SREG |= 1 << Bit;
+      else
+        SREG &= ~(1 << Bit);
+    }
+    void setNZS(unsigned Result) {
+      setFlag(SREG_N, Result & 0x80);
+      setFlag(SREG_Z, (Result & 0xff) == 0);
+      setFlag(SREG_S, getFlag(SREG_N) != getFlag(SREG_V));
+    }
+
+    uint8_t add(uint8_t A, uint8_t B, bool Carry);
+    uint8_t sub(uint8_t A, uint8_t B, bool Carry, bool KeepZ);
+    uint8_t logic(uint8_t Result);
+    void multiply(int A, int B, bool Fractional);
+
+    unsigned reg(const MCInst &MI, unsigned OpNo) const {
+      return getAVRRegisterNumbering(MI.getOperand(OpNo).getReg());
+    }
+    uint16_t pair(unsigned Lo) const { return R[Lo] | (R[Lo + 1] << 8); }
+    void setPair(unsigned Lo, uint16_t Value) {
+      R[Lo] = Value;
+      R[Lo + 1] = Value >> 8;
+    }
+
+    uint8_t readIO(unsigned A);
+    void writeIO(unsigned A, uint8_t Value);
+    uint8_t readData(uint16_t Addr);
+    void writeData(uint16_t Addr, uint8_t Value);
+    uint8_t readFlash(uint32_t Addr);
+
+    void push(uint8_t Value) {
+      writeData(SP--, Value);
+      if (SP < MinSP)
+        MinSP = SP;
+      if (SP < Img.DataEnd)
+        fatal("the stack ran into .data and .bss at PC " +
+              Twine::utohexstr(PC * 2));
+    }
+    uint8_t pop() { return readData(++SP); }
+  };
+}
+
+const Decoded &Simulator::decode(uint32_t Addr) {
+  if (Addr >= Code.size())
+    fatal("PC outside flash: 0x" + Twine::utohexstr(Addr * 2));
+
+  Decoded &D = Code[Addr];
+  if (D.Words)
+    return D;
+
+  uint64_t Size;
+  D.Valid = Dis.getInstruction(D.Inst, Size, FlashObj, Addr * 2, nulls(),
+                               nulls()) == MCDisassembler::Success;
+  D.Words = Size ? Size / 2 : 1;
+  if (D.Valid)
+    D.Cycles = Itins.getStageLatency(
+      MII.get(D.Inst.getOpcode()).getSchedClass());
+  return D;
+}
+
+uint8_t Simulator::readIO(unsigned A) {
+  switch (A) {
+  case IO_SREG: return SREG;
+  case IO_SPL:  return SP & 0xff;
+  case IO_SPH:  return SP >> 8;
+  default:      return Img.Data[IOBase + A];
+  }
+}
+
+void Simulator::writeIO(unsigned A, uint8_t Value) {
+  switch (A) {
+  case IO_SREG: SREG = Value; break;
+  case IO_SPL:  SP = (SP & 0xff00) | Value; break;
+  case IO_SPH:  SP = (SP & 0x00ff) | (Value << 8); break;
+  default:      Img.Data[IOBase + A] = Value; break;
+  }
+  MinSP = std::min(MinSP, SP);
+
+  if (ConsolePort && IOBase + A == ConsolePort)
+    outs() << char(Value);
+}
+
+uint8_t Simulator::readData(uint16_t Addr) {
+  if (!IsXMEGA && Addr < 32)
+    return R[Addr];
+  if (Addr >= IOBase && Addr < IOBase + 64)
+    return readIO(Addr - IOBase);
+  return Img.Data[Addr];
+}
+
+void Simulator::writeData(uint16_t Addr, uint8_t Value) {
+  if (!IsXMEGA && Addr < 32)
+    R[Addr] = Value;
+  else if (Addr >= IOBase && Addr < IOBase + 64)
+    writeIO(Addr - IOBase, Value);
+  else {
+    Img.Data[Addr] = Value;
+    if (ConsolePort && Addr == ConsolePort)
+      outs() << char(Value);
+  }
+}
+
+uint8_t Simulator::readFlash(uint32_t Addr) {
+  return Addr < Img.Flash.size() ? Img.Flash[Addr] : 0xff;
+}
+
+/// pushPC - The return address goes on the stack low byte first, so that
+/// it reads high byte first.
+void Simulator::pushPC(uint32_t Value) {
+  push(Value & 0xff);
+  push((Value >> 8) & 0xff);
+  if (Has22BitPC)
+    push((Value >> 16) & 0xff);
+}
+
+uint32_t Simulator::popPC() {
+  uint32_t Value = 0;
+  if (Has22BitPC)
+    Value = pop() << 16;
+  Value |= pop() << 8;
+  Value |= pop();
+  return Value;
+}
+
+uint8_t Simulator::add(uint8_t A, uint8_t B, bool Carry) {
+  unsigned Sum = A + B + Carry;
+  uint8_t Result = Sum;
+  setFlag(SREG_H, (A & 0xf) + (B & 0xf) + Carry > 0xf);
+  setFlag(SREG_V, ~(A ^ B) & (A ^ Result) & 0x80);
+  setFlag(SREG_C, Sum > 0xff);
+  setNZS(Result);
+  return Result;
+}
+
+/// sub - The Z flag of SBC, SBCI and CPC is only ever cleared, so that it
+/// holds for all bytes of a wider value.
+uint8_t Simulator::sub(uint8_t A, uint8_t B, bool Carry, bool KeepZ) {
+  uint8_t Result = A - B - Carry;
+  bool Z = getFlag(SREG_Z);
+  setFlag(SREG_H, (A & 0xf) < (B & 0xf) + Carry);
+  setFlag(SREG_V, (A ^ B) & (A ^ Result) & 0x80);
+  setFlag(SREG_C, A < B + Carry);
+  setNZS(Result);
+  if (KeepZ)
+    setFlag(SREG_Z, Result == 0 && Z);
+  return Result;
+}
+
+uint8_t Simulator::logic(uint8_t Result) {
+  setFlag(SREG_V, false);
+  setNZS(Result);
+  return Result;
+}
+
+/// multiply - The product goes to R1:R0. The fractional ones shift it left
+/// by one, and leave the bit shifted out in C.
+void Simulator::multiply(int A, int B, bool Fractional) {
+  uint16_t Product = A * B;
+  setFlag(SREG_C, Product & 0x8000);
+  if (Fractional)
+    Product <<= 1;
+  setFlag(SREG_Z, Product == 0);
+  setPair(0, Product);
+}
+
+static bool testCondition(unsigned CC, uint8_t SREG) {
+  bool Set;
+  switch (CC) {
+  default: llvm_unreachable("Unknown condition code!");
+  case AVRCC::COND_E:   case AVRCC::COND_NE:  Set = SREG & (1 << SREG_Z); break;
+  case AVRCC::COND_LO:  case AVRCC::COND_HS:  Set = SREG & (1 << SREG_C); break;
+  case AVRCC::COND_L:   case AVRCC::COND_GE:  Set = SREG & (1 << SREG_S); break;
+  case AVRCC::COND_MI:  case AVRCC::COND_PL:  Set = SREG & (1 << SREG_N); break;
+  case AVRCC::COND_VS:  case AVRCC::COND_VC:  Set = SREG & (1 << SREG_V); break;
+  case AVRCC::COND_TS:  case AVRCC::COND_TC:  Set = SREG & (1 << SREG_T); break;
+  case AVRCC::COND_HCS: case AVRCC::COND_HCC: Set = SREG & (1 << SREG_H); break;
+  case AVRCC::COND_IE:  case AVRCC::COND_ID:  Set = SREG & (1 << SREG_I); break;
+  }
+
+  // The first of each pair branches if the flag is set.
+  switch (CC) {
+  case AVRCC::COND_E: case AVRCC::COND_LO: case AVRCC::COND_L:
+  case AVRCC::COND_MI: case AVRCC::COND_VS: case AVRCC::COND_TS:
+  case AVRCC::COND_HCS: case AVRCC::COND_IE:
+    return Set;
+  default:
+    return !Set;
+  }
+}
+
+/// execute - Run the instruction at PC, and move PC on. Taken branches and
+/// skips cost more than their itinerary, which is for falling through.
+void Simulator::execute(const Decoded &D) {
+  const MCInst &MI = D.Inst;
+  uint32_t NextPC = PC + D.Words;
+  unsigned Extra = 0;
+
+  switch (MI.getOpcode()) {
+  default:
+    fatal(Twine("no simulation of ") + MII.getName(MI.getOpcode()) +
+          " at PC 0x" + Twine::utohexstr(PC * 2));
+
+  case AVR::NOP:
+    break;
+
+  // Control flow. Relative targets are in bytes from the next instruction,
+  // absolute ones are byte addresses.
+  case AVR::RJMP:
+    NextPC += MI.getOperand(0).getImm() / 2;
+    break;
+  case AVR::JMP:
+    NextPC = MI.getOperand(0).getImm() / 2;
+    break;
+  case AVR::IJMP:
+    NextPC = R[30] | R[31] << 8;
+    break;
+  case AVR::JCC:
+    if (testCondition(MI.getOperand(1).getImm(), SREG)) {
+      NextPC += MI.getOperand(0).getImm() / 2;
+      Extra = 1;
+    }
+    break;
+  case AVR::RCALL:
+    pushPC(NextPC);
+    NextPC += MI.getOperand(0).getImm() / 2;
+    break;
+  case AVR::CALL:
+    pushPC(NextPC);
+    NextPC = MI.getOperand(0).getImm() / 2;
+    break;
+  case AVR::RET:
+    NextPC = popPC();
+    break;
+  case AVR::RETI:
+    NextPC = popPC();
+    setFlag(SREG_I, true);
+    break;
+  case AVR::SBRCrb:
+  case AVR::SBRSrb: {
+    bool Set = R[reg(MI, 0)] & (1 << MI.getOperand(1).getImm());
+    if (Set == (MI.getOpcode() == AVR::SBRSrb)) {
+      unsigned Skipped = decode(NextPC).Words;
+      NextPC += Skipped;
+      Extra = Skipped;
+    }
+    break;
+  }
+
+  // I/O.
+  case AVR::INrA:
+    R[reg(MI, 0)] = readIO(MI.getOperand(1).getImm());
+    break;
+  case AVR::OUTAr:
+    writeIO(MI.getOperand(0).getImm(), R[reg(MI, 1)]);
+    break;
+  case AVR::SBIAb:
+  case AVR::CBIAb: {
+    unsigned A = MI.getOperand(0).getImm();
+    uint8_t Bit = 1 << MI.getOperand(1).getImm();
+    uint8_t Value = readIO(A);
+    writeIO(A, MI.getOpcode() == AVR::SBIAb ? Value | Bit : Value & ~Bit);
+    break;
+  }
+  case AVR::SBICAb:
+  case AVR::SBISAb: {
+    bool Set = readIO(MI.getOperand(0).getImm()) &
+               (1 << MI.getOperand(1).getImm());
+    if (Set == (MI.getOpcode() == AVR::SBISAb)) {
+      unsigned Skipped = decode(NextPC).Words;
+      NextPC += Skipped;
+      Extra = Skipped;
+    }
+    break;
+  }
+  case AVR::CLI:
+    setFlag(SREG_I, false);
+    break;
+  case AVR::SEI:
+    setFlag(SREG_I, true);
+    break;
+  case AVR::PUSH:
+    push(R[reg(MI, 0)]);
+    break;
+  case AVR::POP:
+    R[reg(MI, 0)] = pop();
+    break;
+
+  // Moves.
+  case AVR::MOV8rr:
+    R[reg(MI, 0)] = R[reg(MI, 1)];
+    break;
+  case AVR::MOV16rr:
+    setPair(reg(MI, 0), pair(reg(MI, 1)));
+    break;
+  case AVR::MOV8ri:
+    R[reg(MI, 0)] = MI.getOperand(1).getImm();
+    break;
+
+  // Loads and stores.
+  case AVR::MOV8rm:
+    R[reg(MI, 0)] = readData(MI.getOperand(1).getImm());
+    break;
+  case AVR::MOV8mr:
+    writeData(MI.getOperand(0).getImm(), R[reg(MI, 1)]);
+    break;
+  case AVR::MOV8rm_INDEX:
+    R[reg(MI, 0)] = readData(pair(reg(MI, 1)) + MI.getOperand(2).getImm());
+    break;
+  case AVR::MOV8mr_INDEX:
+    writeData(pair(reg(MI, 0)) + MI.getOperand(1).getImm(), R[reg(MI, 2)]);
+    break;
+  case AVR::MOV8rim:
+    R[reg(MI, 0)] = readData(pair(reg(MI, 1)));
+    break;
+  case AVR::MOV8imr:
+    writeData(pair(reg(MI, 0)), R[reg(MI, 1)]);
+    break;
+  case AVR::LD8rm_P: {
+    unsigned Ptr = reg(MI, 2);
+    uint16_t Addr = pair(Ptr);
+    setPair(Ptr, Addr + 1);
+    R[reg(MI, 0)] = readData(Addr);
+    break;
+  }
+  case AVR::LD8rm_PD: {
+    unsigned Ptr = reg(MI, 2);
+    uint16_t Addr = pair(Ptr) - 1;
+    setPair(Ptr, Addr);
+    R[reg(MI, 0)] = readData(Addr);
+    break;
+  }
+  case AVR::ST8mr_P: {
+    unsigned Ptr = reg(MI, 1);
+    uint16_t Addr = pair(Ptr);
+    setPair(Ptr, Addr + 1);
+    writeData(Addr, R[reg(MI, 2)]);
+    break;
+  }
+  case AVR::ST8mr_PD: {
+    unsigned Ptr = reg(MI, 1);
+    uint16_t Addr = pair(Ptr) - 1;
+    setPair(Ptr, Addr);
+    writeData(Addr, R[reg(MI, 2)]);
+    break;
+  }
+
+  // Program memory.
+  case AVR::LPM:
+    R[0] = readFlash(pair(30));
+    break;
+  case AVR::LPM8rz:
+    R[reg(MI, 0)] = readFlash(pair(30));
+    break;
+  case AVR::LPM8rz_P:
+    R[reg(MI, 0)] = readFlash(pair(30));
+    setPair(30, pair(30) + 1);
+    break;
+  case AVR::ELPM8rz:
+    R[reg(MI, 0)] = readFlash((readIO(IO_RAMPZ) << 16) | pair(30));
+    break;
+  case AVR::ELPM8rz_P: {
+    uint32_t Addr = (readIO(IO_RAMPZ) << 16) | pair(30);
+    R[reg(MI, 0)] = readFlash(Addr);
+    ++Addr;
+    setPair(30, Addr);
+    writeIO(IO_RAMPZ, Addr >> 16);
+    break;
+  }
+
+  // Arithmetic. The two address ones have the result tied to operand 1.
+  case AVR::ADD8rr:
+    R[reg(MI, 0)] = add(R[reg(MI, 1)], R[reg(MI, 2)], false);
+    break;
+  case AVR::ADC8rr:
+    R[reg(MI, 0)] = add(R[reg(MI, 1)], R[reg(MI, 2)], getFlag(SREG_C));
+    break;
+  case AVR::SUB8rr:
+    R[reg(MI, 0)] = sub(R[reg(MI, 1)], R[reg(MI, 2)], false, false);
+    break;
+  case AVR::SBC8rr:
+    R[reg(MI, 0)] = sub(R[reg(MI, 1)], R[reg(MI, 2)], getFlag(SREG_C), true);
+    break;
+  case AVR::SUB8ri:
+    R[reg(MI, 0)] = sub(R[reg(MI, 1)], MI.getOperand(2).getImm(), false,
+                        false);
+    break;
+  case AVR::SBC8ri:
+    R[reg(MI, 0)] = sub(R[reg(MI, 1)], MI.getOperand(2).getImm(),
+                        getFlag(SREG_C), true);
+    break;
+  case AVR::CMP8rr:
+    sub(R[reg(MI, 0)], R[reg(MI, 1)], false, false);
+    break;
+  case AVR::CPC8rr:
+    sub(R[reg(MI, 0)], R[reg(MI, 1)], getFlag(SREG_C), true);
+    break;
+  case AVR::CMP8ri:
+    sub(R[reg(MI, 0)], MI.getOperand(1).getImm(), false, false);
+    break;
+  case AVR::ADD16wri:
+  case AVR::SUB16wri: {
+    unsigned Rd = reg(MI, 0);
+    uint16_t A = pair(Rd);
+    uint16_t K = MI.getOperand(2).getImm();
+    bool IsAdd = MI.getOpcode() == AVR::ADD16wri;
+    uint16_t Result = IsAdd ? A + K : A - K;
+    bool A15 = A & 0x8000, R15 = Result & 0x8000;
+    setFlag(SREG_V, IsAdd ? !A15 && R15 : A15 && !R15);
+    setFlag(SREG_C, IsAdd ? A15 && !R15 : !A15 && R15);
+    setFlag(SREG_N, R15);
+    setFlag(SREG_Z, Result == 0);
+    setFlag(SREG_S, getFlag(SREG_N) != getFlag(SREG_V));
+    setPair(Rd, Result);
+    break;
+  }
+  case AVR::AND8rr:
+    R[reg(MI, 0)] = logic(R[reg(MI, 1)] & R[reg(MI, 2)]);
+    break;
+  case AVR::AND8ri:
+    R[reg(MI, 0)] = logic(R[reg(MI, 1)] & MI.getOperand(2).getImm());
+    break;
+  case AVR::OR8rr:
+    R[reg(MI, 0)] = logic(R[reg(MI, 1)] | R[reg(MI, 2)]);
+    break;
+  case AVR::OR8ri:
+    R[reg(MI, 0)] = logic(R[reg(MI, 1)] | MI.getOperand(2).getImm());
+    break;
+  case AVR::XOR8rr:
+    R[reg(MI, 0)] = logic(R[reg(MI, 1)] ^ R[reg(MI, 2)]);
+    break;
+  case AVR::COM8r:
+    R[reg(MI, 0)] = logic(~R[reg(MI, 1)]);
+    setFlag(SREG_C, true);
+    break;
+  case AVR::NEG8r: {
+    uint8_t A = R[reg(MI, 1)];
+    uint8_t Result = -A;
+    setFlag(SREG_H, (Result | A) & 0x08);
+    setFlag(SREG_V, Result == 0x80);
+    setFlag(SREG_C, Result != 0);
+    setNZS(Result);
+    R[reg(MI, 0)] = Result;
+    break;
+  }
+  case AVR::INC8r: {
+    uint8_t Result = R[reg(MI, 1)] + 1;
+    setFlag(SREG_V, Result == 0x80);
+    setNZS(Result);
+    R[reg(MI, 0)] = Result;
+    break;
+  }
+
+  // Shifts. V is N xor C after all of them.
+  case AVR::Shr8r1:
+  case AVR::Shr8r1c:
+  case AVR::ROR8r1c: {
+    uint8_t A = R[reg(MI, 1)];
+    uint8_t Result = A >> 1;
+    if (MI.getOpcode() == AVR::Shr8r1c)
+      Result |= A & 0x80;
+    else if (MI.getOpcode() == AVR::ROR8r1c && getFlag(SREG_C))
+      Result |= 0x80;
+    setFlag(SREG_C, A & 1);
+    setFlag(SREG_V, bool(Result & 0x80) != bool(A & 1));
+    setNZS(Result);
+    R[reg(MI, 0)] = Result;
+    break;
+  }
+  case AVR::SWAP8r: {
+    uint8_t A = R[reg(MI, 1)];
+    R[reg(MI, 0)] = (A << 4) | (A >> 4);
+    break;
+  }
+
+  // Bits through T.
+  case AVR::BSTrb:
+    setFlag(SREG_T, R[reg(MI, 0)] & (1 << MI.getOperand(1).getImm()));
+    break;
+  case AVR::BLDrb: {
+    uint8_t Bit = 1 << MI.getOperand(2).getImm();
+    uint8_t A = R[reg(MI, 1)];
+    R[reg(MI, 0)] = getFlag(SREG_T) ? A | Bit : A & ~Bit;
+    break;
+  }
+
+  // Multiplies.
+  case AVR::MUL8rr:
+    multiply(R[reg(MI, 0)], R[reg(MI, 1)], false);
+    break;
+  case AVR::MULS8rr:
+    multiply(int8_t(R[reg(MI, 0)]), int8_t(R[reg(MI, 1)]), false);
+    break;
+  case AVR::MULSU8rr:
+    multiply(int8_t(R[reg(MI, 0)]), R[reg(MI, 1)], false);
+    break;
+  case AVR::FMUL8rr:
+    multiply(R[reg(MI, 0)], R[reg(MI, 1)], true);
+    break;
+  case AVR::FMULS8rr:
+    multiply(int8_t(R[reg(MI, 0)]), int8_t(R[reg(MI, 1)]), true);
+    break;
+  case AVR::FMULSU8rr:
+    multiply(int8_t(R[reg(MI, 0)]), R[reg(MI, 1)], true);
+    break;
+  }
+
+  unsigned Cost = D.Cycles + Extra;
+  Cycles += Cost;
+  ++Instructions;
+  ++OpcodeCounts[MI.getOpcode()];
+  OpcodeCycles[MI.getOpcode()] += Cost;
+  PC = NextPC;
+}
+
+/// run - Run from the byte address Start until PC gets to the byte address
+/// Exit, or to a jump to itself. Returns false if the cycle limit was hit.
+bool Simulator::run(uint32_t Start, uint32_t Exit) {
+  PC = Start / 2;
+  while (PC != Exit / 2) {
+    if (Cycles >= MaxCycles)
+      return false;
+
+    const Decoded &D = decode(PC);
+    if (!D.Valid)
+      fatal("unknown instruction at PC 0x" + Twine::utohexstr(PC * 2));
+
+    // The _exit of avr-libc stops in "rjmp .-2" with interrupts off.
+    if (D.Inst.getOpcode() == AVR::RJMP && D.Inst.getOperand(0).getImm() == -2)
+      return true;
+
+    execute(D);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+
+  LLVMInitializeAVRTargetInfo();
+  LLVMInitializeAVRTargetMC();
+  LLVMInitializeAVRDisassembler();
+
+  cl::ParseCommandLineOptions(argc, argv, "AVR cycle counting simulator\n");
+  ToolName = argv[0];
+
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget("avr", Error);
+  if (!TheTarget)
+    fatal(Error);
+
+  OwningPtr<const MCSubtargetInfo>
+    STI(TheTarget->createMCSubtargetInfo("avr", MCPU, ""));
+  OwningPtr<const MCInstrInfo> MII(TheTarget->createMCInstrInfo());
+  OwningPtr<const MCDisassembler> Dis(TheTarget->createMCDisassembler(*STI));
+  if (!STI || !MII || !Dis)
+    fatal("the AVR target is incomplete");
+
+  bool IsXMEGA = STI->getFeatureBits() & AVR::FeatureXMEGA;
+  uint32_t RAMFirst = RAMStart.getNumOccurrences() ? unsigned(RAMStart)
+                                                   : IsXMEGA ? 0x2000 : 0x100;
+  uint32_t RAMBytes = RAMSize.getNumOccurrences() ? unsigned(RAMSize)
+                                                  : IsXMEGA ? 0x2000 : 0x800;
+  if (RAMFirst + RAMBytes > 0x10000 || RAMBytes == 0)
+    fatal("SRAM does not fit in the 64K of data space");
+  uint16_t RAMEnd = RAMFirst + RAMBytes - 1;
+
+  // Load the input.
+  std::vector<MemoryBuffer*> Buffers;
+  std::vector<ELFFile*> Objects;
+  Image Img;
+  for (unsigned i = 0, e = InputFilenames.size(); i != e; ++i) {
+    OwningPtr<MemoryBuffer> Buffer;
+    if (error_code ec = MemoryBuffer::getFile(InputFilenames[i], Buffer))
+      fatal(InputFilenames[i] + ": " + ec.message());
+    Buffers.push_back(Buffer.take());
+    ELFFile *F = new ELFFile(Buffers.back()->getBuffer(), InputFilenames[i]);
+    F->check();
+    if (F->getType() == ELF::ET_EXEC) {
+      if (e != 1)
+        fatal("an executable has to be the only input");
+      loadExecutable(*F, Img);
+    } else if (F->getType() == ELF::ET_REL) {
+      Objects.push_back(F);
+      continue;
+    } else {
+      fatal(InputFilenames[i] + ": neither an object nor an executable");
+    }
+    delete F;
+  }
+  if (!Objects.empty())
+    loadObjects(Objects, Img, RAMFirst);
+  for (unsigned i = 0, e = Objects.size(); i != e; ++i)
+    delete Objects[i];
+  for (unsigned i = 0, e = Buffers.size(); i != e; ++i)
+    delete Buffers[i];
+
+  if (Img.DataEnd > RAMEnd)
+    fatal("data does not fit in SRAM");
+
+  Simulator Sim(Img, *Dis, *MII, *STI, MCPU, RAMEnd);
+
+  // Call the entry with a return address just past the end of flash, unless
+  // an executable is run from reset.
+  uint32_t Start = Img.Entry, Exit = ~0U;
+  if (!Img.FromReset || !EntryName.empty()) {
+    StringRef Name = EntryName.empty() ? StringRef("main")
+                                       : StringRef(EntryName);
+    StringMap<uint32_t>::const_iterator I = Img.Symbols.find(Name);
+    if (I == Img.Symbols.end())
+      fatal("no entry point " + Name);
+    Start = I->second;
+    Exit = (Img.Flash.size() + 1) & ~1U;
+    Sim.pushPC(Exit / 2);
+  }
+
+  bool Finished = Sim.run(Start, Exit);
+  if (ConsolePort)
+    outs() << "\n";
+
+  uint16_t Result = Sim.getReturnValue();
+  if (Finished)
+    outs() << "returned:     " << int16_t(Result)
+           << format(" (0x%04x)", Result) << "\n";
+  else
+    outs() << "stopped after " << MaxCycles << " cycles\n";
+  outs() << "cycles:       " << Sim.Cycles << "\n"
+         << "instructions: " << Sim.Instructions << "\n"
+         << "stack:        " << unsigned(RAMEnd - Sim.MinSP) << " bytes\n";
+
+  if (Histogram) {
+    std::vector<std::pair<uint64_t, unsigned> > ByCycles;
+    for (unsigned Opc = 0, e = Sim.OpcodeCounts.size(); Opc != e; ++Opc)
+      if (Sim.OpcodeCounts[Opc])
+        ByCycles.push_back(std::make_pair(Sim.OpcodeCycles[Opc], Opc));
+    std::sort(ByCycles.rbegin(), ByCycles.rend());
+
+    outs() << "\n" << format("%-16s %12s %12s", "opcode", "count", "cycles")
+           << "\n";
+    for (unsigned i = 0, e = ByCycles.size(); i != e; ++i) {
+      unsigned Opc = ByCycles[i].second;
+      outs() << format("%-16s %12llu %12llu", MII->getName(Opc),
+                       (unsigned long long)Sim.OpcodeCounts[Opc],
+                       (unsigned long long)Sim.OpcodeCycles[Opc])
+             << "\n";
+    }
+  }
+
+  return Finished ? 0 : 1;
+}